@@ -31,9 +31,14 @@ void PLATFORM_ATTR_ISR C64Emu::intervalTimerProfilingBatteryCheckFunc() {
     // get battery voltage
     uint16_t voltage = board->getBatteryVoltage();
     cpu.batteryVoltage.store(voltage, std::memory_order_release);
-    // if battery voltage is too low, then power off device
+    // if battery voltage is too low, then power off device (after the
+    // emulation has written back the disk image)
     if (voltage < 3400) {
-      board->powerOff();
+      uint8_t cmd =
+          static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::POWEROFF);
+      if (!cpu.extCmdQueue.push(&cmd, 1)) {
+        board->powerOff();
+      }
     }
     // reset "timer"
     cntSecondsForBatteryCheck = 0;
@@ -64,26 +69,20 @@ void PLATFORM_ATTR_ISR C64Emu::intervalTimerProfilingBatteryCheckFunc() {
   showperfvalues.store(true, std::memory_order_release);
 }
 
-void PLATFORM_ATTR_ISR C64Emu::intervalTimerTODFunc() {
-  cpu.cia1.updateTOD();
-  cpu.cia2.updateTOD();
+void C64Emu::cpuCode(void *parameter) {
+  // keyboard scan and CIA real time clock (TOD) are driven by the emulation
+  cpu.run();
+  // cpu runs forever -> no vTaskDelete(NULL);
 }
 
-void PLATFORM_ATTR_ISR C64Emu::intervalTimerScanKeyboardFunc() {
-  cpu.scanKeyboard();
+void C64Emu::sidCode(void *parameter) {
+  cpu.sid.run();
+  // sid synthesis runs forever -> no vTaskDelete(NULL);
 }
 
-void C64Emu::cpuCode(void *parameter) {
-  // timer interrupts each 8 ms to scan keyboard
-  PlatformManager::getInstance().startIntervalTimer(
-      std::bind(&C64Emu::intervalTimerScanKeyboardFunc, this), 8000);
-
-  // timer interrupts each 100 ms to increment CIA real time clock (TOD)
-  PlatformManager::getInstance().startIntervalTimer(
-      std::bind(&C64Emu::intervalTimerTODFunc, this), 100000);
-
-  cpu.run();
-  // cpu runs forever -> no vTaskDelete(NULL);
+void C64Emu::driveCode(void *parameter) {
+  cpu.floppy.run();
+  // drive runs forever -> no vTaskDelete(NULL);
 }
 
 void C64Emu::setup() {
@@ -104,12 +103,29 @@ void C64Emu::setup() {
 
   // init CPU
   cpu.init(ram, charset_rom);
+#ifdef USE_CAPTURE
+  if (Config::CAPTUREFILE) {
+    cpu.capture.start(Config::CAPTUREFILE);
+  }
+#endif
 
-  // start cpu task
   using namespace std::placeholders;
+#ifndef USE_NOSOUND
+  // start sid synthesis task (on the other core than the cpu task)
+  PlatformManager::getInstance().startTask(
+      std::bind(&C64Emu::sidCode, this, _1), 0, 2);
+#endif
+
+  // start cpu task
   PlatformManager::getInstance().startTask(
       std::bind(&C64Emu::cpuCode, this, _1), 1, 19);
 
+  // start true drive task (on the other core than the cpu task)
+  if (cpu.floppy.truedrive) {
+    PlatformManager::getInstance().startTask(
+        std::bind(&C64Emu::driveCode, this, _1), 0, 2);
+  }
+
   // profiling + battery check: timer interrupts each second
   // using namespace std::placeholders;
   PlatformManager::getInstance().startIntervalTimer(
@@ -140,5 +156,11 @@ void C64Emu::loop() {
     PlatformManager::getInstance().log(
         LOG_INFO, TAG, "voltage: %d",
         cpu.batteryVoltage.load(std::memory_order_acquire));
+    // speed governor, audio
+    cpu.governor.logPerfValues();
+    cpu.runahead.logPerfValues();
+    cpu.rewind.logPerfValues();
+    cpu.sid.logPerfValues();
+    Floppy::ioworker.logPerfValues();
   }
 }
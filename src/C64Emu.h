@@ -28,10 +28,10 @@ private:
   BoardDriver *board;
   uint16_t cntSecondsForBatteryCheck;
 
-  void intervalTimerTODFunc();
-  void intervalTimerScanKeyboardFunc();
   void intervalTimerProfilingBatteryCheckFunc();
   void cpuCode(void *parameter);
+  void sidCode(void *parameter);
+  void driveCode(void *parameter);
   void calibrateBattery();
 
 public:
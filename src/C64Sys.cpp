@@ -24,6 +24,7 @@
 #include "Floppy.h"
 #include "Hooks.h"
 #include "SID.h"
+#include "SaveState.h"
 #include "VIC.h"
 #include "joystick/JoystickDriver.h"
 #include "joystick/JoystickFactory.h"
@@ -50,21 +51,26 @@ static const char *TAG = "C64Sys";
 // => use "(cia1.ciareg[0x00] | ~ddra) & input;" instead of
 // "(cia1.ciareg[0x00] & ddra) | (input & ~ddra);"
 
+inline uint8_t C64Sys::nextRandom() {
+  // xorshift32, part of the machine state so replays are deterministic
+  randomstate ^= randomstate << 13;
+  randomstate ^= randomstate >> 17;
+  randomstate ^= randomstate << 5;
+  return randomstate >> 24;
+}
+
 uint8_t C64Sys::getDC01(uint8_t dc00, bool xchgports) {
-  uint8_t kbcodedc01 =
-      xchgports ? keyboard->getKBCodeDC00() : keyboard->getKBCodeDC01();
-  uint8_t kbcodedc00 =
-      xchgports ? keyboard->getKBCodeDC01() : keyboard->getKBCodeDC00();
-  if (actInGameKeycodeChosen.load(std::memory_order_acquire) && (!xchgports)) {
-    kbcodedc00 = actInGameKeycode.dc00;
-    kbcodedc01 = actInGameKeycode.dc01;
+  uint8_t kbcodedc01 = xchgports ? input.kbcodedc00 : input.kbcodedc01;
+  uint8_t kbcodedc00 = xchgports ? input.kbcodedc01 : input.kbcodedc00;
+  if (input.ingamekey && (!xchgports)) {
+    kbcodedc00 = input.ingamedc00;
+    kbcodedc01 = input.ingamedc01;
   }
   if (dc00 == 0) {
     return kbcodedc01;
   }
   // key combined with a "special key" (shift, ctrl, commodore)?
-  if ((~dc00 & 2) &&
-      (keyboard->getShiftctrlcode() & 1)) { // *query* left shift key?
+  if ((~dc00 & 2) && (input.shiftctrlcode & 1)) { // *query* left shift key?
     if (kbcodedc00 == 0xfd) {
       // handle scan of key codes in the same "row"
       return kbcodedc01 & 0x7f;
@@ -72,7 +78,7 @@ uint8_t C64Sys::getDC01(uint8_t dc00, bool xchgports) {
       return 0x7f;
     }
   } else if ((~dc00 & 0x40) &&
-             (keyboard->getShiftctrlcode() & 1)) { // *query* right shift key?
+             (input.shiftctrlcode & 1)) { // *query* right shift key?
     if (kbcodedc00 == 0xbf) {
       // handle scan of key codes in the same "row"
       return kbcodedc01 & 0xef;
@@ -80,7 +86,7 @@ uint8_t C64Sys::getDC01(uint8_t dc00, bool xchgports) {
       return 0xef;
     }
   } else if ((~dc00 & 0x80) &&
-             (keyboard->getShiftctrlcode() & 2)) { // *query* ctrl key?
+             (input.shiftctrlcode & 2)) { // *query* ctrl key?
     if (kbcodedc00 == 0x7f) {
       // handle scan of key codes in the same "row"
       return kbcodedc01 & 0xfb;
@@ -88,7 +94,7 @@ uint8_t C64Sys::getDC01(uint8_t dc00, bool xchgports) {
       return 0xfb;
     }
   } else if ((~dc00 & 0x80) &&
-             (keyboard->getShiftctrlcode() & 4)) { // *query* commodore key?
+             (input.shiftctrlcode & 4)) { // *query* commodore key?
     if (kbcodedc00 == 0x7f) {
       // handle scan of key codes in the same "row"
       return kbcodedc01 & 0xdf;
@@ -104,6 +110,102 @@ uint8_t C64Sys::getDC01(uint8_t dc00, bool xchgports) {
   }
 }
 
+void C64Sys::readInput(InputState &act) {
+  memset(&act, 0, sizeof(act));
+  act.kbcodedc00 = keyboard->getKBCodeDC00();
+  act.kbcodedc01 = keyboard->getKBCodeDC01();
+  act.shiftctrlcode = keyboard->getShiftctrlcode();
+  act.kbjoyvalue = (kbjoystickmode != 0) ? keyboard->getKBJoyValue() : 0xff;
+  act.joyvalue = (joystickmode != 0) ? joystick->getValue() : 0xff;
+  act.fire2 = (joystickmode == 2) && joystick->getFire2();
+  act.ingamekey = actInGameKeycodeChosen.load(std::memory_order_acquire);
+  act.ingamedc00 = act.ingamekey ? actInGameKeycode.dc00 : 0;
+  act.ingamedc01 = act.ingamekey ? actInGameKeycode.dc01 : 0;
+  act.joystickmode = joystickmode;
+  act.kbjoystickmode = kbjoystickmode;
+  act.specialjoymode = specialjoymode;
+}
+
+void C64Sys::latchInput(bool force) {
+  InputState act;
+  readInput(act);
+  setInput(act, force);
+}
+
+void C64Sys::latchMovieInput() {
+  // once per frame, the input is recorded resp. taken from the movie
+  InputState act;
+  if (movie.isReplaying()) {
+    if (movie.nextInput(&act)) {
+      setInput(act, false);
+    }
+  } else {
+    readInput(act);
+    movie.recordInput(&act);
+    setInput(act, false);
+  }
+}
+
+void C64Sys::setInput(const InputState &act, bool force) {
+  if (!force && (memcmp(&act, &input, sizeof(act)) == 0)) {
+    return;
+  }
+  if (!force) {
+    // latency measurement (key presses and joystick changes, key releases
+    // usually have no visible effect): keep the previous tables to detect
+    // the first read of a changed value
+    memcpy(prevdc00lut, dc00lut, sizeof(dc00lut));
+    memcpy(prevdc01lut, dc01lut, sizeof(dc01lut));
+    bool keypressed = ((act.kbcodedc00 != input.kbcodedc00) ||
+                       (act.kbcodedc01 != input.kbcodedc01) ||
+                       (act.shiftctrlcode != input.shiftctrlcode)) &&
+                      ((act.kbcodedc01 != 0xff) || (act.shiftctrlcode != 0));
+    bool kbjoychanged = act.kbjoyvalue != input.kbjoyvalue;
+    bool joychanged =
+        (act.joyvalue != input.joyvalue) || (act.fire2 != input.fire2);
+    if (keypressed || kbjoychanged) {
+      int64_t eventtime = keyboard->getEventTimeUS();
+      if (eventtime == 0) {
+        eventtime = PlatformManager::getInstance().getTimeUS();
+      }
+      inputlatency.inputChanged(eventtime, vic.getBitmap());
+    } else if (joychanged) {
+      // polled input: no event timestamp available
+      inputlatency.inputChanged(PlatformManager::getInstance().getTimeUS(),
+                                vic.getBitmap());
+    }
+  }
+  memcpy(&input, &act, sizeof(act));
+  for (uint16_t i = 0; i < 256; i++) {
+    // port A: keyboard (rows) + joystick in port 2
+    uint8_t val = getDC01(i, true);
+    if (val == 0xff) {
+      // no key pressed -> joystick value
+      if ((input.joystickmode == 2) && (!input.specialjoymode)) {
+        val = input.joyvalue;
+      } else if (input.kbjoystickmode == 2) {
+        val = input.kbjoyvalue;
+      }
+    }
+    dc00lut[i] = val;
+    // port B: keyboard (columns) + joystick in port 1
+    val = getDC01(i, false);
+    if ((input.joystickmode == 2) && (!input.specialjoymode) &&
+        (i == 0x7f) && input.fire2) {
+      // special case: handle fire2 button -> space key
+      val = 0xef;
+    } else if (val == 0xff) {
+      // no key pressed -> joystick value
+      if ((input.joystickmode == 1) && (!input.specialjoymode)) {
+        val = input.joyvalue;
+      } else if (input.kbjoystickmode == 1) {
+        val = input.kbjoyvalue;
+      }
+    }
+    dc01lut[i] = val;
+  }
+}
+
 uint8_t C64Sys::getMem(uint16_t addr) {
   if ((!bankARAM) && ((addr >= 0xa000) && (addr <= 0xbfff))) {
     //    basic rom
@@ -130,9 +232,9 @@ uint8_t C64Sys::getMem(uint16_t addr) {
     else if (addr <= 0xd7ff) {
       uint8_t sididx = (addr - 0xd400) % 0x20;
       if (sididx == 0x1b) {
-        return PlatformManager::getInstance().getRandomByte();
+        return nextRandom();
       } else if (sididx == 0x1c) {
-        return static_cast<uint8_t>(sid.sidVoice[2].envelope) * 255.0f;
+        return sid.getEnvelope3();
       } else {
         return sid.sidreg[sididx];
       }
@@ -146,40 +248,20 @@ uint8_t C64Sys::getMem(uint16_t addr) {
       uint8_t ciaidx = (addr - 0xdc00) % 0x10;
       if (ciaidx == 0x00) {
         uint8_t ddra = cia1.ciareg[0x02];
-        uint8_t input = getDC01(cia1.ciareg[0x01], true);
-        if ((joystickmode == 2) && (!specialjoymode)) {
-          if (input == 0xff) {
-            // no key pressed -> return joystick value (of real joystick)
-            input = joystick->getValue();
-          }
-        } else if (kbjoystickmode == 2) {
-          if (input == 0xff) {
-            // no key pressed -> return joystick value (of keyboard joystick)
-            input = keyboard->getKBJoyValue();
-          }
+        uint8_t idx = cia1.ciareg[0x01];
+        if (inputlatency.isWaitingForRead() &&
+            (dc00lut[idx] != prevdc00lut[idx])) {
+          inputlatency.inputRead();
         }
-        return (cia1.ciareg[0x00] | ~ddra) & input;
+        return (cia1.ciareg[0x00] | ~ddra) & dc00lut[idx];
       } else if (ciaidx == 0x01) {
         uint8_t ddrb = cia1.ciareg[0x03];
-        uint8_t input = getDC01(cia1.ciareg[0x00], false);
-        if ((joystickmode == 2) && (!specialjoymode)) {
-          // special case: handle fire2 button -> space key
-          if ((cia1.ciareg[0x00] == 0x7f) && joystick->getFire2()) {
-            return 0xef;
-          }
-        }
-        if ((joystickmode == 1) && (!specialjoymode)) {
-          if (input == 0xff) {
-            // no key pressed -> return joystick value (of real joystick)
-            input = joystick->getValue();
-          }
-        } else if (kbjoystickmode == 1) {
-          if (input == 0xff) {
-            // no key pressed -> return joystick value (of keyboard joystick)
-            input = keyboard->getKBJoyValue();
-          }
+        uint8_t idx = cia1.ciareg[0x00];
+        if (inputlatency.isWaitingForRead() &&
+            (dc01lut[idx] != prevdc01lut[idx])) {
+          inputlatency.inputRead();
         }
-        return (cia1.ciareg[0x01] | ~ddrb) & input;
+        return (cia1.ciareg[0x01] | ~ddrb) & dc01lut[idx];
       }
       return cia1.getCommonCIAReg(ciaidx);
     }
@@ -188,6 +270,11 @@ uint8_t C64Sys::getMem(uint16_t addr) {
       uint8_t ciaidx = (addr - 0xdd00) % 0x10;
       if (ciaidx == 0x00) {
         uint8_t ddra = cia2.ciareg[0x02];
+        if (floppy.truedrive) {
+          // bit 6 - 7: CLK and DATA of the serial bus
+          return ((cia2.ciareg[0x00] | ~ddra) & 0x3f) |
+                 floppy.iec.c64Read(linestartcycles + numofcycles);
+        }
         return cia2.ciareg[0x00] | ~ddra;
       } else if (ciaidx == 0x01) {
         uint8_t ddrb = cia2.ciareg[0x03];
@@ -322,39 +409,13 @@ void C64Sys::setMem(uint16_t addr, uint8_t val) {
     }
     // ** SID **
     else if (addr <= 0xd7ff) {
-      uint8_t sididx = (addr - 0xd400) % 0x20;
-      sid.sidreg[sididx] = val;
-      if (sididx <= 0x14) {
-        uint8_t voice = sididx / 7;
-        int regInVoice = sididx % 7;
-        switch (regInVoice) {
-        case 0:
-        case 1:
-          sid.sidVoice[voice].updVarFrequency(sid.sidreg[voice * 7] |
-                                              (sid.sidreg[1 + voice * 7] << 8));
-          break;
-        case 2:
-        case 3:
-          sid.sidVoice[voice].updVarPulseWidth(
-              sid.sidreg[2 + voice * 7] | (sid.sidreg[3 + voice * 7] << 8));
-          break;
-        case 4:
-          sid.sidVoice[voice].updVarControl(sid.sidreg[sididx]);
-          break;
-        case 5:
-          sid.sidVoice[voice].updVarEnvelopeAD(sid.sidreg[sididx]);
-          break;
-        case 6:
-          sid.sidVoice[voice].updVarEnvelopeSR(sid.sidreg[sididx]);
-          break;
-        }
-      } else if (sididx == 0x18) {
-        sid.c64Volume = (float)(val & 0x0f) / 15.0;
-      }
+      sid.writeReg((addr - 0xd400) % 0x20, val,
+                   vic.rasterline * 63 + numofcycles);
     }
     // ** Colorram **
     else if (addr <= 0xdbff) {
       vic.colormap[addr - 0xd800] = val;
+      rewind.markColorRAMDirty(addr - 0xd800);
     }
     // ** CIA 1 **
     else if (addr <= 0xdcff) {
@@ -388,11 +449,20 @@ void C64Sys::setMem(uint16_t addr, uint8_t val) {
           vic.vicmem = 0x0000;
           break;
         }
-        cia2.ciareg[ciaidx] = 0x94 | bank;
+        if (floppy.truedrive) {
+          cia2.ciareg[ciaidx] = val;
+          writeIEC();
+        } else {
+          // ATN is used by the kernal hooks
+          cia2.ciareg[ciaidx] = 0x94 | (val & 0x08) | bank;
+        }
         // adapt VIC base addresses
         adaptVICBaseAddrs(true);
       } else {
         cia2.setCommonCIAReg(ciaidx, val);
+        if ((ciaidx == 0x02) && floppy.truedrive) {
+          writeIEC();
+        }
       }
     }
   }
@@ -404,6 +474,7 @@ void C64Sys::setMem(uint16_t addr, uint8_t val) {
   // ** ram **
   else {
     ram[addr] = val;
+    rewind.markDirty(addr);
   }
 }
 
@@ -421,7 +492,14 @@ void C64Sys::cmd6502nop1a() {
 */
 
 void C64Sys::cmd6502brk() {
+  if (runningahead && hooks->isHook(pc)) {
+    // floppy access is not part of the snapshot -> abort run-ahead
+    cpuhalted = true;
+    return;
+  }
   if (hooks->handlehooks(pc)) {
+    // hooks (floppy access) write to ram directly
+    rewind.markAllDirty();
     return;
   }
   pc++;
@@ -444,9 +522,13 @@ uint8_t C64Sys::getSR() { return sr; }
 uint16_t C64Sys::getPC() { return pc; }
 void C64Sys::setPC(uint16_t newPC) { pc = newPC; }
 
+void C64Sys::pushReturnAddr(uint16_t addr) {
+  uint16_t retaddr = addr - 1;
+  ram[0x100 + sp--] = retaddr >> 8;
+  ram[0x100 + sp--] = retaddr & 0xff;
+}
+
 void C64Sys::checkciatimers(uint8_t cycles) {
-  // CIA 1 TOD alarm
-  cia1.checkAlarm();
   // check for CIA 1 TOD alarm interrupt
   if (((cia1.latchdc0d & 0x84) == 0x84) && (!iflag)) {
     setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
@@ -467,8 +549,6 @@ void C64Sys::checkciatimers(uint8_t cycles) {
   if (((cia1.latchdc0d & 0x88) == 0x88) && (!iflag)) {
     setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
   }
-  // CIA 2 TOD alarm
-  cia2.checkAlarm();
   // check for CIA 2 TOD alarm interrupt
   if (((cia2.latchdc0d & 0x84) == 0x84) && nmiAck) {
     nmiAck = false;
@@ -630,18 +710,11 @@ uint8_t C64Sys::checkJoystickOnlyStatemachine(bool fire2pressed) {
     } else if (leftpressed) {
       if (floppy.fsinitialized) {
         cpuhalted = true;
-        uint16_t addr = floppy.load(actfilename, ram);
-        if (addr != 0) {
+        std::string name = actfilename;
+        floppy.rmPrgFromFilename(name);
+        if (launchProgram(name)) {
           specialjoymodestate = SpecialJoyModeState::RUN;
           vic.doiactive[1] = false;
-          externalCmds->setVarTab(addr);
-          ram[0xd3] = 0;
-          ram[0x0277] = 'R';
-          ram[0x0278] = 'U';
-          ram[0x0279] = 'N';
-          ram[0x027A] = ':';
-          ram[0x027B] = 0x0d;
-          ram[0x00C6] = 5;
         }
         cpuhalted = false;
       }
@@ -700,40 +773,73 @@ uint8_t C64Sys::checkJoystickOnlyStatemachine(bool fire2pressed) {
   return ret;
 }
 
+// external commands changing the memory, the registers or the floppy state
+static bool changesMachineState(ExtCmd cmd) {
+  switch (cmd) {
+  case ExtCmd::LOAD:
+  case ExtCmd::RECEIVEDATA:
+  case ExtCmd::RESTORE:
+  case ExtCmd::WRITETEXT:
+  case ExtCmd::ATTACHD64:
+  case ExtCmd::LOADSTATE:
+  case ExtCmd::REWIND:
+  case ExtCmd::RESET:
+    return true;
+  default:
+    return false;
+  }
+}
+
 void C64Sys::check4extcmd() {
+  // LOAD, SAVE or LIST executed in the background
+  if (externalCmds->checkPendingIO()) {
+    rewind.markAllDirty();
+  }
+  // joystick only mode: long press of fire2 button
   bool fire2pressed = false;
   if ((specialjoymodestate == SpecialJoyModeState::NONE) ||
       (specialjoymodestate == SpecialJoyModeState::RUN)) {
-    bool fire2pressing = joystick->getFire2();
-    if (fire2pressing) {
-      specialjoymodecnt++;
+    if (joystick->getFire2()) {
+      if (specialjoymodecnt < FIRE2LONGPRESSFRAMES) {
+        specialjoymodecnt++;
+      }
     } else {
       specialjoymodecnt = 0;
     }
-    if (specialjoymodecnt >= 100 * 312) {
+    if (specialjoymodecnt >= FIRE2LONGPRESSFRAMES) {
       fire2pressed = true;
     }
   }
-  bool executeExtCmdKB = false;
-  bool executeExtCmdGM = false;
-  uint8_t extCmdBufferGM[1];
-  uint8_t *extCmdBufferKB = keyboard->getExtCmdData();
-  if (extCmdBufferKB != nullptr) {
-    executeExtCmdKB = true;
-  } else {
-    extCmdBufferGM[0] = checkJoystickOnlyStatemachine(fire2pressed);
-    executeExtCmdGM = true;
-  }
-  // ececute external command?
-  if (executeExtCmdKB || executeExtCmdGM) {
-    uint8_t type;
-    if (executeExtCmdKB) {
-      type = externalCmds->executeExternalCmd(extCmdBufferKB);
-      // sync detectreleasekey
-      keyboard->setDetectReleasekey(detectreleasekey);
-    } else {
-      type = externalCmds->executeExternalCmd(extCmdBufferGM);
+  uint8_t extCmdGM = checkJoystickOnlyStatemachine(fire2pressed);
+  if ((extCmdGM != 0) && !movie.isReplaying()) {
+    extCmdQueue.push(&extCmdGM, 1);
+  }
+  // execute external commands
+  uint8_t *extCmdBuffer;
+  while ((extCmdBuffer = extCmdQueue.front()) != nullptr) {
+    ExtCmd cmd = static_cast<ExtCmd>(extCmdBuffer[0]);
+    if (movie.isReplaying() && (cmd != ExtCmd::MOVIE) &&
+        (cmd != ExtCmd::POWEROFF)) {
+      // live input is ignored during a replay
+      extCmdQueue.release();
+      continue;
     }
+    if (changesMachineState(cmd)) {
+      // the READY state resp. the state of a launched program must not
+      // contain the effects of the command
+      instantboot.cancelColdStart();
+      programcache.cancel();
+    }
+    if (movie.isRecording() && (cmd != ExtCmd::MOVIE) &&
+        (cmd != ExtCmd::PAUSE) && (cmd != ExtCmd::POWEROFF)) {
+      movie.recordCommand(extCmdBuffer);
+    }
+    uint8_t type = externalCmds->executeExternalCmd(extCmdBuffer);
+    extCmdQueue.release();
+    // external commands may write to ram directly
+    rewind.markAllDirty();
+    // sync detectreleasekey
+    keyboard->setDetectReleasekey(detectreleasekey);
     // send notification
     uint8_t *data;
     size_t size;
@@ -758,6 +864,10 @@ void C64Sys::check4extcmd() {
       data = reinterpret_cast<uint8_t *>(&(externalCmds->type5notification));
       size = sizeof(externalCmds->type5notification);
       break;
+    case 6:
+      data = reinterpret_cast<uint8_t *>(&(externalCmds->type6notification));
+      size = sizeof(externalCmds->type6notification);
+      break;
     default:
       type = 0;
     }
@@ -765,9 +875,129 @@ void C64Sys::check4extcmd() {
       keyboard->sendExtCmdNotification(data, size);
       PlatformManager::getInstance().log(LOG_INFO, TAG, "notification sent");
     }
+    if (cmd == ExtCmd::MOVIE) {
+      // further commands belong to the movie
+      break;
+    }
+  }
+  // commands of the replayed movie
+  while ((extCmdBuffer = movie.nextCommand()) != nullptr) {
+    externalCmds->executeExternalCmd(extCmdBuffer);
+    rewind.markAllDirty();
+  }
+}
+
+void C64Sys::writeIEC() {
+  // bit 3 - 5: ATN, CLK and DATA out (inverted: 1 pulls the line low)
+  uint8_t pins = cia2.ciareg[0x00] | ~cia2.ciareg[0x02];
+  floppy.iec.c64Write(linestartcycles + numofcycles, (pins >> 3) & 0x07);
+}
+
+void C64Sys::emulateRasterline() {
+  // prepare next rasterline
+  uint8_t badlinecycles = vic.nextRasterline();
+  if (deactivateTemp) {
+    badlinecycles = 0;
+  }
+  linestartcycles = totalcycles + adjustcycles;
+
+  // calculate number of cycles to execute
+  numofcycles = 0;
+  int8_t numofcyclestoexe = 63 - badlinecycles - adjustcycles;
+  if (numofcyclestoexe < 0) {
+    numofcyclestoexe = 0;
+  }
+
+  // execute CPU cycles and check CIA timers
+  while (numofcycles < numofcyclestoexe / 2) {
+    if (cpuhalted) {
+      break;
+    }
+    logDebugInfo();
+    execute(getMem(pc++));
+    // check interrupt request (VIC or CIA) nach jedem Befehl
+    if ((vic.vicreg[0x19] & 0x81) && (vic.vicreg[0x1a] & 1) && (!iflag)) {
+      setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
+    }
+  }
+  checkciatimers(31);
+
+  // draw rasterline
+  vic.drawRasterline();
+
+  // execute CPU cycles and check CIA timers
+  while (numofcycles < numofcyclestoexe) {
+    if (cpuhalted) {
+      break;
+    }
+    logDebugInfo();
+    execute(getMem(pc++));
+    // check interrupt request (VIC or CIA) nach jedem Befehl
+    if ((vic.vicreg[0x19] & 0x81) && (vic.vicreg[0x1a] & 1) && (!iflag)) {
+      setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
+    }
+  }
+  checkciatimers(32);
+  sid.clockEnvelope3(63);
+  adjustcycles = numofcycles - numofcyclestoexe;
+  totalcycles += 63;
+  if (floppy.truedrive) {
+    floppy.iec.c64Sync(totalcycles);
+  }
+
+  // sprite collision interrupt?
+  if ((vic.vicreg[0x19] & 0x86) && (vic.vicreg[0x1a] & 6) && (!iflag)) {
+    setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
+  }
+
+  // restore key pressed?
+  if (restorenmi && nmiAck) {
+    nmiAck = false;
+    restorenmi = false;
+    setPCToIntVec(getMem(0xfffa) + (getMem(0xfffb) << 8), false);
+  }
+
+  // power line frequency (50 Hz) for the TOD clocks
+  if (vic.rasterline == 311) {
+    cia1.powerLineTick();
+    cia2.powerLineTick();
   }
 }
 
+void C64Sys::runAhead() {
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  saveState(*runahead.snapshot);
+  int64_t saved = platform.getTimeUS();
+  runningahead = true;
+  sid.setSuppressed(true);
+  uint8_t frame = 0;
+  while ((frame < runahead.frames) && (!cpuhalted)) {
+    // only the last frame is shown
+    frame++;
+    vic.setSuppressed(frame < runahead.frames);
+    do {
+      emulateRasterline();
+    } while ((vic.rasterline != 311) && (!cpuhalted));
+  }
+  runningahead = false;
+  sid.setSuppressed(movie.isHeadless());
+  bool aborted = cpuhalted;
+  int64_t emulated = platform.getTimeUS();
+  loadState(*runahead.snapshot);
+  int64_t end = platform.getTimeUS();
+  if (aborted) {
+    // show the actual frames for a while
+    runahead.abort();
+    vic.setSuppressed(false);
+  } else {
+    // the actual frame is not shown
+    vic.setSuppressed(true);
+  }
+  runahead.addStatistics(frame, emulated - saved,
+                         (saved - start) + (end - emulated));
+}
+
 void C64Sys::run() {
   // pc *must* be set externally!
   cpuhalted = false;
@@ -776,94 +1006,66 @@ void C64Sys::run() {
   debugNumOfSteps = 0;
   detectreleasekey = true;
   numofcycles = 0;
-  uint8_t badlinecycles = 0;
-  uint8_t adjustcycles = 0;
-  int64_t lastMeasuredTime = PlatformManager::getInstance().getTimeUS();
+  adjustcycles = 0;
+  uint8_t kbscanlines = 0;
+  latchInput(true);
+  governor.init();
   while (true) {
-    // check for "external commands" once per frame
-    check4extcmd();
-
-    // cpu halted?
+    // cpu halted? (keyboard is still scanned and external commands are still
+    // executed to be able to continue)
     if (cpuhalted) {
+      check4extcmd();
+      scanKeyboard();
+      PlatformManager::getInstance().waitMS(8);
+      governor.init();
       continue;
     }
 
-    // prepare next rasterline
-    badlinecycles = vic.nextRasterline();
-    if (deactivateTemp) {
-      badlinecycles = 0;
-    }
-
-    // calculate number of cycles to execute
-    numofcycles = 0;
-    int8_t numofcyclestoexe = 63 - badlinecycles - adjustcycles;
-    if (numofcyclestoexe < 0) {
-      numofcyclestoexe = 0;
-    }
+    emulateRasterline();
 
-    // execute CPU cycles and check CIA timers
-    while (numofcycles < numofcyclestoexe / 2) {
-      if (cpuhalted) {
-        break;
-      }
-      logDebugInfo();
-      execute(getMem(pc++));
-      // check interrupt request (VIC or CIA) nach jedem Befehl
-      if ((vic.vicreg[0x19] & 0x81) && (vic.vicreg[0x1a] & 1) && (!iflag)) {
-        setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
-      }
+    // keyboard scan every 8 ms (emulated time)
+    if (++kbscanlines == KBSCANLINES) {
+      kbscanlines = 0;
+      scanKeyboard();
     }
-    checkciatimers(31);
 
-    // draw rasterline
-    vic.drawRasterline();
-
-    // execute CPU cycles and check CIA timers
-    while (numofcycles < numofcyclestoexe) {
-      if (cpuhalted) {
-        break;
+    // run-ahead, rewind, hand over frame to SID synthesis, adapt speed to
+    // audio clock
+    numofcyclespersecond.fetch_add(numofcycles, std::memory_order_release);
+    if (vic.rasterline == 311) {
+      if (runahead.isActive() && (!debug)) {
+        runAhead();
+      } else {
+        vic.setSuppressed(false);
       }
-      logDebugInfo();
-      execute(getMem(pc++));
-      // check interrupt request (VIC or CIA) nach jedem Befehl
-      if ((vic.vicreg[0x19] & 0x81) && (vic.vicreg[0x1a] & 1) && (!iflag)) {
-        setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
+      rewind.capture(*this);
+      checkColdStart();
+      checkProgramCache();
+      if (movie.isActive()) {
+        movie.frameEnd(vic.getBitmap());
+        if (movie.isActive()) {
+          latchMovieInput();
+        } else {
+          stopMovie();
+        }
       }
-    }
-    checkciatimers(32);
-    adjustcycles = numofcycles - numofcyclestoexe;
-
-    // sprite collision interrupt?
-    if ((vic.vicreg[0x19] & 0x86) && (vic.vicreg[0x1a] & 6) && (!iflag)) {
-      setPCToIntVec(getMem(0xfffe) + (getMem(0xffff) << 8), false);
-    }
-
-    // restore key pressed?
-    if (restorenmi && nmiAck) {
-      nmiAck = false;
-      restorenmi = false;
-      setPCToIntVec(getMem(0xfffa) + (getMem(0xfffb) << 8), false);
-    }
-
-    // fill audio buffer
-    sid.fillBuffer(vic.rasterline);
-
-    // "throttle"
-    numofcyclespersecond.fetch_add(numofcycles, std::memory_order_release);
-    int64_t nominaltime =
-        lastMeasuredTime + Config::HEURISTIC_PERFORMANCE_FACTOR *
-                               ((vic.rasterline + 1) * 1000000 / 50 / 312);
-    int64_t now = PlatformManager::getInstance().getTimeUS();
-    if (nominaltime > now) {
-      int64_t us = nominaltime - now;
-      numofburnedcyclespersecond.fetch_add(us, std::memory_order_release);
-      PlatformManager::getInstance().waitUS(us);
+#ifdef USE_CAPTURE
+      sid.endFrame(capture.captureFrame(vic.getBitmap()));
+#else
+      sid.endFrame();
+#endif
+      governor.adjust(sid.getFillLevel());
+      inputlatency.frameEnd(vic.getBitmap());
+      // check for "external commands" once per frame
+      check4extcmd();
+      floppy.checkFlush();
     }
 
-    // get start time of frame, play audio
-    if (vic.rasterline == 311) {
-      lastMeasuredTime = PlatformManager::getInstance().getTimeUS();
-      sid.playAudio();
+    // "throttle" (not if replaying a movie headless)
+    if (((vic.rasterline + 1) % SpeedGovernor::LINESPERSYNC == 0) &&
+        !movie.isHeadless()) {
+      numofburnedcyclespersecond.fetch_add(governor.sync(vic.rasterline),
+                                           std::memory_order_release);
     }
   }
 }
@@ -893,6 +1095,7 @@ void C64Sys::initMemAndRegs() {
   gmprevright = false;
   specialjoymodestate = SpecialJoyModeState::NONE;
   specialjoymode = false;
+  specialjoymodecnt = 0;
   listInGameKeycodesIdx = 1;
   ingamebox[47] = 39;
   ingamebox[48] = 32;
@@ -901,10 +1104,222 @@ void C64Sys::initMemAndRegs() {
   actInGameKeycodeChosen.store(false, std::memory_order_release);
 }
 
+void C64Sys::reset(bool coldstart) {
+  cpuhalted = true;
+  initMemAndRegs();
+  vic.initVarsAndRegs();
+  cia1.init(true);
+  cia2.init(false);
+  sid.init();
+  floppy.init(8);
+  programcache.cancel();
+  if (coldstart || !restoreBootState()) {
+    instantboot.startColdStart();
+  }
+  cpuhalted = false;
+  joystickmode = 0;
+  keyboard->setJoystickmode(ExtCmd::JOYSTICKMODEOFF);
+}
+
+void C64Sys::resetForMovie(uint32_t seed) {
+  // defined memory, the kernal does not clear the ram; always a cold start
+  // (the READY state is host specific)
+  memset(ram, 0, 1 << 16);
+  memset(vic.colormap, 0, 1024);
+  randomstate = seed;
+  reset(true);
+  // registers not initialized by a reset
+  a = 0;
+  x = 0;
+  y = 0;
+  sr = 0;
+  cflag = false;
+  zflag = false;
+  vflag = false;
+  nflag = false;
+  numofcycles = 0;
+  adjustcycles = 0;
+}
+
+bool C64Sys::loadBootState() {
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  std::vector<uint8_t> savestate;
+  if (!instantboot.read(savestate)) {
+    return false;
+  }
+  uint32_t seed = randomstate;
+  if (!SaveState::deserialize(*this, savestate.data(), savestate.size())) {
+    return false;
+  }
+  randomstate = seed;
+  saveState(*instantboot.snapshot);
+  instantboot.loaded(platform.getTimeUS() - start);
+  return true;
+}
+
+bool C64Sys::restoreBootState() {
+  if (!instantboot.isAvailable()) {
+    return false;
+  }
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  // keep the sequence of the random generator
+  uint32_t seed = randomstate;
+  loadState(*instantboot.snapshot);
+  randomstate = seed;
+  instantboot.restored(platform.getTimeUS() - start);
+  return true;
+}
+
+void C64Sys::checkColdStart() {
+  if (!instantboot.isReady(pc, ram)) {
+    return;
+  }
+  saveState(*instantboot.snapshot);
+  std::vector<uint8_t> savestate;
+  SaveState::serialize(*this, savestate, true);
+  instantboot.store(savestate);
+}
+
+void C64Sys::typeToKeyboardBuffer(const char *text) {
+  // start of the cursor line, the screen editor reads the whole line
+  ram[0xd3] = 0;
+  uint8_t len = strlen(text);
+  memcpy(&ram[0x0277], text, len);
+  ram[0xc6] = len;
+}
+
+bool C64Sys::launchProgram(const std::string &name) {
+  if (!floppy.fsinitialized) {
+    return false;
+  }
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  FileDriver &file = *Floppy::sysfile;
+  bool d64 = !file.open(Config::PATH + name + ".prg", "rb");
+  file.close();
+  std::string filename = name + (d64 ? ".d64" : ".prg");
+  // no cache during movies (the cache is host specific)
+  std::vector<uint8_t> savestate;
+  if (!movie.isActive() && programcache.lookup(filename, savestate)) {
+    uint32_t seed = randomstate;
+    if (SaveState::deserialize(*this, savestate.data(), savestate.size())) {
+      randomstate = seed;
+      rewind.markAllDirty();
+      programcache.restored(platform.getTimeUS() - start);
+      return true;
+    }
+  }
+  if (d64) {
+    if (!floppy.attach(filename)) {
+      return false;
+    }
+    // clear the cursor line (the line is entered by RETURN)
+    memset(&ram[0x0400 + ram[0xd6] * 40], ' ', 40);
+    typeToKeyboardBuffer("LOAD\"*\",8\r");
+    programcache.startLoading();
+  } else {
+    uint16_t addr = floppy.load(filename, ram);
+    if (addr == 0) {
+      return false;
+    }
+    externalCmds->setVarTab(addr);
+    typeToKeyboardBuffer("RUN:\r");
+    programcache.startRunning();
+  }
+  rewind.markAllDirty();
+  return true;
+}
+
+void C64Sys::checkProgramCache() {
+  if (autorunpending && InstantBoot::isWaitingForKey(pc, ram)) {
+    autorunpending = false;
+    if (!launchProgram(Config::AUTORUN)) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG, "cannot launch %s",
+                                         Config::AUTORUN);
+    }
+  }
+  switch (programcache.frameEnd(InstantBoot::isWaitingForKey(pc, ram))) {
+  case ProgramCache::Action::RUN:
+    // d64 program loaded
+    typeToKeyboardBuffer("RUN:\r");
+    break;
+  case ProgramCache::Action::STORE: {
+    std::vector<uint8_t> savestate;
+    SaveState::serialize(*this, savestate, true);
+    programcache.store(savestate);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void C64Sys::startMovie() {
+  // host side state influencing the frames
+  autorunpending = false;
+  programcache.cancel();
+  runahead.init(runahead.frames);
+  // the next frame is drawn independent of the run-ahead before the movie
+  vic.setSuppressed(false);
+  vic.overlaysenabled = false;
+  sid.setSuppressed(movie.isHeadless());
+  rewind.markAllDirty();
+}
+
+void C64Sys::recordMovie(const std::string &name, bool fromreset) {
+  externalCmds->cancelPendingIO();
+  std::vector<uint8_t> savestate;
+  if (fromreset) {
+    resetForMovie(randomstate);
+  } else {
+    SaveState::serialize(*this, savestate, true);
+  }
+  InputState act;
+  readInput(act);
+  setInput(act, true);
+  movie.startRecording(name, randomstate, runahead.frames, &act, sizeof(act),
+                       savestate);
+  startMovie();
+}
+
+void C64Sys::replayMovie(const std::string &name, bool headless) {
+  if (!movie.startReplay(name, headless, sizeof(InputState))) {
+    return;
+  }
+  externalCmds->cancelPendingIO();
+  // the shown frames depend on the run-ahead frames of the recording
+  runahead.frames = movie.getRunAhead();
+  const uint8_t *savestate;
+  uint32_t size;
+  if (!movie.getSaveState(savestate, size)) {
+    resetForMovie(movie.getSeed());
+  } else if (!SaveState::deserialize(*this, savestate, size)) {
+    stopMovie();
+    return;
+  }
+  InputState act;
+  movie.getStartInput(&act);
+  setInput(act, true);
+  startMovie();
+}
+
+void C64Sys::stopMovie() {
+  movie.stop();
+  runahead.init(floppy.truedrive ? 0 : Config::RUNAHEADFRAMES);
+  vic.overlaysenabled = true;
+  sid.setSuppressed(false);
+}
+
 void C64Sys::init(uint8_t *ram, const uint8_t *charrom) {
   PlatformManager::getInstance().log(LOG_INFO, TAG, "init");
   vic.init(ram, charrom);
   floppy.init(8);
+#ifdef USE_CAPTURE
+  sid.capture = &capture;
+#endif
+  vic.inputlatency = &inputlatency;
   this->ram = ram;
   this->charrom = charrom;
   this->externalCmds = new ExternalCmds();
@@ -913,12 +1328,27 @@ void C64Sys::init(uint8_t *ram, const uint8_t *charrom) {
   kbjoystickmode = 0;
   deactivateTemp = false;
   numofcycles = 0;
+  adjustcycles = 0;
+  totalcycles = 0;
+  linestartcycles = 0;
+  runningahead = false;
+  Platform &platform = PlatformManager::getInstance();
+  randomstate = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    randomstate |= platform.getRandomByte() << (i * 8);
+  }
+  randomstate |= 1; // must not be 0
+  // run-ahead would send the bus events of the frames emulated ahead to the
+  // true drive
+  runahead.init(floppy.truedrive ? 0 : Config::RUNAHEADFRAMES);
+  rewind.init(Config::REWINDBUFFERKB * 1024, ram, vic.colormap);
   numofcyclespersecond.store(0, std::memory_order_release);
   numofburnedcyclespersecond.store(0, std::memory_order_release);
   perf.store(false, std::memory_order_release);
   batteryVoltage.store(0, std::memory_order_release);
   poweroff.store(false, std::memory_order_release);
   keyboard = Keyboard::create();
+  keyboard->setExtCmdQueue(&extCmdQueue);
   keyboard->init();
   joystick = Joystick::create();
   try {
@@ -931,9 +1361,20 @@ void C64Sys::init(uint8_t *ram, const uint8_t *charrom) {
   initMemAndRegs();
   externalCmds->init(ram, this);
   hooks->init(ram, this);
-  hooks->patchKernal(kernal_rom);
+  if (!floppy.truedrive) {
+    hooks->patchKernal(kernal_rom);
+  }
   FileConfig::loadConfig(*floppy.sysfile, std::string(Config::PATH) +
                                               std::string(Config::CONFIGFILE));
+  uint32_t machinekey =
+      InstantBoot::getMachineKey(kernal_rom, basic_rom, charrom,
+                                 floppy.truedrive, Config::SIDFIXEDPOINT);
+  instantboot.init(Config::INSTANTBOOT, machinekey);
+  if (!loadBootState()) {
+    instantboot.startColdStart();
+  }
+  programcache.init(Config::PRGCACHEFRAMES, Config::PRGCACHEKB, machinekey);
+  autorunpending = (Config::AUTORUN != nullptr);
   std::vector<JoystickOnlyTextKeycode> listAdditionalInGameKeycodes =
       FileConfig::getJoystickOnlyKeycodes();
   listInGameKeycodes.insert(listInGameKeycodes.end(),
@@ -1001,6 +1442,9 @@ void C64Sys::exeSubroutine(uint16_t addr, uint8_t rega, uint8_t regx,
 
 void C64Sys::scanKeyboard() {
   keyboard->scanKeyboard();
+  if (!movie.isActive()) {
+    latchInput(false);
+  }
   if (actInGameKeycodeChosen.load(std::memory_order_acquire)) {
     uint8_t prev = actInGameKeycodeCnt.fetch_sub(1, std::memory_order_acq_rel);
     if (prev <= 1) {
@@ -1008,3 +1452,69 @@ void C64Sys::scanKeyboard() {
     }
   }
 }
+
+void C64Sys::saveState(Snapshot &snapshot, bool memory) {
+  snapshot.cpu.a = a;
+  snapshot.cpu.x = x;
+  snapshot.cpu.y = y;
+  snapshot.cpu.sp = sp;
+  snapshot.cpu.sr = sr;
+  snapshot.cpu.pc = pc;
+  snapshot.cpu.cflag = cflag;
+  snapshot.cpu.zflag = zflag;
+  snapshot.cpu.dflag = dflag;
+  snapshot.cpu.bflag = bflag;
+  snapshot.cpu.vflag = vflag;
+  snapshot.cpu.nflag = nflag;
+  snapshot.cpu.iflag = iflag;
+  snapshot.cpu.cpuhalted = cpuhalted;
+  snapshot.cpu.numofcycles = numofcycles;
+  snapshot.cpu.adjustcycles = adjustcycles;
+  snapshot.cpu.register1 = register1;
+  snapshot.cpu.nmiAck = nmiAck;
+  snapshot.cpu.restorenmi = restorenmi;
+  snapshot.cpu.randomstate = randomstate;
+  vic.saveState(snapshot.vic);
+  cia1.saveState(snapshot.cia1);
+  cia2.saveState(snapshot.cia2);
+  sid.saveState(snapshot.sid);
+  if (memory) {
+    memcpy(snapshot.ram, ram, sizeof(snapshot.ram));
+    memcpy(snapshot.colorram, vic.colormap, sizeof(snapshot.colorram));
+  }
+}
+
+void C64Sys::loadState(const Snapshot &snapshot, bool memory) {
+  a = snapshot.cpu.a;
+  x = snapshot.cpu.x;
+  y = snapshot.cpu.y;
+  sp = snapshot.cpu.sp;
+  sr = snapshot.cpu.sr;
+  pc = snapshot.cpu.pc;
+  cflag = snapshot.cpu.cflag;
+  zflag = snapshot.cpu.zflag;
+  dflag = snapshot.cpu.dflag;
+  bflag = snapshot.cpu.bflag;
+  vflag = snapshot.cpu.vflag;
+  nflag = snapshot.cpu.nflag;
+  iflag = snapshot.cpu.iflag;
+  cpuhalted = snapshot.cpu.cpuhalted;
+  numofcycles = snapshot.cpu.numofcycles;
+  adjustcycles = snapshot.cpu.adjustcycles;
+  register1 = snapshot.cpu.register1;
+  decodeRegister1(register1 & 7);
+  nmiAck = snapshot.cpu.nmiAck;
+  restorenmi = snapshot.cpu.restorenmi;
+  randomstate = snapshot.cpu.randomstate;
+  vic.loadState(snapshot.vic);
+  cia1.loadState(snapshot.cia1);
+  cia2.loadState(snapshot.cia2);
+  sid.loadState(snapshot.sid);
+  if (memory) {
+    memcpy(ram, snapshot.ram, sizeof(snapshot.ram));
+    memcpy(vic.colormap, snapshot.colorram, sizeof(snapshot.colorram));
+  }
+  if (floppy.truedrive) {
+    writeIEC();
+  }
+}
@@ -18,12 +18,22 @@
 #define C64SYS_H
 
 #include "CIA.h"
+#include "Capture.h"
 #include "CPU6502.h"
+#include "ExtCmdQueue.h"
 #include "Floppy.h"
 #include "Hooks.h"
+#include "InputLatency.h"
+#include "InstantBoot.h"
 #include "IDebugBus.h"
 #include "JoystickOnlyTextKeycode.h"
+#include "Movie.h"
+#include "ProgramCache.h"
+#include "Rewind.h"
+#include "RunAhead.h"
 #include "SID.h"
+#include "Snapshot.h"
+#include "SpeedGovernor.h"
 #include "VIC.h"
 #include "joystick/JoystickDriver.h"
 #include "keyboard/C64Keycodes.h"
@@ -38,6 +48,11 @@ enum class SpecialJoyModeState { NONE, CHOOSEFILE, RUN, INGAME };
 
 class C64Sys : public CPU6502, public IDebugBus {
 private:
+  // number of rasterlines between keyboard scans (8 ms)
+  static const uint8_t KBSCANLINES = 125;
+  // number of frames fire2 must be pressed to enter joystick only mode (2 s)
+  static const uint8_t FIRE2LONGPRESSFRAMES = 100;
+
   uint8_t *ram;
   uint8_t *kernalrom;
   const uint8_t *charrom;
@@ -50,9 +65,44 @@ private:
   uint8_t register1;
 
   bool nmiAck;
+  // cycles executed beyond the last rasterline
+  uint8_t adjustcycles;
+  // cycles since power on resp. cycle of the first instruction of the
+  // rasterline (time base of the serial bus with the true drive)
+  uint64_t totalcycles;
+  uint64_t linestartcycles;
+  // emulating frames ahead (see runAhead)
+  bool runningahead;
+  // state of the random generator (SID register 0x1b)
+  uint32_t randomstate;
+  // Config::AUTORUN not yet launched
+  bool autorunpending;
+
+  // input state, latched at each keyboard scan
+  struct InputState {
+    uint8_t kbcodedc00;
+    uint8_t kbcodedc01;
+    uint8_t shiftctrlcode;
+    uint8_t kbjoyvalue;
+    uint8_t joyvalue;
+    bool fire2;
+    bool ingamekey;
+    uint8_t ingamedc00;
+    uint8_t ingamedc01;
+    uint8_t joystickmode;
+    uint8_t kbjoystickmode;
+    bool specialjoymode;
+  };
+  InputState input;
+  // input of port A resp. port B for each output value of the other port
+  // (keyboard matrix incl. joystick), rebuilt if the input state changes
+  uint8_t dc00lut[256];
+  uint8_t dc01lut[256];
+  uint8_t prevdc00lut[256];
+  uint8_t prevdc01lut[256];
 
   SpecialJoyModeState specialjoymodestate;
-  uint16_t specialjoymodecnt;
+  uint8_t specialjoymodecnt;
   bool specialjoymode;
   bool gmprevfire1;
   bool gmprevup;
@@ -74,14 +124,29 @@ private:
   uint8_t listInGameKeycodesIdx;
 
   uint8_t getDC01(uint8_t dc00, bool xchgports);
+  void readInput(InputState &act);
+  void setInput(const InputState &act, bool force);
+  void latchInput(bool force);
+  void latchMovieInput();
+  void resetForMovie(uint32_t seed);
+  bool loadBootState();
+  bool restoreBootState();
+  void checkColdStart();
+  void typeToKeyboardBuffer(const char *text);
+  void checkProgramCache();
+  void startMovie();
+  inline uint8_t nextRandom() __attribute__((always_inline));
   inline void adaptVICBaseAddrs(bool fromcia) __attribute__((always_inline));
   inline void decodeRegister1(uint8_t val) __attribute__((always_inline));
   inline void checkciatimers(uint8_t cycles) __attribute__((always_inline));
   inline void logDebugInfo() __attribute__((always_inline));
+  void writeIEC();
   JoystickOnlyTextKeycode getNextKeycode();
   void getJoystickValues();
   uint8_t checkJoystickOnlyStatemachine(bool fire2pressed);
   void check4extcmd();
+  void emulateRasterline();
+  void runAhead();
 
 public:
   VIC vic;
@@ -89,7 +154,18 @@ public:
   CIA cia2;
   SID sid;
   Floppy floppy;
+  SpeedGovernor governor;
+  RunAhead runahead;
+  Rewind rewind;
+  Movie movie;
+  InstantBoot instantboot;
+  ProgramCache programcache;
+  InputLatency inputlatency;
+#ifdef USE_CAPTURE
+  Capture capture;
+#endif
   ExternalCmds *externalCmds;
+  ExtCmdQueue extCmdQueue;
   Hooks *hooks;
   KeyboardDriver *keyboard;
 
@@ -135,11 +211,25 @@ public:
   void startLogCPUCmds(const long numOfCmds) override;
 
   void initMemAndRegs();
+  // coldstart: run the kernal reset even if the READY state is available
+  void reset(bool coldstart = false);
+  // movies (see class Movie)
+  void recordMovie(const std::string &name, bool fromreset);
+  void replayMovie(const std::string &name, bool headless);
+  void stopMovie();
+  // loads and runs a program (NAME.prg resp. first file of NAME.d64) or
+  // restores its state from the program cache (see class ProgramCache)
+  bool launchProgram(const std::string &name);
   void init(uint8_t *ram, const uint8_t *charrom);
   void setPC(uint16_t pc);
+  // pushes a return address like jsr (rts continues at addr)
+  void pushReturnAddr(uint16_t addr);
   void exeSubroutine(uint16_t addr, uint8_t rega, uint8_t regx, uint8_t regy);
   void exeSubroutine(uint16_t regpc);
   void scanKeyboard();
+  // memory: include ram and color ram
+  void saveState(Snapshot &snapshot, bool memory = true);
+  void loadState(const Snapshot &snapshot, bool memory = true);
 };
 
 #endif // C64SYS_H
@@ -15,19 +15,10 @@
  http://www.gnu.org/licenses/.
 */
 #include "CIA.h"
+#include <cstring>
 
 // bit 4 of ciareg[0x0e] and ciareg[0x0f] is handled in CPUC64::setMem
 
-void CIA::checkAlarm() {
-  if (isAlarm.load(std::memory_order_acquire)) {
-    isAlarm.store(false, std::memory_order_release);
-    latchdc0d |= 0x04;
-    if (ciareg[0x0d] & 4) {
-      latchdc0d |= 0x80;
-    }
-  }
-}
-
 void CIA::checkTimerA(uint8_t deltaT) {
   uint8_t reg0e = ciareg[0x0e];
   if (!(reg0e & 1)) {
@@ -127,15 +118,15 @@ void CIA::init(bool isCIA1) {
   timerB = 0xffff;
 
   isTODFreezed = false;
-  isAlarm.store(false, std::memory_order_release);
-  latchrundc08.store(0, std::memory_order_release);
-  latchrundc09.store(0, std::memory_order_release);
-  latchrundc0a.store(0, std::memory_order_release);
-  latchrundc0b.store(0, std::memory_order_release);
-  latchalarmdc08.store(0, std::memory_order_release);
-  latchalarmdc09.store(0, std::memory_order_release);
-  latchalarmdc0a.store(0, std::memory_order_release);
-  latchalarmdc0b.store(0, std::memory_order_release);
+  todpulses = 0;
+  latchrundc08 = 0;
+  latchrundc09 = 0;
+  latchrundc0a = 0;
+  latchrundc0b = 0;
+  latchalarmdc08 = 0;
+  latchalarmdc09 = 0;
+  latchalarmdc0a = 0;
+  latchalarmdc0b = 0;
 
   if (isCIA1) {
     ciareg[0] = 127;
@@ -148,7 +139,7 @@ void CIA::init(bool isCIA1) {
 
 CIA::CIA(bool isCIA1) {
   init(isCIA1);
-  isTODRunning.store(false, std::memory_order_release);
+  isTODRunning = false;
 }
 
 uint8_t CIA::getCommonCIAReg(uint8_t ciaidx) {
@@ -165,7 +156,7 @@ uint8_t CIA::getCommonCIAReg(uint8_t ciaidx) {
     if (isTODFreezed) {
       val = ciareg[ciaidx];
     } else {
-      val = latchrundc08.load(std::memory_order_acquire);
+      val = latchrundc08;
     }
     isTODFreezed = false;
     return val;
@@ -173,20 +164,20 @@ uint8_t CIA::getCommonCIAReg(uint8_t ciaidx) {
     if (isTODFreezed) {
       return ciareg[ciaidx];
     } else {
-      return latchrundc09.load(std::memory_order_acquire);
+      return latchrundc09;
     }
   } else if (ciaidx == 0x0a) {
     if (isTODFreezed) {
       return ciareg[ciaidx];
     } else {
-      return latchrundc0a.load(std::memory_order_acquire);
+      return latchrundc0a;
     }
   } else if (ciaidx == 0x0b) {
     isTODFreezed = true;
-    ciareg[0x08] = latchrundc08.load(std::memory_order_acquire);
-    ciareg[0x09] = latchrundc09.load(std::memory_order_acquire);
-    ciareg[0x0a] = latchrundc0a.load(std::memory_order_acquire);
-    ciareg[0x0b] = latchrundc0b.load(std::memory_order_acquire);
+    ciareg[0x08] = latchrundc08;
+    ciareg[0x09] = latchrundc09;
+    ciareg[0x0a] = latchrundc0a;
+    ciareg[0x0b] = latchrundc0b;
     return ciareg[ciaidx];
   } else if (ciaidx == 0x0d) {
     uint8_t val = latchdc0d;
@@ -216,32 +207,32 @@ void CIA::setCommonCIAReg(uint8_t ciaidx, uint8_t val) {
     }
   } else if (ciaidx == 0x08) {
     if (ciareg[0x0f] & 128) {
-      latchalarmdc08.store(val, std::memory_order_release);
+      latchalarmdc08 = val;
     } else {
       ciareg[0x08] = val;
-      latchrundc08.store(val, std::memory_order_release);
-      latchrundc09.store(ciareg[0x09], std::memory_order_release);
-      latchrundc0a.store(ciareg[0x0a], std::memory_order_release);
-      latchrundc0b.store(ciareg[0x0b], std::memory_order_release);
-      isTODRunning.store(true, std::memory_order_release);
+      latchrundc08 = val;
+      latchrundc09 = ciareg[0x09];
+      latchrundc0a = ciareg[0x0a];
+      latchrundc0b = ciareg[0x0b];
+      isTODRunning = true;
     }
   } else if (ciaidx == 0x09) {
     if (ciareg[0x0f] & 128) {
-      latchalarmdc09.store(val, std::memory_order_release);
+      latchalarmdc09 = val;
     } else {
       ciareg[0x09] = val;
     }
   } else if (ciaidx == 0x0a) {
     if (ciareg[0x0f] & 128) {
-      latchalarmdc0a.store(val, std::memory_order_release);
+      latchalarmdc0a = val;
     } else {
       ciareg[0x0a] = val;
     }
   } else if (ciaidx == 0x0b) {
     if (ciareg[0x0f] & 128) {
-      latchalarmdc0b.store(val, std::memory_order_release);
+      latchalarmdc0b = val;
     } else {
-      isTODRunning.store(false, std::memory_order_release);
+      isTODRunning = false;
       ciareg[0x0b] = val;
     }
   } else if (ciaidx == 0x0c) {
@@ -273,11 +264,11 @@ void CIA::setCommonCIAReg(uint8_t ciaidx, uint8_t val) {
 }
 
 bool CIA::updateTODInt() {
-  uint8_t dc08 = latchrundc08.load(std::memory_order_acquire);
+  uint8_t dc08 = latchrundc08;
   dc08++;
   if (dc08 > 9) {
     dc08 = 0;
-    uint8_t dc09 = latchrundc09.load(std::memory_order_acquire);
+    uint8_t dc09 = latchrundc09;
     uint8_t dc09one = dc09 & 15;
     uint8_t dc09ten = dc09 >> 4;
     dc09one++;
@@ -286,7 +277,7 @@ bool CIA::updateTODInt() {
       dc09ten++;
       if (dc09ten > 5) {
         dc09ten = 0;
-        uint8_t dc0a = latchrundc0a.load(std::memory_order_acquire);
+        uint8_t dc0a = latchrundc0a;
         uint8_t dc0aone = dc0a & 15;
         uint8_t dc0aten = dc0a >> 4;
         dc0aone++;
@@ -295,7 +286,7 @@ bool CIA::updateTODInt() {
           dc0aten++;
           if (dc0aten > 5) {
             dc0aten = 0;
-            uint8_t dc0b = latchrundc0b.load(std::memory_order_acquire);
+            uint8_t dc0b = latchrundc0b;
             uint8_t dc0bone = dc0b & 15;
             uint8_t dc0bten = dc0b >> 4;
             bool pm = dc0b & 128;
@@ -309,26 +300,25 @@ bool CIA::updateTODInt() {
                 pm = !pm;
               }
             }
-            latchrundc0b.store(dc0bone | (dc0bten << 4) | (pm ? 127 : 0),
-                               std::memory_order_release);
+            latchrundc0b = dc0bone | (dc0bten << 4) | (pm ? 0x80 : 0);
           }
         }
-        latchrundc0a.store(dc0aone | (dc0aten << 4), std::memory_order_release);
+        latchrundc0a = dc0aone | (dc0aten << 4);
       }
     }
-    latchrundc09.store(dc09one | (dc09ten << 4), std::memory_order_release);
+    latchrundc09 = dc09one | (dc09ten << 4);
   }
-  latchrundc08.store(dc08, std::memory_order_release);
-  uint8_t alarmdc08 = latchalarmdc08.load(std::memory_order_acquire);
+  latchrundc08 = dc08;
+  uint8_t alarmdc08 = latchalarmdc08;
   if (dc08 == alarmdc08) {
-    uint8_t dc09 = latchrundc09.load(std::memory_order_acquire);
-    uint8_t alarmdc09 = latchalarmdc09.load(std::memory_order_acquire);
+    uint8_t dc09 = latchrundc09;
+    uint8_t alarmdc09 = latchalarmdc09;
     if (dc09 == alarmdc09) {
-      uint8_t dc0a = latchrundc0a.load(std::memory_order_acquire);
-      uint8_t alarmdc0a = latchalarmdc0a.load(std::memory_order_acquire);
+      uint8_t dc0a = latchrundc0a;
+      uint8_t alarmdc0a = latchalarmdc0a;
       if (dc0a == alarmdc0a) {
-        uint8_t dc0b = latchrundc0b.load(std::memory_order_acquire);
-        uint8_t alarmdc0b = latchalarmdc0b.load(std::memory_order_acquire);
+        uint8_t dc0b = latchrundc0b;
+        uint8_t alarmdc0b = latchalarmdc0b;
         if (dc0b == alarmdc0b) {
           return true;
         }
@@ -338,10 +328,68 @@ bool CIA::updateTODInt() {
   return false;
 }
 
-void CIA::updateTOD() {
-  if (isTODRunning.load(std::memory_order_acquire)) {
-    if (updateTODInt()) {
-      isAlarm.store(true, std::memory_order_release);
+void CIA::powerLineTick() {
+  // TOD is clocked by the power line frequency (50 Hz), bit 7 of register
+  // 0x0e selects the divider (1: 50 Hz -> 5, 0: 60 Hz -> 6)
+  todpulses++;
+  if (todpulses < ((ciareg[0x0e] & 0x80) ? 5 : 6)) {
+    return;
+  }
+  todpulses = 0;
+  if (isTODRunning && updateTODInt()) {
+    latchdc0d |= 0x04;
+    if (ciareg[0x0d] & 4) {
+      latchdc0d |= 0x80;
     }
   }
 }
+
+void CIA::saveState(State &state) const {
+  memcpy(state.ciareg, ciareg, sizeof(ciareg));
+  state.underflowTimerA = underflowTimerA;
+  state.serbitnr = serbitnr;
+  state.serbitnrnext = serbitnrnext;
+  state.latchdc04 = latchdc04;
+  state.latchdc05 = latchdc05;
+  state.latchdc06 = latchdc06;
+  state.latchdc07 = latchdc07;
+  state.latchdc0d = latchdc0d;
+  state.timerA = timerA;
+  state.timerB = timerB;
+  state.isTODRunning = isTODRunning;
+  state.isTODFreezed = isTODFreezed;
+  state.todpulses = todpulses;
+  state.latchrundc08 = latchrundc08;
+  state.latchrundc09 = latchrundc09;
+  state.latchrundc0a = latchrundc0a;
+  state.latchrundc0b = latchrundc0b;
+  state.latchalarmdc08 = latchalarmdc08;
+  state.latchalarmdc09 = latchalarmdc09;
+  state.latchalarmdc0a = latchalarmdc0a;
+  state.latchalarmdc0b = latchalarmdc0b;
+}
+
+void CIA::loadState(const State &state) {
+  memcpy(ciareg, state.ciareg, sizeof(ciareg));
+  underflowTimerA = state.underflowTimerA;
+  serbitnr = state.serbitnr;
+  serbitnrnext = state.serbitnrnext;
+  latchdc04 = state.latchdc04;
+  latchdc05 = state.latchdc05;
+  latchdc06 = state.latchdc06;
+  latchdc07 = state.latchdc07;
+  latchdc0d = state.latchdc0d;
+  timerA = state.timerA;
+  timerB = state.timerB;
+  isTODRunning = state.isTODRunning;
+  isTODFreezed = state.isTODFreezed;
+  todpulses = state.todpulses;
+  latchrundc08 = state.latchrundc08;
+  latchrundc09 = state.latchrundc09;
+  latchrundc0a = state.latchrundc0a;
+  latchrundc0b = state.latchrundc0b;
+  latchalarmdc08 = state.latchalarmdc08;
+  latchalarmdc09 = state.latchalarmdc09;
+  latchalarmdc0a = state.latchalarmdc0a;
+  latchalarmdc0b = state.latchalarmdc0b;
+}
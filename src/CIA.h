@@ -17,7 +17,6 @@
 #ifndef CIA_H
 #define CIA_H
 
-#include <atomic>
 #include <cstdint>
 
 // register dc0d:
@@ -30,6 +29,32 @@ private:
   bool updateTODInt();
 
 public:
+  // state of the CIA (see class Snapshot)
+  struct State {
+    uint8_t ciareg[0x10];
+    bool underflowTimerA;
+    uint8_t serbitnr;
+    uint8_t serbitnrnext;
+    uint8_t latchdc04;
+    uint8_t latchdc05;
+    uint8_t latchdc06;
+    uint8_t latchdc07;
+    uint8_t latchdc0d;
+    uint16_t timerA;
+    uint16_t timerB;
+    bool isTODRunning;
+    bool isTODFreezed;
+    uint8_t todpulses;
+    uint8_t latchrundc08;
+    uint8_t latchrundc09;
+    uint8_t latchrundc0a;
+    uint8_t latchrundc0b;
+    uint8_t latchalarmdc08;
+    uint8_t latchalarmdc09;
+    uint8_t latchalarmdc0a;
+    uint8_t latchalarmdc0b;
+  };
+
   uint8_t ciareg[0x10];
 
   bool underflowTimerA;
@@ -43,25 +68,26 @@ public:
   uint16_t timerA;
   uint16_t timerB;
 
-  std::atomic<bool> isTODRunning;
+  bool isTODRunning;
   bool isTODFreezed;
-  std::atomic<bool> isAlarm;
-  std::atomic<uint8_t> latchrundc08; // TOD running
-  std::atomic<uint8_t> latchrundc09;
-  std::atomic<uint8_t> latchrundc0a;
-  std::atomic<uint8_t> latchrundc0b;
-  std::atomic<uint8_t> latchalarmdc08; // set alarm
-  std::atomic<uint8_t> latchalarmdc09;
-  std::atomic<uint8_t> latchalarmdc0a;
-  std::atomic<uint8_t> latchalarmdc0b;
+  uint8_t todpulses;    // power line pulses since last TOD tick
+  uint8_t latchrundc08; // TOD running
+  uint8_t latchrundc09;
+  uint8_t latchrundc0a;
+  uint8_t latchrundc0b;
+  uint8_t latchalarmdc08; // set alarm
+  uint8_t latchalarmdc09;
+  uint8_t latchalarmdc0a;
+  uint8_t latchalarmdc0b;
 
   CIA(bool isCIA1);
   void init(bool isCIA1);
-  void checkAlarm();
   void checkTimerA(uint8_t deltaT);
   void checkTimerB(uint8_t deltaT);
   uint8_t getCommonCIAReg(uint8_t ciaidx);
   void setCommonCIAReg(uint8_t ciaidx, uint8_t val);
-  void updateTOD();
+  void powerLineTick();
+  void saveState(State &state) const;
+  void loadState(const State &state);
 };
 #endif // CIA_H
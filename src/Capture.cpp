@@ -0,0 +1,277 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "Capture.h"
+#ifdef USE_CAPTURE
+#include "fs/FileFactory.h"
+#include "platform/PlatformManager.h"
+#include <cstring>
+#include <functional>
+
+static const char *TAG = "Capture";
+
+static const char *Y4MHEADER =
+    "YUV4MPEG2 W320 H200 F50:1 Ip A1:1 C420jpeg\n";
+static const char *Y4MFRAMEHEADER = "FRAME\n";
+
+Capture::Capture()
+    : state(IDLE), writerstarted(false), session(0), videoidx(0),
+      audioidx(0), audiosession(0), droppedvideo(0), droppedaudio(0) {}
+
+bool Capture::start(const std::string &name) {
+  if (state.load(std::memory_order_acquire) != IDLE) {
+    return false;
+  }
+  basename = name;
+  videoidx = 0;
+  uint8_t next = session.load(std::memory_order_acquire) + 1;
+  session.store((next == 0) ? 1 : next, std::memory_order_release);
+  droppedvideo.store(0, std::memory_order_release);
+  droppedaudio.store(0, std::memory_order_release);
+  if (!writerstarted.exchange(true, std::memory_order_acq_rel)) {
+    PlatformManager::getInstance().startTask(
+        std::bind(&Capture::writer, this), 0, 1);
+  }
+  state.store(RUNNING, std::memory_order_release);
+  PlatformManager::getInstance().log(LOG_INFO, TAG, "start capture %s",
+                                     basename.c_str());
+  return true;
+}
+
+void Capture::stop() {
+  State expected = RUNNING;
+  if (state.compare_exchange_strong(expected, STOPPING,
+                                    std::memory_order_acq_rel)) {
+    PlatformManager::getInstance().log(LOG_INFO, TAG, "stop capture");
+  }
+}
+
+bool Capture::isActive() {
+  return state.load(std::memory_order_acquire) != IDLE;
+}
+
+uint8_t Capture::captureFrame(const uint16_t *bitmap) {
+  // return value: 0 = no capture, else capture audio of this frame for the
+  // returned session
+  if (state.load(std::memory_order_acquire) != RUNNING) {
+    return 0;
+  }
+  VideoFrame *frame = videoqueue.reserve();
+  if (frame == nullptr) {
+    droppedvideo.fetch_add(1, std::memory_order_release);
+  } else {
+    frame->idx = videoidx;
+    memcpy(frame->pixels, bitmap, sizeof(frame->pixels));
+    videoqueue.commit();
+  }
+  videoidx++;
+  return session.load(std::memory_order_acquire);
+}
+
+void Capture::captureAudio(const int16_t *samples, uint8_t session) {
+  if (session != audiosession) {
+    // first frame of a new capture session
+    audiosession = session;
+    audioidx = 0;
+  }
+  AudioBlock *block = audioqueue.reserve();
+  if (block == nullptr) {
+    droppedaudio.fetch_add(1, std::memory_order_release);
+  } else {
+    block->idx = audioidx;
+    block->session = session;
+    memcpy(block->samples, samples, sizeof(block->samples));
+    audioqueue.commit();
+  }
+  audioidx++;
+}
+
+bool Capture::openFiles() {
+  std::string path = Config::PATH + basename;
+  y4mfile = FileSys::create();
+  wavfile = FileSys::create();
+  if (!y4mfile->init() || !wavfile->init() ||
+      !y4mfile->open(path + ".y4m", "wb") ||
+      !wavfile->open(path + ".wav", "wb")) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "cannot create capture files %s",
+                                       path.c_str());
+    y4mfile.reset();
+    wavfile.reset();
+    return false;
+  }
+  y4mfile->write(Y4MHEADER, strlen(Y4MHEADER));
+  writeWAVHeader(0);
+  numofvideoframes = 0;
+  numofaudioframes = 0;
+  numofaudiobytes = 0;
+  writersession = session.load(std::memory_order_acquire);
+  stoptime = 0;
+  return true;
+}
+
+void Capture::closeFiles() {
+  wavfile->seek(0, SEEK_SET);
+  writeWAVHeader(numofaudiobytes);
+  wavfile->close();
+  y4mfile->close();
+  wavfile.reset();
+  y4mfile.reset();
+  PlatformManager::getInstance().log(
+      LOG_INFO, TAG,
+      "capture finished: %lu frames, dropped video frames: %lu, dropped "
+      "audio frames: %lu",
+      (unsigned long)numofvideoframes,
+      (unsigned long)droppedvideo.load(std::memory_order_acquire),
+      (unsigned long)droppedaudio.load(std::memory_order_acquire));
+}
+
+void Capture::writeWAVHeader(uint32_t datasize) {
+  // 16 bit mono PCM, all values little endian
+  auto le = [](uint8_t *p, uint32_t val, uint8_t numofbytes) {
+    for (uint8_t i = 0; i < numofbytes; i++) {
+      p[i] = (val >> (8 * i)) & 0xff;
+    }
+  };
+  uint8_t header[44];
+  memcpy(header, "RIFF", 4);
+  le(header + 4, 36 + datasize, 4);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  le(header + 16, 16, 4);                    // size of fmt chunk
+  le(header + 20, 1, 2);                     // PCM
+  le(header + 22, 1, 2);                     // channels
+  le(header + 24, AUDIO_SAMPLE_RATE, 4);     // sample rate
+  le(header + 28, AUDIO_SAMPLE_RATE * 2, 4); // byte rate
+  le(header + 32, 2, 2);                     // block align
+  le(header + 34, 16, 2);                    // bits per sample
+  memcpy(header + 36, "data", 4);
+  le(header + 40, datasize, 4);
+  wavfile->write(header, sizeof(header));
+}
+
+void Capture::convertToYUV(const uint16_t *pixels) {
+  // RGB565 -> YCbCr 4:2:0 (BT.601, chroma of a 2x2 block averaged)
+  uint8_t *py = yuv;
+  uint8_t *pu = yuv + WIDTH * HEIGHT;
+  uint8_t *pv = pu + WIDTH * HEIGHT / 4;
+  for (uint16_t y = 0; y < HEIGHT; y += 2) {
+    for (uint16_t x = 0; x < WIDTH; x += 2) {
+      int32_t rsum = 0;
+      int32_t gsum = 0;
+      int32_t bsum = 0;
+      for (uint8_t i = 0; i < 4; i++) {
+        uint32_t idx = (y + (i >> 1)) * WIDTH + x + (i & 1);
+        uint16_t p = pixels[idx];
+        int32_t r = (p >> 11) & 0x1f;
+        int32_t g = (p >> 5) & 0x3f;
+        int32_t b = p & 0x1f;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+        py[idx] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        rsum += r;
+        gsum += g;
+        bsum += b;
+      }
+      *pu++ = ((-38 * rsum - 74 * gsum + 112 * bsum + 512) >> 10) + 128;
+      *pv++ = ((112 * rsum - 94 * gsum - 18 * bsum + 512) >> 10) + 128;
+    }
+  }
+}
+
+void Capture::writeVideoFrame(const VideoFrame &frame) {
+  uint32_t i = numofvideoframes;
+  if (i > 0) {
+    // dropped frames are replaced by the previous frame (still in yuv)
+    for (; i < frame.idx; i++) {
+      y4mfile->write(Y4MFRAMEHEADER, strlen(Y4MFRAMEHEADER));
+      y4mfile->write(yuv, sizeof(yuv));
+    }
+  }
+  convertToYUV(frame.pixels);
+  // actual frame, also replaces frames dropped at the start of the capture
+  for (; i <= frame.idx; i++) {
+    y4mfile->write(Y4MFRAMEHEADER, strlen(Y4MFRAMEHEADER));
+    y4mfile->write(yuv, sizeof(yuv));
+  }
+  numofvideoframes = frame.idx + 1;
+}
+
+void Capture::writeAudioBlock(const AudioBlock &block) {
+  if (block.session != writersession) {
+    // left over from a previous capture session
+    return;
+  }
+  // dropped frames are replaced by silence
+  static const int16_t silence[NUMSAMPLESPERFRAME] = {};
+  for (uint32_t i = numofaudioframes; i < block.idx; i++) {
+    wavfile->write(silence, sizeof(silence));
+    numofaudiobytes += sizeof(silence);
+  }
+  wavfile->write(block.samples, sizeof(block.samples));
+  numofaudiobytes += sizeof(block.samples);
+  numofaudioframes = block.idx + 1;
+}
+
+void Capture::writer() {
+  Platform &platform = PlatformManager::getInstance();
+  while (true) {
+    State actstate = state.load(std::memory_order_acquire);
+    if (actstate == IDLE) {
+      platform.waitMS(20);
+      continue;
+    }
+    if (!y4mfile && !openFiles()) {
+      state.store(IDLE, std::memory_order_release);
+      // discard captured frames
+      while (videoqueue.front() != nullptr) {
+        videoqueue.release();
+      }
+      continue;
+    }
+    bool idle = true;
+    VideoFrame *frame = videoqueue.front();
+    if (frame != nullptr) {
+      writeVideoFrame(*frame);
+      videoqueue.release();
+      idle = false;
+    }
+    AudioBlock *block = audioqueue.front();
+    if (block != nullptr) {
+      writeAudioBlock(*block);
+      audioqueue.release();
+      idle = false;
+    }
+    if (!idle) {
+      continue;
+    }
+    if (actstate == STOPPING) {
+      // wait for the audio of the last frames (sid synthesis lags behind)
+      int64_t now = platform.getTimeUS();
+      if (stoptime == 0) {
+        stoptime = now;
+      }
+      if ((numofaudioframes >= numofvideoframes) ||
+          (now - stoptime > 500000)) {
+        closeFiles();
+        state.store(IDLE, std::memory_order_release);
+        continue;
+      }
+    }
+    platform.waitMS(5);
+  }
+}
+#endif
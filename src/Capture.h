@@ -0,0 +1,101 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "Config.h"
+#ifdef USE_CAPTURE
+#include "SPSCRing.h"
+#include "fs/FileDriver.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Records the emulator output to <name>.y4m (video, 320x200, 50 fps) and
+// <name>.wav (audio). Frames and samples are handed over to a writer task
+// via bounded queues. If the writer falls behind, frames are dropped (and
+// replaced by the previous frame resp. silence in the files to keep audio
+// and video in sync, frames dropped at the start by the first frame), the
+// emulation is never blocked.
+// Frames are captured by the emulation task at the end of each frame, audio
+// by the SID synthesis task for the frames marked by the emulation task with
+// the number of the capture session. Audio blocks carry this number, so the
+// writer skips blocks left over from a previous session without depending on
+// a particular block of the new session being queued.
+class Capture {
+private:
+  static const uint16_t WIDTH = 320;
+  static const uint16_t HEIGHT = 200;
+  static const uint16_t NUMSAMPLESPERFRAME = AUDIO_SAMPLE_RATE / 50;
+  enum State : uint8_t { IDLE, RUNNING, STOPPING };
+
+  struct VideoFrame {
+    uint32_t idx;
+    uint16_t pixels[WIDTH * HEIGHT];
+  };
+
+  struct AudioBlock {
+    uint32_t idx;
+    uint8_t session;
+    int16_t samples[NUMSAMPLESPERFRAME];
+  };
+
+  SPSCRing<VideoFrame, 8> videoqueue;
+  SPSCRing<AudioBlock, 16> audioqueue;
+  std::atomic<State> state;
+  std::atomic<bool> writerstarted;
+  std::string basename;
+  // number of the capture session (1..255), set by start
+  std::atomic<uint8_t> session;
+
+  // producer side
+  uint32_t videoidx;     // emulation task
+  uint32_t audioidx;     // sid synthesis task
+  uint8_t audiosession;  // sid synthesis task: session of audioidx
+  std::atomic<uint32_t> droppedvideo;
+  std::atomic<uint32_t> droppedaudio;
+
+  // writer side
+  std::unique_ptr<FileDriver> y4mfile;
+  std::unique_ptr<FileDriver> wavfile;
+  uint8_t yuv[WIDTH * HEIGHT * 3 / 2];
+  uint32_t numofvideoframes;
+  uint32_t numofaudioframes;
+  uint32_t numofaudiobytes;
+  uint8_t writersession;
+  int64_t stoptime;
+
+  void writer();
+  bool openFiles();
+  void closeFiles();
+  void writeVideoFrame(const VideoFrame &frame);
+  void writeAudioBlock(const AudioBlock &block);
+  void writeWAVHeader(uint32_t datasize);
+  void convertToYUV(const uint16_t *pixels);
+
+public:
+  Capture();
+  bool start(const std::string &name);
+  void stop();
+  bool isActive();
+  uint8_t captureFrame(const uint16_t *bitmap);
+  void captureAudio(const int16_t *samples, uint8_t session);
+};
+#endif
+
+#endif // CAPTURE_H
@@ -31,6 +31,7 @@
 #define USE_LINUXFS
 #define USE_SDLJOYSTICK
 #define USE_SDLSOUND
+#define USE_CAPTURE
 #define WINDOWS_BUSYWAIT
 
 #elif defined(ESP_PLATFORM)
@@ -55,6 +56,11 @@
 
 #endif
 
+// SID filter emulation (not needed without sound output)
+#ifndef USE_NOSOUND
+#define USE_SIDFILTER
+#endif
+
 // global defines
 #define AUDIO_SAMPLE_RATE 44100
 
@@ -68,18 +74,48 @@ struct Config {
   // delay until next display refresh
   static const uint8_t REFRESHDELAY = 20;
 
-  // "heuristic performance factor"
-  static constexpr double HEURISTIC_PERFORMANCE_FACTOR = 1.0;
-
   // audio
   static const uint8_t DEFAULT_VOLUME = 10;
 
+  // SID synthesis engine (true: fixed point, false: float)
+  static inline bool SIDFIXEDPOINT = false;
+
+  // run-ahead: number of frames emulated ahead of the shown frame (0: off)
+  static inline uint8_t RUNAHEADFRAMES = 0;
+
+  // rewind: size of the rewind ring in KB (0: off)
+  static inline uint32_t REWINDBUFFERKB = 0;
+
+  // instant boot: restore the state at READY instead of a cold start
+  static inline bool INSTANTBOOT = true;
+
+  // program cache: snapshot launched programs after the given number of
+  // frames after RUN (0: off), size limit of all entries in KB
+  static inline uint32_t PRGCACHEFRAMES = 0;
+  static inline uint32_t PRGCACHEKB = 4096;
+
+  // program launched at start (name without extension, nullptr: none)
+  static inline const char *AUTORUN = nullptr;
+
+  // true drive: emulate the 1541 incl. its DOS (DOS ROM dos1541.rom in the
+  // configured directory) in its own thread instead of trapping the kernal
+  static inline bool TRUEDRIVE = false;
+
   // --- driver specific constants ---
 
+  // sound driver: target latency (maximum of buffered audio)
+  static inline uint16_t AUDIOLATENCYMS = 60;
+
+  // capture: name of the files to record to at startup (nullptr: off)
+  static inline const char *CAPTUREFILE = nullptr;
+
   // display driver
   static const uint16_t LCDWIDTH = 404;
   static const uint16_t LCDHEIGHT = 284;
   static inline uint16_t LCDSCALE = 3;
+  // scale on the CPU (SDLScaler) instead of letting the renderer scale
+  static inline bool SWSCALE = true;
+  static inline bool SCANLINES = false;
 
   // filesystem
   static constexpr const char *PATH = "c64prgs/";
@@ -96,8 +132,29 @@ struct Config {
   // delay until next display refresh
   static const uint8_t REFRESHDELAY = 0;
 
-  // "heuristic performance factor"
-  static constexpr double HEURISTIC_PERFORMANCE_FACTOR = 1.0;
+  // SID synthesis engine (true: fixed point, false: float)
+  static const bool SIDFIXEDPOINT = true;
+
+  // run-ahead: number of frames emulated ahead of the shown frame (0: off)
+  static const uint8_t RUNAHEADFRAMES = 0;
+
+  // rewind: size of the rewind ring in KB (0: off), allocated in PSRAM
+  static const uint32_t REWINDBUFFERKB = 0;
+
+  // instant boot: restore the state at READY instead of a cold start
+  static const bool INSTANTBOOT = true;
+
+  // program cache: snapshot launched programs after the given number of
+  // frames after RUN (0: off), size limit of all entries in KB
+  static const uint32_t PRGCACHEFRAMES = 0;
+  static const uint32_t PRGCACHEKB = 4096;
+
+  // program launched at start (name without extension, nullptr: none)
+  static constexpr const char *AUTORUN = nullptr;
+
+  // true drive: emulate the 1541 incl. its DOS (DOS ROM dos1541.rom on the
+  // SD card) on core 0 instead of trapping the kernal
+  static const bool TRUEDRIVE = false;
 
   // --- driver specific constants ---
 
@@ -154,8 +211,29 @@ struct Config {
   // delay until next display refresh
   static const uint8_t REFRESHDELAY = 13;
 
-  // "heuristic performance factor"
-  static constexpr double HEURISTIC_PERFORMANCE_FACTOR = 1.0;
+  // SID synthesis engine (true: fixed point, false: float)
+  static const bool SIDFIXEDPOINT = true;
+
+  // run-ahead: number of frames emulated ahead of the shown frame (0: off)
+  static const uint8_t RUNAHEADFRAMES = 0;
+
+  // rewind: size of the rewind ring in KB (0: off), allocated in PSRAM
+  static const uint32_t REWINDBUFFERKB = 0;
+
+  // instant boot: restore the state at READY instead of a cold start
+  static const bool INSTANTBOOT = true;
+
+  // program cache: snapshot launched programs after the given number of
+  // frames after RUN (0: off), size limit of all entries in KB
+  static const uint32_t PRGCACHEFRAMES = 0;
+  static const uint32_t PRGCACHEKB = 4096;
+
+  // program launched at start (name without extension, nullptr: none)
+  static constexpr const char *AUTORUN = nullptr;
+
+  // true drive: emulate the 1541 incl. its DOS (DOS ROM dos1541.rom on the
+  // SD card) on core 0 instead of trapping the kernal
+  static const bool TRUEDRIVE = false;
 
   // --- driver specific constants ---
 
@@ -187,8 +265,29 @@ struct Config {
   // delay until next display refresh
   static const uint8_t REFRESHDELAY = 11;
 
-  // "heuristic performance factor"
-  static constexpr double HEURISTIC_PERFORMANCE_FACTOR = 0.7;
+  // SID synthesis engine (true: fixed point, false: float)
+  static const bool SIDFIXEDPOINT = true;
+
+  // run-ahead: number of frames emulated ahead of the shown frame (0: off)
+  static const uint8_t RUNAHEADFRAMES = 0;
+
+  // rewind: size of the rewind ring in KB (0: off), allocated in PSRAM
+  static const uint32_t REWINDBUFFERKB = 0;
+
+  // instant boot: restore the state at READY instead of a cold start
+  static const bool INSTANTBOOT = true;
+
+  // program cache: snapshot launched programs after the given number of
+  // frames after RUN (0: off), size limit of all entries in KB
+  static const uint32_t PRGCACHEFRAMES = 0;
+  static const uint32_t PRGCACHEKB = 4096;
+
+  // program launched at start (name without extension, nullptr: none)
+  static constexpr const char *AUTORUN = nullptr;
+
+  // true drive: emulate the 1541 incl. its DOS (DOS ROM dos1541.rom on the
+  // SD card) on core 0 instead of trapping the kernal
+  static const bool TRUEDRIVE = false;
 
   // --- driver specific constants ---
 
@@ -21,10 +21,10 @@
  * @brief External commands for the emulator.
  *
  * External commands are sent to the emulator in a uint8_t buffer, see class
- * KeyboardDriver, method getExtCmdData. The first element (buf[0]) of the
+ * KeyboardDriver, method setExtCmdQueue. The first element (buf[0]) of the
  * buffer contains the command, i.e. a constant of the following enum. Some
  * commands need parameters which have to be placed in the following elements of
- * the buffer. The size of the buffer is implementation specfic.
+ * the buffer. The size of the buffer is at most ExtCmdQueue::CMDSIZE.
  * Some commands (see description) send back a notification, see class
  * KeyboardDriver, method sendExtCmdNotification. The structure of the different
  * notifications is defined in NotificationStruct.h.
@@ -87,13 +87,15 @@ enum class ExtCmd {
    * memory.
    *
    * Name of the prg file is to the left of the actual cursor position (see
-   * README.md). No parameters needed.
+   * README.md). buffer[1] (bit 0): load and run the program (NAME.prg resp.
+   * the first file of NAME.d64), the state is restored from the program
+   * cache if available (see class ProgramCache).
    */
   LOAD = 11,
 
   /**
-   * @brief Receives a program using consecutive calls of
-   * KeyboardDriver.getExtCmdData() and put it to memory.
+   * @brief Receives a program using consecutive external commands (see
+   * KeyboardDriver.setExtCmdQueue()) and put it to memory.
    *
    * A simple protocol is used to receive the whole program in blocks of 250
    * bytes (in buffer):
@@ -281,7 +283,67 @@ enum class ExtCmd {
    * - byte 12-: text to be displayed
    */
   WRITEOSD = 39,
-  PAUSE = 40
+  PAUSE = 40,
+
+  /**
+   * @brief Starts recording the emulator output (video and audio) or stops
+   * a running recording (only if compiled with USE_CAPTURE).
+   *
+   * The name of the files (without extension) is stored starting at buffer
+   * position 4 (from buffer[3]), "capture" if empty.
+   */
+  CAPTURE = 41,
+
+  /**
+   * @brief Gets the input latency histogram of a measurement stage and logs
+   * the histograms of all stages.
+   *
+   * buffer[1] (bit 0-1): stage (0: input event -> C64 reads the changed
+   * keyboard/joystick value, 1: C64 read -> first changed frame, 2: changed
+   * frame -> frame displayed, 3: total), bit 7: reset histograms afterwards.
+   * This command sends back a notification of type NotificationStruct6.
+   */
+  GETINPUTLATENCY = 42,
+
+  /**
+   * @brief Saves the state of the emulator to a file in the configured
+   * directory.
+   *
+   * buffer[1] (bit 0): compress the state. The name of the file (without
+   * extension) is stored starting at buffer position 4 (from buffer[3]),
+   * "snapshot" if empty.
+   */
+  SAVESTATE = 43,
+
+  /**
+   * @brief Loads the state of the emulator from a file in the configured
+   * directory.
+   *
+   * The name of the file (without extension) is stored starting at buffer
+   * position 4 (from buffer[3]), "snapshot" if empty.
+   */
+  LOADSTATE = 44,
+
+  /**
+   * @brief Steps the emulator back in time (only if the rewind ring is
+   * enabled, see Config::REWINDBUFFERKB).
+   *
+   * buffer[1]: number of seconds to go back, 0: one frame. If the emulator is
+   * paused, it stays paused.
+   */
+  REWIND = 45,
+
+  /**
+   * @brief Records or replays a movie (see class Movie) resp. stops the
+   * active movie.
+   *
+   * buffer[1]: 1: record starting with a reset, 2: record starting with the
+   * actual state, 3: replay, buffer[2] (bit 0): replay as fast as possible
+   * without sound. If a movie is active, it is stopped instead. The name of
+   * the file (without extension) is stored starting at buffer position 4
+   * (from buffer[3]), "movie" if empty.
+   */
+  MOVIE = 46
 };
 
 #endif // EXTCMD_H
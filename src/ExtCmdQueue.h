@@ -0,0 +1,124 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef EXTCMDQUEUE_H
+#define EXTCMDQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Lock-free queue of external commands for any number of producer
+ * threads (keyboard drivers) and exactly one consumer thread (CPU thread).
+ *
+ * Each slot holds the data buffer of one external command, see enum class
+ * ExtCmd. Bounded MPMC queue by D. Vyukov restricted to a single consumer:
+ * each slot carries a sequence number which tells producers and the
+ * consumer whether the slot is free resp. filled.
+ */
+class ExtCmdQueue {
+public:
+  // maximum size of the data buffer of an external command
+  static const uint16_t CMDSIZE = 1024;
+
+private:
+  static const uint32_t NUMOFSLOTS = 4;
+  struct Slot {
+    std::atomic<uint32_t> seq;
+    uint8_t data[CMDSIZE];
+  };
+  Slot slots[NUMOFSLOTS];
+  std::atomic<uint32_t> enqueuepos{0};
+  std::atomic<uint32_t> dropped{0};
+  uint32_t dequeuepos = 0;
+
+public:
+  ExtCmdQueue() {
+    for (uint32_t i = 0; i < NUMOFSLOTS; i++) {
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Appends an external command (producer side, any thread).
+   *
+   * @param data Data buffer of the command, data[0] contains the command.
+   * @param len Size of the data buffer (truncated to CMDSIZE, the rest of
+   * the slot is zero-filled).
+   * @return false if the queue is full (the command is dropped).
+   */
+  bool push(const uint8_t *data, size_t len) {
+    uint32_t pos = enqueuepos.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots[pos & (NUMOFSLOTS - 1)];
+      int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+      if (diff == 0) {
+        if (enqueuepos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = enqueuepos.load(std::memory_order_relaxed);
+      }
+    }
+    if (len > CMDSIZE) {
+      len = CMDSIZE;
+    }
+    memcpy(slot->data, data, len);
+    memset(slot->data + len, 0, CMDSIZE - len);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Returns the oldest command without removing it (consumer side),
+   * the command is removed by calling release().
+   *
+   * @return nullptr if the queue is empty.
+   */
+  uint8_t *front() {
+    Slot &slot = slots[dequeuepos & (NUMOFSLOTS - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != dequeuepos + 1) {
+      return nullptr;
+    }
+    return slot.data;
+  }
+
+  /**
+   * @brief Removes the command returned by front() (consumer side).
+   */
+  void release() {
+    slots[dequeuepos & (NUMOFSLOTS - 1)].seq.store(dequeuepos + NUMOFSLOTS,
+                                                   std::memory_order_release);
+    dequeuepos++;
+  }
+
+  /**
+   * @brief Returns and resets the number of commands dropped because the
+   * queue was full.
+   */
+  uint32_t getDropped() {
+    return dropped.exchange(0, std::memory_order_relaxed);
+  }
+};
+
+#endif // EXTCMDQUEUE_H
@@ -18,6 +18,7 @@
 
 #include "C64Sys.h"
 #include "ExtCmd.h"
+#include "SaveState.h"
 #include "platform/PlatformManager.h"
 #include <algorithm>
 #include <cstring>
@@ -82,6 +83,13 @@ void ExternalCmds::setType5Notification(uint8_t batteryVolLow,
   type5notification.batteryVolHi = batteryVolHi;
 }
 
+void ExternalCmds::setType6Notification(uint8_t stage) {
+  type6notification.type = 6;
+  type6notification.stage = stage;
+  type6notification.numofsamples =
+      cpu->inputlatency.getHistogram(stage, type6notification.buckets);
+}
+
 void ExternalCmds::setVarTab(uint16_t addr) {
   // set VARTAB
   ram[0x2d] = addr % 256;
@@ -156,6 +164,93 @@ void ExternalCmds::writeTextToC64Screen(uint16_t addr, int16_t sizebuffer) {
   }
 }
 
+void ExternalCmds::submitIOJob(std::unique_ptr<IOWorker::Job> job) {
+  iojob = std::move(job);
+  Floppy::ioworker.submit(*iojob);
+  if (cpu->movie.isActive()) {
+    // the result must be visible in the frame of the command
+    Floppy::ioworker.wait(*iojob);
+    checkPendingIO();
+  }
+}
+
+bool ExternalCmds::checkPendingIO() {
+  if ((!iojob) || (!iojob->isDone()) || (!isBasicInputMode())) {
+    return false;
+  }
+  std::unique_ptr<IOWorker::Job> job = std::move(iojob);
+  switch (job->op) {
+  case IOWorker::Op::READFILE:
+    finishLoad(*job);
+    break;
+  case IOWorker::Op::WRITEFILE:
+    finishSave(*job);
+    break;
+  case IOWorker::Op::LISTDIR:
+    finishList(*job);
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+void ExternalCmds::cancelPendingIO() {
+  if (iojob) {
+    Floppy::ioworker.wait(*iojob);
+    iojob.reset();
+  }
+}
+
+void ExternalCmds::finishLoad(IOWorker::Job &job) {
+  uint16_t addr = job.ok ? Floppy::storePrg(job.data, ram) : 0;
+  if (addr == 0) {
+    PlatformManager::getInstance().log(LOG_INFO, TAG, "file not found");
+    memcpy(&ram[0x342], "\rFILE NOT FOUND\r\0", 17);
+    writeTextToC64Screen(0x342, 17);
+    return;
+  }
+  setVarTab(addr);
+  memcpy(&ram[0x342], "\rLOADED\r\0", 9);
+  writeTextToC64Screen(0x342, 9);
+}
+
+void ExternalCmds::finishSave(IOWorker::Job &job) {
+  uint16_t addr = 0x342;
+  if (job.ok) {
+    memcpy(&ram[addr], "\rSAVED\r\0", 8);
+    writeTextToC64Screen(addr, 8);
+  } else {
+    PlatformManager::getInstance().log(LOG_INFO, TAG, "error saving file");
+    memcpy(&ram[addr], "\rERROR\r\0", 8);
+    writeTextToC64Screen(addr, 8);
+  }
+}
+
+void ExternalCmds::finishList(IOWorker::Job &job) {
+  for (std::string &filename : job.names) {
+    liststartflag = false;
+    cpu->floppy.rmPrgFromFilename(filename);
+    std::transform(filename.begin(), filename.end(), filename.begin(),
+                   ::toupper);
+    uint16_t addr = 0x342;
+    size_t len = std::min(filename.length(), static_cast<size_t>(16));
+    std::memcpy(&ram[addr], filename.c_str(), len);
+    ram[addr + len] = '\r';
+    ram[addr + len + 1] = '\0';
+    writeTextToC64Screen(addr, len + 2);
+  }
+  if (!job.ok) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "error reading entry");
+  } else if (job.end) {
+    liststartflag = true;
+    const uint8_t end[] = "*** END ***\r\0";
+    uint16_t addr = 0x342;
+    memcpy(&ram[addr], end, 13);
+    writeTextToC64Screen(addr, 13);
+  }
+}
+
 uint8_t ExternalCmds::executeExternalCmd(uint8_t *buffer) {
   ExtCmd cmd = static_cast<ExtCmd>(buffer[0]);
   switch (cmd) {
@@ -166,36 +261,26 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t *buffer) {
       return 0;
     }
     PlatformManager::getInstance().log(LOG_INFO, TAG, "load from file system");
-    cpu->cpuhalted = true;
-    bool fileloaded = false;
-    bool error = false;
-    uint16_t addr;
-    if (cpu->floppy.fsinitialized) {
-      std::string filename = getFilename(ram, ".prg");
-      addr = cpu->floppy.load(filename, ram);
-      if (addr == 0) {
-        PlatformManager::getInstance().log(LOG_INFO, TAG, "file not found");
-      } else {
-        setVarTab(addr);
-        fileloaded = true;
+    if (buffer[1] & 1) {
+      if (!cpu->launchProgram(getFilename(ram, ""))) {
+        memcpy(&ram[0x342], "\rFILE NOT FOUND\r\0", 17);
+        writeTextToC64Screen(0x342, 17);
       }
+      return 0;
+    }
+    if (iojob) {
+      PlatformManager::getInstance().log(LOG_INFO, TAG, "file system busy");
+      return 0;
+    }
+    if (cpu->floppy.fsinitialized) {
+      submitIOJob(std::unique_ptr<IOWorker::Job>(new IOWorker::Job(
+          IOWorker::Op::READFILE, Config::PATH + getFilename(ram, ".prg"))));
     } else {
-      error = true;
       PlatformManager::getInstance().log(LOG_INFO, TAG,
                                          "file system not initialized");
+      memcpy(&ram[0x342], "\rERROR\r\0", 8);
+      writeTextToC64Screen(0x342, 8);
     }
-    addr = 0x342;
-    if (fileloaded) {
-      memcpy(&ram[addr], "\rLOADED\r\0", 9);
-      writeTextToC64Screen(addr, 9);
-    } else if (error) {
-      memcpy(&ram[addr], "\rERROR\r\0", 8);
-      writeTextToC64Screen(addr, 8);
-    } else {
-      memcpy(&ram[addr], "\rFILE NOT FOUND\r\0", 17);
-      writeTextToC64Screen(addr, 17);
-    }
-    cpu->cpuhalted = false;
     return 0;
   }
   case ExtCmd::SAVE: {
@@ -203,36 +288,29 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t *buffer) {
       return 0;
     }
     PlatformManager::getInstance().log(LOG_INFO, TAG, "save to file system");
-    cpu->cpuhalted = true;
-    bool filesaved = false;
+    if (iojob) {
+      PlatformManager::getInstance().log(LOG_INFO, TAG, "file system busy");
+      return 0;
+    }
     if (cpu->floppy.fsinitialized) {
-      std::string filename = getFilename(ram, ".prg");
+      std::unique_ptr<IOWorker::Job> job(new IOWorker::Job(
+          IOWorker::Op::WRITEFILE, Config::PATH + getFilename(ram, ".prg")));
       uint16_t startaddr = ram[43] + ram[44] * 256;
       uint16_t endaddr = ram[45] + ram[46] * 256;
-      filesaved = cpu->floppy.save(filename, ram, startaddr, endaddr);
-      if (!filesaved) {
-        PlatformManager::getInstance().log(LOG_INFO, TAG, "error saving file");
-      }
+      Floppy::makePrg(job->data, ram, startaddr, endaddr);
+      submitIOJob(std::move(job));
     } else {
       PlatformManager::getInstance().log(LOG_INFO, TAG,
                                          "file system not initialized");
+      memcpy(&ram[0x342], "\rERROR\r\0", 8);
+      writeTextToC64Screen(0x342, 8);
     }
-    uint16_t addr = 0x342;
-    if (filesaved) {
-      memcpy(&ram[addr], "\rSAVED\r\0", 8);
-      writeTextToC64Screen(addr, 8);
-    } else {
-      memcpy(&ram[addr], "\rERROR\r\0", 8);
-      writeTextToC64Screen(addr, 8);
-    }
-    cpu->cpuhalted = false;
     return 0;
   }
   case ExtCmd::LIST: {
-    if (!isBasicInputMode()) {
+    if (!isBasicInputMode() || iojob) {
       return 0;
     }
-    cpu->cpuhalted = true;
     if (cpu->floppy.fsinitialized) {
       if (liststartflag) {
         const uint8_t start[] = "*** START ***\r\0";
@@ -245,40 +323,15 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t *buffer) {
         memcpy(&ram[addr], next, 14);
         writeTextToC64Screen(addr, 14);
       }
-      uint8_t cnt = 0;
-      while (cnt < 23) {
-        std::string filename;
-        bool success = cpu->floppy.listnextentry(filename, liststartflag);
-        if (!success) {
-          PlatformManager::getInstance().log(LOG_ERROR, TAG,
-                                             "error reading entry");
-          break;
-        } else if (filename.empty()) {
-          liststartflag = true;
-          const uint8_t next[] = "*** END ***\r\0";
-          uint16_t addr = 0x342;
-          memcpy(&ram[addr], next, 13);
-          writeTextToC64Screen(addr, 13);
-          break;
-        } else {
-          liststartflag = false;
-          cpu->floppy.rmPrgFromFilename(filename);
-          std::transform(filename.begin(), filename.end(), filename.begin(),
-                         ::toupper);
-          uint16_t addr = 0x342;
-          size_t len = std::min(filename.length(), static_cast<size_t>(16));
-          std::memcpy(&ram[addr], filename.c_str(), len);
-          ram[addr + len] = '\r';
-          ram[addr + len + 1] = '\0';
-          writeTextToC64Screen(addr, len + 2);
-        }
-        cnt++;
-      }
+      std::unique_ptr<IOWorker::Job> job(
+          new IOWorker::Job(IOWorker::Op::LISTDIR, ""));
+      job->start = liststartflag;
+      job->maxentries = 23;
+      submitIOJob(std::move(job));
     } else {
       PlatformManager::getInstance().log(LOG_ERROR, TAG,
                                          "file system not initialized");
     }
-    cpu->cpuhalted = false;
     return 0;
   }
   case ExtCmd::ATTACHD64: {
@@ -406,16 +459,9 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t *buffer) {
     return 3;
   }
   case ExtCmd::RESET:
-    cpu->cpuhalted = true;
-    cpu->initMemAndRegs();
-    cpu->vic.initVarsAndRegs();
-    cpu->cia1.init(true);
-    cpu->cia2.init(false);
-    cpu->sid.init();
-    cpu->floppy.init(8);
-    cpu->cpuhalted = false;
-    cpu->joystickmode = 0;
-    cpu->keyboard->setJoystickmode(ExtCmd::JOYSTICKMODEOFF);
+    cancelPendingIO();
+    // the READY state is host specific, a movie needs a cold start
+    cpu->reset(cpu->movie.isActive());
     setType1Notification();
     return 1;
   case ExtCmd::JOYSTICKMODE1:
@@ -500,6 +546,11 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t *buffer) {
     return 5;
   }
   case ExtCmd::POWEROFF:
+    if (cpu->movie.isActive()) {
+      cpu->stopMovie();
+    }
+    cancelPendingIO();
+    cpu->floppy.flush(true);
     cpu->poweroff.store(true, std::memory_order_release);
     return 0;
   case ExtCmd::SETVOLUME:
@@ -552,6 +603,77 @@ uint8_t ExternalCmds::executeExternalCmd(uint8_t *buffer) {
     PlatformManager::getInstance().log(LOG_INFO, TAG, "execute pause");
     return 0;
   }
+  case ExtCmd::CAPTURE: {
+#ifdef USE_CAPTURE
+    if (cpu->capture.isActive()) {
+      cpu->capture.stop();
+    } else {
+      std::string name(reinterpret_cast<char *>(&buffer[3]));
+      cpu->capture.start(name.empty() ? "capture" : name);
+    }
+#else
+    PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                       "capture not supported");
+#endif
+    return 0;
+  }
+  case ExtCmd::GETINPUTLATENCY: {
+    uint8_t stage = buffer[1] & 0x03;
+    cpu->inputlatency.logHistograms();
+    setType6Notification(stage);
+    if (buffer[1] & 0x80) {
+      cpu->inputlatency.reset();
+    }
+    return 6;
+  }
+  case ExtCmd::SAVESTATE:
+  case ExtCmd::LOADSTATE: {
+    if (!cpu->floppy.fsinitialized) {
+      return 0;
+    }
+    std::string name(reinterpret_cast<char *>(&buffer[3]));
+    if (name.empty()) {
+      name = "snapshot";
+    }
+    if (cmd == ExtCmd::SAVESTATE) {
+      SaveState::save(*cpu, name, buffer[1] & 1);
+    } else {
+      cancelPendingIO();
+      SaveState::load(*cpu, name);
+    }
+    return 0;
+  }
+  case ExtCmd::REWIND: {
+    if (cpu->movie.isActive()) {
+      PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                         "no rewind during a movie");
+      return 0;
+    }
+    cancelPendingIO();
+    bool halted = cpu->cpuhalted;
+    cpu->rewind.rewind(*cpu, buffer[1] == 0 ? 1 : buffer[1] * 50);
+    cpu->cpuhalted = halted;
+    return 0;
+  }
+  case ExtCmd::MOVIE: {
+    if (cpu->movie.isActive()) {
+      cpu->stopMovie();
+      return 0;
+    }
+    if (!cpu->floppy.fsinitialized) {
+      return 0;
+    }
+    std::string name(reinterpret_cast<char *>(&buffer[3]));
+    if (name.empty()) {
+      name = "movie";
+    }
+    if ((buffer[1] == 1) || (buffer[1] == 2)) {
+      cpu->recordMovie(name, buffer[1] == 1);
+    } else if (buffer[1] == 3) {
+      cpu->replayMovie(name, buffer[2] & 1);
+    }
+    return 0;
+  }
   }
   return 0;
 }
@@ -17,8 +17,10 @@
 #ifndef EXTERNALCMDS_H
 #define EXTERNALCMDS_H
 
+#include "IOWorker.h"
 #include "NotificationStruct.h"
 #include <cstdint>
+#include <memory>
 
 class C64Sys; // forward declaration
 
@@ -28,15 +30,22 @@ private:
   C64Sys *cpu;
   bool sendrawkeycodes;
   uint16_t actaddrreceivecmd;
+  // LOAD, SAVE or LIST executed by the I/O worker (one at a time)
+  std::unique_ptr<IOWorker::Job> iojob;
 
   void setType1Notification();
   void setType2Notification();
   void setType3Notification(uint16_t addr);
   void setType4Notification();
   void setType5Notification(uint8_t batteryVolLow, uint8_t batteryVolHi);
+  void setType6Notification(uint8_t stage);
   void dispVolume();
   void writeTextToC64Screen(uint16_t addr, int16_t sizebuffer);
   bool isBasicInputMode();
+  void submitIOJob(std::unique_ptr<IOWorker::Job> job);
+  void finishLoad(IOWorker::Job &job);
+  void finishSave(IOWorker::Job &job);
+  void finishList(IOWorker::Job &job);
 
 public:
   bool liststartflag;
@@ -46,10 +55,17 @@ public:
   NotificationStruct3 type3notification;
   NotificationStruct4 type4notification;
   NotificationStruct5 type5notification;
+  NotificationStruct6 type6notification;
 
   void init(uint8_t *ram, C64Sys *cpu);
   void setVarTab(uint16_t addr);
   uint8_t executeExternalCmd(uint8_t *buffer);
+  // completes a finished LOAD, SAVE or LIST (in BASIC input mode), true if
+  // the memory was changed
+  bool checkPendingIO();
+  // waits for a LOAD, SAVE or LIST in progress and drops its result (the
+  // memory it was meant for is replaced)
+  void cancelPendingIO();
 };
 
 #endif // EXTERNALCMDS_H
@@ -20,11 +20,14 @@
 #include "platform/PlatformManager.h"
 #include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iomanip>
+#include <new>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 static const char *TAG = "Floppy";
@@ -68,7 +71,68 @@ uint16_t countBitsLimited(uint32_t mask, uint8_t limit) {
   return cnt;
 }
 
+uint8_t Floppy::bamOffset(uint8_t track, uint8_t extbam) {
+  if ((track >= 1) && (track <= 35)) {
+    return 4 + (track - 1) * 4;
+  }
+  if ((track <= 40) && (extbam != 0)) {
+    return extbam + (track - 36) * 4;
+  }
+  return 0;
+}
+
+// a 40 track image has BAM entries for the tracks 36-40 if they are
+// consistent at the SpeedDOS ($c0) resp. DolphinDOS ($ac) offset (the
+// standard DOS leaves these bytes zero)
+uint8_t Floppy::detectExtBAM(const uint8_t *bam, uint8_t numtracks) {
+  if (numtracks < 40) {
+    return 0;
+  }
+  static const uint8_t layouts[] = {0xc0, 0xac};
+  for (uint8_t extbam : layouts) {
+    bool valid = true;
+    bool empty = true;
+    for (uint8_t t = 36; valid && (t <= 40); t++) {
+      const uint8_t *entry = &bam[bamOffset(t, extbam)];
+      uint32_t mask = static_cast<uint32_t>(entry[1]) |
+                      (static_cast<uint32_t>(entry[2]) << 8) |
+                      (static_cast<uint32_t>(entry[3]) << 16);
+      valid = (mask >> sectorsPerTrack[t] == 0) &&
+              (countBitsLimited(mask, sectorsPerTrack[t]) == entry[0]);
+      empty = empty && (mask == 0);
+    }
+    if (valid && !empty) {
+      return extbam;
+    }
+  }
+  return 0;
+}
+
+// free blocks according to the BAM (without the directory track)
+uint16_t Floppy::countFreeBlocks(const uint8_t *bam, uint8_t numtracks,
+                                 uint8_t extbam) {
+  uint16_t freeBlocks = 0;
+  for (uint8_t t = 1; t <= numtracks; t++) {
+    uint8_t base = bamOffset(t, extbam);
+    if ((t == 18) || (base == 0)) {
+      continue;
+    }
+    uint32_t mask = static_cast<uint32_t>(bam[base + 1]) |
+                    (static_cast<uint32_t>(bam[base + 2]) << 8) |
+                    (static_cast<uint32_t>(bam[base + 3]) << 16);
+    freeBlocks += countBitsLimited(mask, sectorsPerTrack[t]);
+  }
+  return freeBlocks;
+}
+
 void Floppy::initChannels() {
+  stopPrefetch();
+  stopReadJob();
+  writesecondary = 0xff;
+  writedata.clear();
+  writestatus = 0;
+  errmessagelen = 0;
+  errmessageidx = 0;
   for (auto &ch : channels) {
     ch.buffernr = 0;
     ch.hasChannelName = false;
@@ -92,6 +156,7 @@ void Floppy::initAttach() {
 
 bool Floppy::fsinitialized = false;
 std::unique_ptr<FileDriver> Floppy::sysfile;
+IOWorker Floppy::ioworker;
 
 void Floppy::init(uint8_t device) {
   this->device = device;
@@ -104,23 +169,62 @@ void Floppy::init(uint8_t device) {
     sysfile = FileSys::create();
     fsinitialized = sysfile->init();
     d64file = FileSys::create();
-    for (auto &ch : channels) {
-      ch.file = FileSys::create();
+    if (fsinitialized) {
+      ioworker.start();
     }
+    truedrive = Config::TRUEDRIVE && loadDOSROM();
   }
   initChannels();
   initAttach();
+  if (truedrive) {
+    // reset line of the serial bus
+    resetrequest.store(true, std::memory_order_release);
+  }
+}
+
+bool Floppy::loadDOSROM() {
+  std::string filename = std::string(Config::PATH) + DOSROMFILE;
+  if (!sysfile->open(filename, "rb")) {
+    PlatformManager::getInstance().log(
+        LOG_ERROR, TAG, "cannot open %s, true drive emulation not available",
+        filename.c_str());
+    return false;
+  }
+  dosrom.reset(new (std::nothrow) uint8_t[DOSROMSIZE]);
+  bool ok = dosrom && (sysfile->size() == DOSROMSIZE) &&
+            (sysfile->read(dosrom.get(), DOSROMSIZE) == DOSROMSIZE);
+  sysfile->close();
+  if (!ok) {
+    PlatformManager::getInstance().log(
+        LOG_ERROR, TAG,
+        "%s is not a 16 KB rom, true drive emulation not available",
+        filename.c_str());
+    dosrom.reset();
+    return false;
+  }
+  PlatformManager::getInstance().log(LOG_INFO, TAG, "true drive emulation");
+  return true;
 }
 
 bool Floppy::attach(const std::string &filename) {
   initChannels();
   initAttach();
+  // write back the actual image (may be the same file)
+  flush(true);
   std::string d64filename = Config::PATH + filename;
   d64file->close();
+  d64image.reset();
+  d64imagesize = 0;
+  dirindexvalid = false;
   if (!d64file->open(d64filename, "rb")) {
-    PlatformManager::getInstance().log(
-        LOG_ERROR, "Floppy", "cannot open file %s", d64filename.c_str());
-    return false;
+    // power lost while replacing the file by the written back image?
+    std::string tmpfilename = d64filename + ".tmp";
+    if (!sysfile->rename(tmpfilename, d64filename) ||
+        !d64file->open(d64filename, "rb")) {
+      PlatformManager::getInstance().log(
+          LOG_ERROR, "Floppy", "cannot open file %s", d64filename.c_str());
+      return false;
+    }
   }
   // try to detect tracks from file size
   int64_t filesize = d64file->size();
@@ -133,42 +237,174 @@ bool Floppy::attach(const std::string &filename) {
   } else {
     detectedTracks = 35;
   }
-  // read BAM (track 18 sector 0)
-  if (!d64file->seek(calcOffset(18, 0), SEEK_SET)) {
-    PlatformManager::getInstance().log(LOG_ERROR, TAG,
-                                       "unsuccessful seek operation");
-    return false;
+  if (loadImage()) {
+    d64file->close();
   }
-  if (d64file->read(buffer[4], 256) == 0) {
+  // read BAM (track 18 sector 0), the drive ram belongs to the drive thread
+  // if the true drive is active
+  uint8_t bam[256];
+  if (!readSector(18, 0, bam)) {
     PlatformManager::getInstance().log(LOG_ERROR, TAG,
                                        "unsuccessful read operation");
     return false;
   }
-  // count free blocks (skip track 18)
-  freeBlocks = 0;
-  for (uint8_t t = 1; t <= detectedTracks; t++) {
-    if (t == 18) {
-      continue;
-    }
-    uint8_t base = (t - 1) * 4;
-    uint32_t mask = static_cast<uint32_t>(buffer[4][base + 5]) |
-                    (static_cast<uint32_t>(buffer[4][base + 6]) << 8) |
-                    (static_cast<uint32_t>(buffer[4][base + 7]) << 16);
-    uint16_t bits = countBitsLimited(mask, sectorsPerTrack[t]);
-    freeBlocks += bits;
-  }
-  if (buffer[4][0] == 0) {
+  uint8_t detectedExtBAM = detectExtBAM(bam, detectedTracks);
+  freeBlocks = countFreeBlocks(bam, detectedTracks, detectedExtBAM);
+  if (bam[0] == 0) {
     return false;
   }
+  numtracks = detectedTracks;
+  extbam = detectedExtBAM;
+  if (truedrive) {
+    insertDisk(detectedTracks);
+  } else {
+    memcpy(buffer[4], bam, sizeof(bam));
+  }
   d64attached = true;
+  d64name = filename;
+  buildDirIndex(bam);
   return true;
 }
 
 void Floppy::detach() {
   initChannels();
   initAttach();
+  flush(true);
+  flushbuf.reset();
   d64attached = false;
   d64file->close();
+  d64image.reset();
+  d64imagesize = 0;
+  dirindexvalid = false;
+  direntries.clear();
+  direxact.clear();
+  dirsorted.clear();
+  if (truedrive) {
+    insertDisk(0);
+  }
+}
+
+void Floppy::insertDisk(uint8_t numtracks) {
+  GCRDisk *gcrdisk = new GCRDisk();
+  if (numtracks > 0) {
+    gcrdisk->encode(
+        [this](uint8_t t, uint8_t s, uint8_t *buf) {
+          return readSector(t, s, buf);
+        },
+        numtracks);
+  }
+  // a disk not yet taken by the drive thread is replaced
+  delete newdisk.exchange(gcrdisk, std::memory_order_acq_rel);
+}
+
+bool Floppy::loadImage() {
+  d64image.reset();
+  d64imagesize = 0;
+  int64_t size = d64file->size();
+  if ((size <= 0) || (size > MAXIMAGESIZE)) {
+    return false;
+  }
+  // large allocations are placed in PSRAM on the ESP32, the image is
+  // streamed from the file if memory is short
+  std::unique_ptr<uint8_t[]> image(new (std::nothrow) uint8_t[size]);
+  if (!image) {
+    PlatformManager::getInstance().log(
+        LOG_INFO, TAG, "not enough memory for d64 image, streaming");
+    return false;
+  }
+  if (!d64file->seek(0, SEEK_SET) ||
+      (d64file->read(image.get(), size) != (size_t)size)) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "unsuccessful read operation");
+    return false;
+  }
+  d64image = std::move(image);
+  d64imagesize = size;
+  return true;
+}
+
+void Floppy::startPrefetch(std::unique_ptr<IOWorker::Job> job) {
+  stopPrefetch();
+  prefetch = std::move(job);
+  prefetchpos = 0;
+  ioworker.submit(*prefetch);
+}
+
+void Floppy::stopPrefetch() {
+  if (prefetch) {
+    // the worker may still use the job
+    ioworker.wait(*prefetch);
+    prefetch.reset();
+  }
+}
+
+void Floppy::stopReadJob() {
+  if (readjob) {
+    ioworker.wait(*readjob);
+    readjob.reset();
+  }
+}
+
+bool Floppy::isIOPending(bool read) const {
+  if (prefetch && !prefetch->isDone()) {
+    return true;
+  }
+  if (read) {
+    return false;
+  }
+  return (readjob && !readjob->isDone()) ||
+         (writejob && !writejob->isDone()) ||
+         (flushjob && !flushjob->isDone());
+}
+
+void Floppy::waitIO() {
+  for (IOWorker::Job *job :
+       {prefetch.get(), readjob.get(), writejob.get(), flushjob.get()}) {
+    if (job) {
+      ioworker.wait(*job);
+    }
+  }
+}
+
+IOWorker::Job *Floppy::getPrefetch(IOWorker::Op op) {
+  if ((!prefetch) || (prefetch->op != op)) {
+    return nullptr;
+  }
+  ioworker.wait(*prefetch);
+  return prefetch.get();
+}
+
+bool Floppy::readChainSector(uint8_t track, uint8_t sector, uint8_t *buf) {
+  IOWorker::Job *job = getPrefetch(IOWorker::Op::READCHAIN);
+  if (job && ((prefetchpos + 1) * 256 <= job->data.size())) {
+    // the block must be the one linked by the previous block
+    const uint8_t *blk = job->data.data() + prefetchpos * 256;
+    const uint8_t *prev = blk - 256;
+    if ((prefetchpos == 0)
+            ? ((job->track == track) && (job->sector == sector))
+            : ((prev[0] == track) && (prev[1] == sector))) {
+      memcpy(buf, blk, 256);
+      prefetchpos++;
+      return true;
+    }
+  }
+  stopPrefetch();
+  return readSector(track, sector, buf);
+}
+
+bool Floppy::readSector(uint8_t track, uint8_t sector, uint8_t *buf) {
+  int64_t offset = calcOffset(track, sector);
+  if (offset < 0) {
+    return false;
+  }
+  if (d64image) {
+    if (offset + 256 > d64imagesize) {
+      return false;
+    }
+    memcpy(buf, d64image.get() + offset, 256);
+    return true;
+  }
+  return d64file->seek(offset, SEEK_SET) && (d64file->read(buf, 256) == 256);
 }
 
 void addDirectoryLine(uint8_t *buf, uint16_t &idx, uint16_t &addr,
@@ -240,20 +476,20 @@ bool Floppy::readNextDirBlk() {
     channels[0].buffersize = 32;
     channels[0].bufferidx = 0;
     diriterstate++;
-    initIterateDirectoryBlk();
+    diriteridx = 0;
     break;
   }
   case 2: {
-    iterateDirectoryBlk(name, buf,
-                        [&](const std::string &name, const std::string &search,
-                            const uint16_t blocks, const uint8_t fileType) {
-                          addDirectoryLine(buf, idx, diriteraddr, blocks, name,
-                                           decodeFileType(fileType));
-                          return false;
-                        });
+    // up to 8 lines of 32 bytes per buffer
+    const std::vector<DirEntry> &entries = getDirIndex();
+    for (uint8_t i = 0; (i < 8) && (diriteridx < entries.size()); i++) {
+      const DirEntry &entry = entries[diriteridx++];
+      addDirectoryLine(buf, idx, diriteraddr, entry.blocks, entry.name,
+                       decodeFileType(entry.fileType));
+    }
     channels[0].buffersize = idx;
     channels[0].bufferidx = 0;
-    if (track == 0) {
+    if (diriteridx >= entries.size()) {
       diriterstate++;
     }
     break;
@@ -290,18 +526,15 @@ bool Floppy::readNextDirBlk() {
 
 bool Floppy::readNextFileBlk() {
   if (track != 0) {
-    if (!d64file->seek(calcOffset(track, sector), SEEK_SET)) {
-      lastStatus = 0x42;
-      return true;
-    }
     // PlatformManager::getInstance().log(LOG_INFO, TAG,
     //                                   "readNextFileBlk, currentSecondary=%d",
     //                                    currentSecondary);
     uint8_t *buf = buffer[channels[currentSecondary].buffernr];
-    uint16_t s = d64file->read(buf, 256);
-    if (s == 0) {
+    if (!readChainSector(track, sector, buf)) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                         "unsuccessful read operation");
       track = 0;
-      lastStatus = 0x40; // EOI
+      lastStatus = 0x42;
       return true;
     }
     uint8_t oldtrack = track;
@@ -329,14 +562,20 @@ bool Floppy::readNextFileBlk() {
 }
 
 bool Floppy::directLoad() {
-  if (!channels[0].isOpen) {
+  IOWorker::Job *job =
+      channels[0].isOpen ? getPrefetch(IOWorker::Op::READFILE) : nullptr;
+  if ((!job) || (!job->ok)) {
     PlatformManager::getInstance().log(LOG_INFO, TAG, "file not found");
     lastStatus = 0x42;
     return true;
   }
   uint8_t *buf = buffer[channels[0].buffernr];
+  uint32_t size = job->data.size();
+  uint32_t len = (prefetchpos < size) ? std::min(size - prefetchpos, 256u) : 0;
+  memcpy(buf, job->data.data() + prefetchpos, len);
+  prefetchpos += len;
   channels[0].bufferidx = 0;
-  channels[0].buffersize = channels[0].file->read(buf, 256);
+  channels[0].buffersize = len;
   if (channels[0].buffersize == 0) {
     lastStatus = 0x40; // EOI
     return true;
@@ -445,13 +684,32 @@ bool Floppy::handleCmdChannel() {
             LOG_INFO, TAG, "track1 = %d, sector1 = %d, secch1=%d, buffernr=%d",
             (int)track1, (int)sector1, (int)secch1,
             (int)channels[secch1].buffernr);
-        if (!d64file->seek(calcOffset(track1, sector1), SEEK_SET)) {
+        uint8_t *buf = buffer[channels[secch1].buffernr];
+        if (!readSector(track1, sector1, buf)) {
           lastStatus = 0x02;
           return true;
         }
-        uint8_t *buf = buffer[channels[secch1].buffernr];
-        channels[secch1].buffersize = d64file->read(buf, 256);
+        channels[secch1].buffersize = 256;
         channels[secch1].bufferidx = 0;
+      } else if ((cmd->command == "S") || (cmd->command == "S0") ||
+                 (cmd->command == "R") || (cmd->command == "R0")) {
+        // argument without the trailing return
+        std::string arg = name.substr(name.find(':') + 1);
+        arg = arg.substr(0, arg.find('\r'));
+        if (cmd->command[0] == 'S') {
+          uint16_t cnt = scratch(arg);
+          PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                             "%lu files scratched",
+                                             (unsigned long)cnt);
+        } else {
+          size_t eq = arg.find('=');
+          if ((eq == std::string::npos) ||
+              !rename(arg.substr(0, eq), arg.substr(eq + 1))) {
+            PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                               "cannot rename: %s",
+                                               arg.c_str());
+          }
+        }
       } else {
         PlatformManager::getInstance().log(LOG_ERROR, TAG,
                                            "unknown command: %s", name.c_str());
@@ -471,7 +729,7 @@ uint8_t Floppy::iecin() {
     return 0;
   }
   if (triggererrorchannel) {
-    if (errmessageidx < 12) {
+    if (errmessageidx < errmessagelen) {
       return errmessage[errmessageidx++];
     }
     lastStatus = 0x40; // EOI
@@ -542,14 +800,597 @@ bool wildcard_match(const char *text, const char *pattern) {
   return !*pattern;
 }
 
-void Floppy::iecout(uint8_t value) {
+void Floppy::buildDirIndex(const uint8_t *bam) {
+  direntries.clear();
+  direxact.clear();
+  dirsorted.clear();
+  dirindexvalid = true;
+  uint8_t buf[256];
+  uint8_t t = bam[0];
+  uint8_t s = bam[1];
+  // a directory has at most MAXDIRBLOCKS blocks (protection against loops)
+  for (uint8_t blk = 0; (t != 0) && (blk < MAXDIRBLOCKS); blk++) {
+    if (!readSector(t, s, buf)) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                         "unsuccessful read operation");
+      break;
+    }
+    t = buf[0];
+    s = buf[1];
+    for (uint8_t e = 0; e < 8; e++) {
+      const uint8_t *raw = &buf[e * 32];
+      uint8_t fileTypeE = raw[2] & 0x0f;
+      if ((fileTypeE < 1) || (fileTypeE > 4)) {
+        continue;
+      }
+      DirEntry entry;
+      uint8_t len = 0;
+      while ((len < 16) && (raw[5 + len] != 160)) {
+        entry.name[len] = raw[5 + len];
+        len++;
+      }
+      entry.name[len] = 0;
+      entry.fileType = raw[2];
+      entry.startTrack = raw[3];
+      entry.startSector = raw[4];
+      entry.blocks = raw[30] + (raw[31] << 8);
+      // first entry of a name wins (as on a real drive)
+      direxact.emplace(entry.name, direntries.size());
+      direntries.push_back(entry);
+    }
+  }
+  dirsorted.resize(direntries.size());
+  for (uint16_t i = 0; i < dirsorted.size(); i++) {
+    dirsorted[i] = i;
+  }
+  std::stable_sort(dirsorted.begin(), dirsorted.end(),
+                   [this](uint16_t a, uint16_t b) {
+                     return strcmp(direntries[a].name, direntries[b].name) < 0;
+                   });
+}
+
+const std::vector<Floppy::DirEntry> &Floppy::getDirIndex() {
+  if (!dirindexvalid) {
+    // BAM of the image, the drive ram belongs to the drive thread if the
+    // true drive is active
+    uint8_t bam[256];
+    if (!readSector(18, 0, bam)) {
+      bam[0] = 0;
+    }
+    buildDirIndex(bam);
+  }
+  return direntries;
+}
+
+int16_t Floppy::findDirEntry(const std::string &pattern) {
+  const std::vector<DirEntry> &entries = getDirIndex();
+  size_t wildcard = pattern.find_first_of("*?");
+  if (wildcard == std::string::npos) {
+    auto it = direxact.find(pattern);
+    return (it == direxact.end()) ? -1 : it->second;
+  }
+  int16_t found = -1;
+  if (wildcard == 0) {
+    for (uint16_t i = 0; (i < entries.size()) && (found < 0); i++) {
+      if (wildcard_match(entries[i].name, pattern.c_str())) {
+        found = i;
+      }
+    }
+    return found;
+  }
+  // candidates: entries starting with the fixed prefix of the pattern
+  std::string prefix = pattern.substr(0, wildcard);
+  auto it = std::lower_bound(dirsorted.begin(), dirsorted.end(), prefix,
+                             [this](uint16_t idx, const std::string &p) {
+                               return strcmp(direntries[idx].name, p.c_str()) <
+                                      0;
+                             });
+  for (; it != dirsorted.end(); ++it) {
+    const char *entryname = direntries[*it].name;
+    if (strncmp(entryname, prefix.c_str(), prefix.size()) != 0) {
+      break;
+    }
+    if (((found < 0) || (*it < found)) &&
+        wildcard_match(entryname, pattern.c_str())) {
+      found = *it;
+    }
+  }
+  return found;
+}
+
+bool Floppy::writeSector(uint8_t track, uint8_t sector, const uint8_t *buf) {
+  int64_t offset = calcOffset(track, sector);
+  if ((!d64image) || (offset < 0) || (offset + 256 > d64imagesize) ||
+      (sector >= sectorsPerTrack[track])) {
+    return false;
+  }
+  memcpy(d64image.get() + offset, buf, 256);
+  dirtysectors.set(offset / 256);
+  lastwrite = PlatformManager::getInstance().getTimeUS();
+  if (track == 18) {
+    dirindexvalid = false;
+  }
+  return true;
+}
+
+uint8_t *Floppy::getBAM() { return d64image.get() + calcOffset(18, 0); }
+
+void Floppy::updateBAM() {
+  uint8_t *bam = getBAM();
+  dirtysectors.set(calcOffset(18, 0) / 256);
+  lastwrite = PlatformManager::getInstance().getTimeUS();
+  freeBlocks = countFreeBlocks(bam, numtracks, extbam);
+  if (!truedrive) {
+    memcpy(buffer[4], bam, 256);
+  }
+}
+
+bool Floppy::allocSector(uint8_t &track, uint8_t &sector) {
+  // track 18: directory sector, otherwise the next free sector of the actual
+  // track (interleave), then the tracks nearest to the directory track (17,
+  // 19, 16, 20, ...)
+  uint8_t candidates[40];
+  uint8_t num = 0;
+  if (track != 0) {
+    candidates[num++] = track;
+  }
+  for (uint8_t dist = 1; (track != 18) && (dist < 40); dist++) {
+    if ((dist < 18) && (18 - dist != track)) {
+      candidates[num++] = 18 - dist;
+    }
+    if ((18 + dist <= numtracks) && (18 + dist != track)) {
+      candidates[num++] = 18 + dist;
+    }
+  }
+  uint8_t *bam = getBAM();
+  for (uint8_t i = 0; i < num; i++) {
+    uint8_t t = candidates[i];
+    uint8_t base = bamOffset(t, extbam);
+    if (base == 0) {
+      continue;
+    }
+    uint8_t n = sectorsPerTrack[t];
+    uint8_t start = (t == track) ? (sector + INTERLEAVE) % n : 0;
+    uint8_t *entry = &bam[base];
+    for (uint8_t j = 0; j < n; j++) {
+      uint8_t s = (start + j) % n;
+      uint8_t mask = 1 << (s % 8);
+      if (entry[1 + s / 8] & mask) {
+        entry[1 + s / 8] &= ~mask;
+        if (entry[0] > 0) {
+          entry[0]--;
+        }
+        updateBAM();
+        track = t;
+        sector = s;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Floppy::freeSector(uint8_t track, uint8_t sector) {
+  uint8_t base = bamOffset(track, extbam);
+  if ((base == 0) || (track > numtracks) ||
+      (sector >= sectorsPerTrack[track])) {
+    return;
+  }
+  uint8_t *entry = &getBAM()[base];
+  uint8_t mask = 1 << (sector % 8);
+  if (!(entry[1 + sector / 8] & mask)) {
+    entry[1 + sector / 8] |= mask;
+    entry[0]++;
+    updateBAM();
+  }
+}
+
+bool Floppy::allocDirEntry(uint8_t &track, uint8_t &sector, uint8_t &idx) {
+  // first free entry of the directory, the directory is extended if full
+  uint8_t buf[256];
+  uint8_t *bam = getBAM();
+  uint8_t t = bam[0];
+  uint8_t s = bam[1];
+  for (uint8_t blk = 0; blk < MAXDIRBLOCKS; blk++) {
+    if (!readSector(t, s, buf)) {
+      return false;
+    }
+    for (uint8_t e = 0; e < 8; e++) {
+      if (buf[e * 32 + 2] == 0) {
+        track = t;
+        sector = s;
+        idx = e;
+        return true;
+      }
+    }
+    if (buf[0] == 0) {
+      uint8_t nt = 18;
+      uint8_t ns = s;
+      if ((t != 18) || !allocSector(nt, ns)) {
+        return false;
+      }
+      buf[0] = nt;
+      buf[1] = ns;
+      writeSector(t, s, buf);
+      memset(buf, 0, sizeof(buf));
+      buf[1] = 0xff;
+      writeSector(nt, ns, buf);
+      track = nt;
+      sector = ns;
+      idx = 0;
+      return true;
+    }
+    t = buf[0];
+    s = buf[1];
+  }
+  return false;
+}
+
+uint8_t Floppy::writeFileToImage(const std::string &filename,
+                                 const std::vector<uint8_t> &data,
+                                 uint8_t fileType) {
+  if (!d64image) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "d64 image not in memory (read only)");
+    return 26; // write protect on
+  }
+  // "@0:NAME": replace an existing file
+  std::string fname = filename;
+  bool replace = (!fname.empty()) && (fname[0] == '@');
+  size_t colon = fname.find(':');
+  if (colon != std::string::npos) {
+    fname.erase(0, colon + 1);
+  } else if (replace) {
+    fname.erase(0, 1);
+  }
+  // "NAME,S,W": the file type follows the name (the mode is ignored)
+  size_t comma = fname.find(',');
+  while (comma != std::string::npos) {
+    switch (fname[comma + 1]) {
+    case 'S':
+      fileType = 0x81;
+      break;
+    case 'P':
+      fileType = 0x82;
+      break;
+    case 'U':
+      fileType = 0x83;
+      break;
+    default:
+      break;
+    }
+    comma = fname.find(',', comma + 1);
+  }
+  fname = fname.substr(0, fname.find(','));
+  if (fname.empty() || (fname.size() > 16) ||
+      (fname.find_first_of("*?") != std::string::npos)) {
+    return 33; // syntax error
+  }
+  getDirIndex();
+  auto it = direxact.find(fname);
+  uint8_t dirt, dirs, diridx;
+  if (it != direxact.end()) {
+    // the old file is replaced after the new one is written
+    if ((!replace) || !findDirSlot(it->second, dirt, dirs, diridx)) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG, "file exists: %s",
+                                         fname.c_str());
+      return 63; // file exists
+    }
+  } else {
+    replace = false;
+  }
+  uint16_t blocks = (data.size() + 253) / 254;
+  if (blocks == 0) {
+    blocks = 1;
+  }
+  if (blocks > freeBlocks) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "disk full");
+    return 72; // disk full
+  }
+  // allocate the chain, then write the blocks
+  std::vector<std::pair<uint8_t, uint8_t>> chain;
+  uint8_t t = 0;
+  uint8_t s = 0;
+  for (uint16_t blk = 0; blk < blocks; blk++) {
+    if (!allocSector(t, s)) {
+      for (auto &ts : chain) {
+        freeSector(ts.first, ts.second);
+      }
+      PlatformManager::getInstance().log(LOG_ERROR, TAG, "disk full");
+      return 72;
+    }
+    chain.emplace_back(t, s);
+  }
+  uint8_t buf[256];
+  for (uint16_t blk = 0; blk < blocks; blk++) {
+    memset(buf, 0, sizeof(buf));
+    size_t pos = blk * 254;
+    size_t len = std::min<size_t>(data.size() - pos, 254);
+    memcpy(&buf[2], data.data() + pos, len);
+    if (blk + 1 < blocks) {
+      buf[0] = chain[blk + 1].first;
+      buf[1] = chain[blk + 1].second;
+    } else {
+      // last block: index of the last byte
+      buf[0] = 0;
+      buf[1] = len + 1;
+    }
+    writeSector(chain[blk].first, chain[blk].second, buf);
+  }
+  if ((!replace) && !allocDirEntry(dirt, dirs, diridx)) {
+    for (auto &ts : chain) {
+      freeSector(ts.first, ts.second);
+    }
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "directory full");
+    return 72;
+  }
+  readSector(dirt, dirs, buf);
+  uint8_t *raw = &buf[diridx * 32];
+  uint8_t oldt = raw[3];
+  uint8_t olds = raw[4];
+  memset(&raw[2], 0, 30);
+  raw[2] = fileType;
+  raw[3] = chain[0].first;
+  raw[4] = chain[0].second;
+  memset(&raw[5], 160, 16);
+  memcpy(&raw[5], fname.data(), fname.size());
+  raw[30] = blocks & 0xff;
+  raw[31] = blocks >> 8;
+  writeSector(dirt, dirs, buf);
+  if (replace) {
+    freeChain(oldt, olds);
+  }
+  PlatformManager::getInstance().log(LOG_INFO, TAG, "saved %s (%lu blocks)",
+                                     fname.c_str(), (unsigned long)blocks);
+  return 0;
+}
+
+bool Floppy::findDirSlot(uint16_t entryidx, uint8_t &track, uint8_t &sector,
+                         uint8_t &idx) {
+  // position of an entry of the directory index in the directory
+  uint8_t buf[256];
+  uint8_t *bam = getBAM();
+  uint8_t t = bam[0];
+  uint8_t s = bam[1];
+  uint16_t cnt = 0;
+  for (uint8_t blk = 0; (t != 0) && (blk < MAXDIRBLOCKS); blk++) {
+    if (!readSector(t, s, buf)) {
+      return false;
+    }
+    for (uint8_t e = 0; e < 8; e++) {
+      uint8_t fileType = buf[e * 32 + 2] & 0x0f;
+      if ((fileType < 1) || (fileType > 4)) {
+        continue;
+      }
+      if (cnt++ == entryidx) {
+        track = t;
+        sector = s;
+        idx = e;
+        return true;
+      }
+    }
+    t = buf[0];
+    s = buf[1];
+  }
+  return false;
+}
+
+void Floppy::freeChain(uint8_t track, uint8_t sector) {
+  uint8_t buf[256];
+  for (uint16_t i = 0; (track != 0) && (i < MAXSECTORS); i++) {
+    if (!readSector(track, sector, buf)) {
+      break;
+    }
+    freeSector(track, sector);
+    track = buf[0];
+    sector = buf[1];
+  }
+}
+
+uint16_t Floppy::scratch(const std::string &pattern) {
+  if (!d64image) {
+    return 0;
+  }
+  uint16_t cnt = 0;
+  uint8_t buf[256];
+  uint8_t *bam = getBAM();
+  uint8_t t = bam[0];
+  uint8_t s = bam[1];
+  for (uint8_t blk = 0; (t != 0) && (blk < MAXDIRBLOCKS); blk++) {
+    if (!readSector(t, s, buf)) {
+      break;
+    }
+    bool changed = false;
+    for (uint8_t e = 0; e < 8; e++) {
+      uint8_t *raw = &buf[e * 32];
+      uint8_t fileType = raw[2] & 0x0f;
+      if ((fileType < 1) || (fileType > 4)) {
+        continue;
+      }
+      char entryname[17];
+      uint8_t len = 0;
+      while ((len < 16) && (raw[5 + len] != 160)) {
+        entryname[len] = raw[5 + len];
+        len++;
+      }
+      entryname[len] = 0;
+      if (!wildcard_match(entryname, pattern.c_str())) {
+        continue;
+      }
+      freeChain(raw[3], raw[4]);
+      raw[2] = 0;
+      changed = true;
+      cnt++;
+    }
+    if (changed) {
+      writeSector(t, s, buf);
+    }
+    t = buf[0];
+    s = buf[1];
+  }
+  return cnt;
+}
+
+bool Floppy::rename(const std::string &newname, const std::string &oldname) {
+  if ((!d64image) || newname.empty() || (newname.size() > 16)) {
+    return false;
+  }
+  getDirIndex();
+  auto it = direxact.find(oldname);
+  if ((it == direxact.end()) || (direxact.count(newname) != 0)) {
+    return false;
+  }
+  uint8_t t, s, e;
+  uint8_t buf[256];
+  if ((!findDirSlot(it->second, t, s, e)) || !readSector(t, s, buf)) {
+    return false;
+  }
+  uint8_t *raw = &buf[e * 32];
+  memset(&raw[5], 160, 16);
+  memcpy(&raw[5], newname.data(), newname.size());
+  return writeSector(t, s, buf);
+}
+
+void Floppy::closeWriteFile() {
+  // without a type in the name SAVE writes a PRG file, other channels a SEQ
+  // file (as the 1541 does)
+  uint8_t fileType = (writesecondary == 1) ? 0x82 : 0x81;
+  writesecondary = 0xff;
+  uint8_t err = 0;
+  if (d64attached) {
+    err = writeFileToImage(writename, writedata, fileType);
+  } else {
+    // "direct" save as prg file
+    std::string filename = writename;
+    size_t colon = filename.find(':');
+    if (colon != std::string::npos) {
+      filename.erase(0, colon + 1);
+    } else if ((!filename.empty()) && (filename[0] == '@')) {
+      filename.erase(0, 1);
+    }
+    filename = filename.substr(0, filename.find(','));
+    for (auto &c : filename) {
+      c = tolower(c);
+    }
+    if (writejob) {
+      ioworker.wait(*writejob);
+    }
+    writejob.reset(new IOWorker::Job(IOWorker::Op::WRITEFILE,
+                                     Config::PATH + filename + ".prg"));
+    writejob->data = std::move(writedata);
+    ioworker.submit(*writejob);
+  }
+  writedata.clear();
+  if (err != 0) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "cannot write %s",
+                                       writename.c_str());
+    // reported on the error channel and in ST (bit 0: write error)
+    setErrMessage(err);
+    writestatus = 0x01;
+  }
+}
+
+void Floppy::setErrMessage(uint8_t code) {
+  const char *text;
+  switch (code) {
+  case 0:
+    text = " OK";
+    break;
+  case 26:
+    text = "WRITE PROTECT ON";
+    break;
+  case 33:
+    text = "SYNTAX ERROR";
+    break;
+  case 63:
+    text = "FILE EXISTS";
+    break;
+  case 72:
+    text = "DISK FULL";
+    break;
+  default:
+    text = "ERROR";
+    break;
+  }
+  errmessagelen = snprintf(reinterpret_cast<char *>(errmessage),
+                           sizeof(errmessage), "%02u,%s,00,00",
+                           (unsigned int)code, text);
+  errmessageidx = 0;
+}
+
+void Floppy::finishFlush() {
+  if (!flushjob) {
+    return;
+  }
+  ioworker.wait(*flushjob);
+  if (!flushjob->ok) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "cannot write %s",
+                                       flushjob->path.c_str());
+  }
+  flushjob.reset();
+}
+
+void Floppy::flush(bool wait) {
+  if ((!d64image) || dirtysectors.none()) {
+    return;
+  }
+  finishFlush();
+  // the image is copied, the emulation continues to write to it
+  if (!flushbuf) {
+    flushbuf.reset(new (std::nothrow) uint8_t[MAXIMAGESIZE]);
+  }
+  const uint8_t *src = d64image.get();
+  if (flushbuf) {
+    memcpy(flushbuf.get(), src, d64imagesize);
+    src = flushbuf.get();
+  } else {
+    wait = true;
+  }
+  PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                     "write back %s (%lu modified sectors)",
+                                     d64name.c_str(),
+                                     (unsigned long)dirtysectors.count());
+  dirtysectors.reset();
+  flushjob.reset(
+      new IOWorker::Job(IOWorker::Op::REPLACEFILE, Config::PATH + d64name));
+  flushjob->src = src;
+  flushjob->srclen = d64imagesize;
+  ioworker.submit(*flushjob);
+  if (wait) {
+    finishFlush();
+  }
+}
+
+void Floppy::checkFlush() {
+  if (flushjob && flushjob->isDone()) {
+    finishFlush();
+  }
+  if (dirtysectors.none() || flushjob) {
+    return;
+  }
+  if ((dirtysectors.count() >= FLUSHSECTORS) ||
+      (PlatformManager::getInstance().getTimeUS() - lastwrite >=
+       FLUSHIDLEUS)) {
+    flush(false);
+  }
+}
+
+void Floppy::iecout(uint8_t value, bool atn) {
   if (collectName) {
-    if (value == 0x3f) {
+    if (atn) {
       // end of filename
       collectName = false;
       PlatformManager::getInstance().log(LOG_INFO, TAG, "name = %s!",
                                          name.c_str());
-      if (d64attached) {
+      if ((currentSecondary != 15) &&
+          ((currentSecondary == 1) || (name.find(",W") != std::string::npos))) {
+        // file written by the C64 (SAVE uses secondary address 1), stored
+        // at close
+        writesecondary = currentSecondary;
+        writename = name;
+        writedata.clear();
+        lastStatus = 0;
+      } else if (d64attached) {
         if (name == "$") {
           channels[0].isOpen = true;
           diriterstate = 1;
@@ -565,25 +1406,25 @@ void Floppy::iecout(uint8_t value) {
           //     LOG_INFO, TAG, "iecout, currentSecondary=%d",
           //     currentSecondary);
           lastStatus = 0;
-          initIterateDirectoryBlk();
-          bool found = false;
-          while ((track != 0) && (!found)) {
-            uint8_t *buf = buffer[channels[currentSecondary].buffernr];
-            found = iterateDirectoryBlk(
-                name, buf,
-                [&](const std::string &name, const std::string &search,
-                    const uint16_t blocks, const uint8_t fileType) {
-                  return wildcard_match(name.c_str(), search.c_str());
-                });
-          }
-          if (!found) {
+          int16_t entryidx = findDirEntry(name);
+          if (entryidx < 0) {
             lastStatus = 0x42; // file not found
           } else {
+            startTrack = direntries[entryidx].startTrack;
+            startSector = direntries[entryidx].startSector;
             track = startTrack;
             sector = startSector;
             channels[currentSecondary].isOpen = true;
             channels[currentSecondary].bufferidx = 0;
             channels[currentSecondary].buffersize = 0;
+            if (!d64image) {
+              // follow the sector chain in the background
+              std::unique_ptr<IOWorker::Job> job(new IOWorker::Job(
+                  IOWorker::Op::READCHAIN, Config::PATH + d64name));
+              job->track = track;
+              job->sector = sector;
+              startPrefetch(std::move(job));
+            }
           }
         }
       } else { // "direct" load
@@ -591,21 +1432,24 @@ void Floppy::iecout(uint8_t value) {
           c = tolower(c);
         }
         lastStatus = 0;
-        std::string filename = Config::PATH + name + ".prg";
-        if (!channels[0].file->open(filename, "rb")) {
-          PlatformManager::getInstance().log(LOG_INFO, TAG, "cannot open file");
-          channels[0].isOpen = false;
-          lastStatus = 0x42; // file not found
-        } else {
-          channels[0].isOpen = true;
-          channels[0].bufferidx = 0;
-          channels[0].buffersize = 0;
-        }
+        // the file is read in the background, a missing file is reported
+        // at the first read (see directLoad)
+        startPrefetch(std::unique_ptr<IOWorker::Job>(new IOWorker::Job(
+            IOWorker::Op::READFILE, Config::PATH + name + ".prg")));
+        channels[0].isOpen = true;
+        channels[0].bufferidx = 0;
+        channels[0].buffersize = 0;
       }
     } else {
       // get next char for filename
       name += static_cast<char>(value);
     }
+  } else if (!atn) {
+    // data byte
+    if (listening && (currentSecondary == writesecondary)) {
+      writedata.push_back(value);
+    }
+    return;
   }
   if (!collectName) {
     uint8_t cmd = value & 0xf0;
@@ -613,7 +1457,8 @@ void Floppy::iecout(uint8_t value) {
       listening = true;
       talking = false;
     } else if (value == 0x3f) {
-      lastStatus &= 0x40;
+      lastStatus = (lastStatus & 0x40) | writestatus;
+      writestatus = 0;
       listening = false;
     } else if (value == 0x40 + device) {
       talking = true;
@@ -626,9 +1471,10 @@ void Floppy::iecout(uint8_t value) {
       if ((currentSecondary == 15) &&
           (channels[15].bufferidx == channels[15].buffersize)) {
         if (talking) {
-          const char *okmsg = "00, OK,00,00";
-          memcpy(errmessage, okmsg, 12);
-          errmessageidx = 0;
+          if (errmessageidx >= errmessagelen) {
+            setErrMessage(0);
+          }
+          lastStatus = 0;
           channels[15].hasChannelName = false;
           channels[15].isOpen = true;
           triggererrorchannel = true;
@@ -643,6 +1489,11 @@ void Floppy::iecout(uint8_t value) {
       currentSecondary = value & 0x0f;
       channels[currentSecondary].hasChannelName = false;
       channels[currentSecondary].isOpen = false;
+      if (currentSecondary == writesecondary) {
+        closeWriteFile();
+      } else if (currentSecondary != 15) {
+        stopPrefetch();
+      }
       name = "";
     } else if (cmd == 0xf0) {
       currentSecondary = value & 0x0f;
@@ -655,52 +1506,131 @@ void Floppy::iecout(uint8_t value) {
 }
 
 uint16_t Floppy::load(const std::string &filename, uint8_t *ram) {
-  std::string path = Config::PATH + filename;
-  if (!sysfile->open(path, "rb")) {
+  IOWorker::Job job(IOWorker::Op::READFILE, Config::PATH + filename);
+  ioworker.submit(job);
+  ioworker.wait(job);
+  if (!job.ok) {
     PlatformManager::getInstance().log(LOG_ERROR, TAG, "cannot open file %s",
-                                       path.c_str());
+                                       job.path.c_str());
     return 0;
   }
-  uint8_t buf[256];
-  if (sysfile->read(buf, 2) != 2) {
+  return storePrg(job.data, ram);
+}
+
+uint16_t Floppy::storePrg(const std::vector<uint8_t> &prg, uint8_t *ram) {
+  if (prg.size() < 2) {
     PlatformManager::getInstance().log(LOG_ERROR, TAG,
                                        "not a prg file (header too short)");
     return 0;
   }
-  uint8_t addrLow = buf[0], addrHigh = buf[1];
-  uint16_t addr = addrLow | (addrHigh << 8);
-  uint16_t bytesRead;
-  while ((bytesRead = sysfile->read(buf, sizeof(buf))) > 0) {
-    for (uint16_t i = 0; i < bytesRead; i++) {
-      ram[addr++] = buf[i];
-    }
+  uint16_t addr = prg[0] | (prg[1] << 8);
+  for (size_t i = 2; i < prg.size(); i++) {
+    ram[addr++] = prg[i];
   }
-  sysfile->close();
   return addr;
 }
 
-bool Floppy::save(const std::string &filename, uint8_t *ram, uint16_t startaddr,
-                  uint16_t endaddr) {
-  std::string path = Config::PATH + filename;
-  if (!sysfile->open(path, "wb")) {
-    PlatformManager::getInstance().log(LOG_ERROR, TAG, "cannot open file %s",
-                                       path.c_str());
-    return false;
+void Floppy::makePrg(std::vector<uint8_t> &prg, const uint8_t *ram,
+                     uint16_t startaddr, uint16_t endaddr) {
+  uint16_t length = endaddr - startaddr;
+  prg.clear();
+  prg.reserve(length + 2);
+  prg.push_back(startaddr & 0xff);
+  prg.push_back((startaddr >> 8) & 0xff);
+  prg.insert(prg.end(), ram + startaddr, ram + startaddr + length);
+}
+
+Floppy::ReadStatus Floppy::readFile(const std::string &name,
+                                    std::vector<uint8_t> &data) {
+  data.clear();
+  if (readjob && (readname != name)) {
+    // left over from an interrupted load
+    stopReadJob();
   }
-  uint8_t buf[2];
-  buf[0] = startaddr & 0xff;
-  buf[1] = (startaddr >> 8) & 0xff;
-  if (sysfile->write(buf, 2) != 2) {
-    PlatformManager::getInstance().log(LOG_ERROR, TAG, "could not write file");
-    return false;
+  if (!readjob) {
+    std::unique_ptr<IOWorker::Job> job;
+    if (!d64attached) {
+      // "direct" load
+      std::string filename = name;
+      for (auto &c : filename) {
+        c = tolower(c);
+      }
+      job.reset(new IOWorker::Job(IOWorker::Op::READFILE,
+                                  Config::PATH + filename + ".prg"));
+    } else {
+      int16_t entryidx = findDirEntry(name);
+      if (entryidx < 0) {
+        return ReadStatus::NOTFOUND;
+      }
+      uint8_t t = direntries[entryidx].startTrack;
+      uint8_t s = direntries[entryidx].startSector;
+      if (d64image) {
+        return readChain(t, s, {}, data) ? ReadStatus::FOUND
+                                         : ReadStatus::NOTFOUND;
+      }
+      // image not in memory: the whole chain is read by the worker
+      job.reset(
+          new IOWorker::Job(IOWorker::Op::READCHAIN, Config::PATH + d64name));
+      job->track = t;
+      job->sector = s;
+    }
+    readjob = std::move(job);
+    readname = name;
+    ioworker.submit(*readjob);
   }
-  uint16_t length = endaddr - startaddr;
-  if (sysfile->write(ram + startaddr, length) != length) {
-    PlatformManager::getInstance().log(LOG_ERROR, TAG, "could not write file");
-    return false;
+  if (!readjob->isDone()) {
+    return ReadStatus::PENDING;
   }
-  sysfile->close();
-  return true;
+  std::unique_ptr<IOWorker::Job> job = std::move(readjob);
+  bool found;
+  if (job->op == IOWorker::Op::READFILE) {
+    data = std::move(job->data);
+    found = job->ok && !data.empty();
+  } else {
+    found = readChain(job->track, job->sector, job->data, data);
+  }
+  return found ? ReadStatus::FOUND : ReadStatus::NOTFOUND;
+}
+
+bool Floppy::readChain(uint8_t track, uint8_t sector,
+                       const std::vector<uint8_t> &blocks,
+                       std::vector<uint8_t> &data) {
+  // blocks read by the worker, the remaining blocks are read directly
+  uint8_t buf[256];
+  uint8_t t = track;
+  uint8_t s = sector;
+  // a file has at most 768 blocks (protection against loops)
+  for (uint16_t blk = 0; blk < 768; blk++) {
+    if ((blk + 1) * 256u <= blocks.size()) {
+      memcpy(buf, blocks.data() + blk * 256, 256);
+    } else if (!readSector(t, s, buf)) {
+      return false;
+    }
+    if (buf[0] == 0) {
+      // last block: buf[1] is the index of the last byte
+      if (buf[1] >= 2) {
+        data.insert(data.end(), buf + 2, buf + buf[1] + 1);
+      }
+      return true;
+    }
+    data.insert(data.end(), buf + 2, buf + 256);
+    t = buf[0];
+    s = buf[1];
+  }
+  return false;
+}
+
+bool Floppy::save(const std::string &filename, uint8_t *ram, uint16_t startaddr,
+                  uint16_t endaddr) {
+  IOWorker::Job job(IOWorker::Op::WRITEFILE, Config::PATH + filename);
+  makePrg(job.data, ram, startaddr, endaddr);
+  ioworker.submit(job);
+  ioworker.wait(job);
+  if (!job.ok) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "could not write file %s",
+                                       job.path.c_str());
+  }
+  return job.ok;
 }
 
 void Floppy::rmPrgFromFilename(std::string &filename) {
@@ -714,18 +1644,316 @@ bool Floppy::listnextentry(std::string &name, bool start) {
   return sysfile->listnextentry(name, start);
 }
 
+void Floppy::saveState(State &state) {
+  // the true drive is not part of the state
+  if (!truedrive) {
+    memcpy(state.ram, ram, sizeof(ram));
+  } else {
+    memset(state.ram, 0, sizeof(state.ram));
+  }
+  memcpy(state.errmessage, errmessage, sizeof(errmessage));
+  state.errmessagelen = errmessagelen;
+  state.errmessageidx = errmessageidx;
+  state.freeBlocks = freeBlocks;
+  state.track = track;
+  state.sector = sector;
+  state.startTrack = startTrack;
+  state.startSector = startSector;
+  state.diriterstate = diriterstate;
+  state.diriteraddr = diriteraddr;
+  state.diriteridx = diriteridx;
+  for (uint8_t i = 0; i < 16; i++) {
+    Channel &ch = channels[i];
+    State::ChannelState &chstate = state.channels[i];
+    chstate.buffernr = ch.buffernr;
+    chstate.hasChannelName = ch.hasChannelName;
+    chstate.isOpen = ch.isOpen;
+    chstate.bufferidx = ch.bufferidx;
+    chstate.buffersize = ch.buffersize;
+    chstate.filepos = ((i == 0) && ch.isOpen && (!d64attached) && prefetch)
+                          ? prefetchpos
+                          : -1;
+  }
+  memset(state.name, 0, sizeof(state.name));
+  name.copy(state.name, sizeof(state.name) - 1);
+  state.d64attached = d64attached;
+  memset(state.d64name, 0, sizeof(state.d64name));
+  d64name.copy(state.d64name, sizeof(state.d64name) - 1);
+  state.listening = listening;
+  state.talking = talking;
+  state.currentSecondary = currentSecondary;
+  state.collectName = collectName;
+  state.triggererrorchannel = triggererrorchannel;
+  state.triggercmdchannel = triggercmdchannel;
+  state.lastStatus = lastStatus;
+}
+
+bool Floppy::loadState(const State &state) {
+  // the d64 file is opened again resp. the file of a "direct" load is read
+  // again
+  if (state.d64attached) {
+    // the attached image is kept if the file is missing
+    std::string path = Config::PATH + std::string(state.d64name);
+    if ((!sysfile->open(path, "rb")) && !sysfile->open(path + ".tmp", "rb")) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                         "cannot open d64 file %s",
+                                         state.d64name);
+      return false;
+    }
+    sysfile->close();
+    if (!attach(std::string(state.d64name))) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                         "cannot attach d64 file %s",
+                                         state.d64name);
+      return false;
+    }
+  } else {
+    detach();
+  }
+  if (!truedrive) {
+    memcpy(ram, state.ram, sizeof(ram));
+  }
+  memcpy(errmessage, state.errmessage, sizeof(errmessage));
+  errmessagelen = state.errmessagelen;
+  errmessageidx = state.errmessageidx;
+  freeBlocks = state.freeBlocks;
+  track = state.track;
+  sector = state.sector;
+  startTrack = state.startTrack;
+  startSector = state.startSector;
+  diriterstate = state.diriterstate;
+  diriteraddr = state.diriteraddr;
+  diriteridx = state.diriteridx;
+  name = std::string(state.name);
+  for (uint8_t i = 0; i < 16; i++) {
+    Channel &ch = channels[i];
+    const State::ChannelState &chstate = state.channels[i];
+    ch.buffernr = chstate.buffernr;
+    ch.hasChannelName = chstate.hasChannelName;
+    ch.isOpen = chstate.isOpen;
+    ch.bufferidx = chstate.bufferidx;
+    ch.buffersize = chstate.buffersize;
+    if ((!d64attached) && (i == 0) && ch.isOpen && (chstate.filepos >= 0)) {
+      startPrefetch(std::unique_ptr<IOWorker::Job>(new IOWorker::Job(
+          IOWorker::Op::READFILE, Config::PATH + name + ".prg")));
+      prefetchpos = chstate.filepos;
+    }
+  }
+  listening = state.listening;
+  talking = state.talking;
+  currentSecondary = state.currentSecondary;
+  collectName = state.collectName;
+  triggererrorchannel = state.triggererrorchannel;
+  triggercmdchannel = state.triggercmdchannel;
+  lastStatus = state.lastStatus;
+  return true;
+}
+
+void Floppy::resetDrive() {
+  via1.init();
+  via2.init();
+  a = 0;
+  x = 0;
+  y = 0;
+  sp = 0xff;
+  cflag = false;
+  zflag = false;
+  dflag = false;
+  bflag = false;
+  vflag = false;
+  nflag = false;
+  iflag = true;
+  cpuhalted = false;
+  pc = getMem(0xfffc) | (getMem(0xfffd) << 8);
+  halftrack = 36;
+  headpos = 0;
+  bytecycles = 0;
+  lastbyte = 0;
+  sync = false;
+  lastactivity = cycles;
+  driveOutChanged();
+}
+
+void Floppy::busChanged() {
+  // inputs of VIA1 port B are inverted (1: line low), bit 5 - 6: device
+  // address jumpers
+  uint8_t lines = iec.getDriveLines();
+  via1.pbin = ((lines & IECBus::DATA) ? 0x01 : 0) |
+              ((lines & IECBus::CLK) ? 0x04 : 0) |
+              ((lines & IECBus::ATN) ? 0x80 : 0) | (((device - 8) & 3) << 5);
+  // ATN triggers an interrupt via CA1
+  via1.setCA1((lines & IECBus::ATN) != 0);
+}
+
+void Floppy::driveOutChanged() {
+  // VIA1 port B: bit 1: DATA out, bit 3: CLK out, bit 4: ATN acknowledge
+  uint8_t pb = via1.getPB();
+  uint8_t lines = ((pb & 0x02) ? IECBus::DATA : 0) |
+                  ((pb & 0x08) ? IECBus::CLK : 0) |
+                  ((pb & 0x10) ? IECBus::ATNA : 0);
+  if (iec.driveWrite(cycles, lines)) {
+    lastactivity = cycles;
+  }
+  busChanged();
+}
+
+void Floppy::stepHead() {
+  // VIA2 port B bit 0 - 1: phase of the stepper motor, one phase = half a
+  // track (the head position determines the phase the motor is in)
+  uint8_t phase = via2.getPB() & 3;
+  if ((phase == ((halftrack + 1) & 3)) && (halftrack < 84)) {
+    halftrack++;
+  } else if ((phase == ((halftrack - 1) & 3)) && (halftrack > 2)) {
+    halftrack--;
+  }
+}
+
+void Floppy::rotateDisk(uint8_t cyc) {
+  // VIA2 port B bit 2: motor, bit 5 - 6: density (speed zone)
+  uint8_t pb = via2.getPB();
+  if (!(pb & 0x04)) {
+    return;
+  }
+  bytecycles += cyc;
+  uint8_t bytetime = 32 - ((pb >> 5) & 3) * 2;
+  while (bytecycles >= bytetime) {
+    bytecycles -= bytetime;
+    uint8_t *gcrtrack = nullptr;
+    uint16_t size = 0;
+    if (disk && ((halftrack & 1) == 0)) {
+      gcrtrack = disk->getTrack(halftrack >> 1);
+      size = disk->getTrackSize(halftrack >> 1);
+    }
+    if (gcrtrack == nullptr) {
+      sync = false;
+      continue;
+    }
+    headpos++;
+    if (headpos >= size) {
+      headpos = 0;
+    }
+    if (!via2.getCB2()) {
+      // write mode (CB2 low): the data is kept until the disk is changed
+      gcrtrack[headpos] = via2.getPA();
+      sync = false;
+    } else {
+      // sync: at least 10 one bits
+      uint8_t data = gcrtrack[headpos];
+      sync = (data == 0xff) && (lastbyte == 0xff);
+      lastbyte = data;
+      if (sync) {
+        continue;
+      }
+      via2.pain = data;
+    }
+    // byte ready: CA1 resp. overflow flag (SO pin) if enabled by CA2
+    via2.ifr |= 0x02;
+    if (via2.getCA2()) {
+      vflag = true;
+    }
+  }
+}
+
 uint8_t Floppy::getMem(uint16_t addr) {
+  if (addr & 0x8000) {
+    return dosrom ? dosrom[addr & 0x3fff] : 0;
+  }
+  addr &= 0x1fff;
   if (addr < 0x0800) {
     return ram[addr];
-  } else {
-    return 0;
+  } else if (addr >= 0x1c00) {
+    // VIA2 port B bit 4: write protect (0: protected), bit 7: sync (0: sync)
+    via2.pbin = (sync ? 0 : 0x80) | 0x10;
+    return via2.getReg(addr & 0x0f);
+  } else if (addr >= 0x1800) {
+    return via1.getReg(addr & 0x0f);
   }
+  return addr >> 8;
 }
 
 void Floppy::setMem(uint16_t addr, uint8_t val) {
+  if (addr & 0x8000) {
+    return;
+  }
+  addr &= 0x1fff;
   if (addr < 0x0800) {
     ram[addr] = val;
+  } else if (addr >= 0x1c00) {
+    via2.setReg(addr & 0x0f, val);
+    stepHead();
+  } else if (addr >= 0x1800) {
+    uint8_t idx = addr & 0x0f;
+    via1.setReg(idx, val);
+    if ((idx == 0x00) || (idx == 0x02)) {
+      driveOutChanged();
+    }
   }
 }
 
-void Floppy::run() {}
+void Floppy::run() {
+  Platform &platform = PlatformManager::getInstance();
+  uint16_t spins = 0;
+  uint32_t busycycles = 0;
+  while (true) {
+    if (resetrequest.exchange(false, std::memory_order_acq_rel)) {
+      resetDrive();
+    }
+    GCRDisk *gcrdisk = newdisk.exchange(nullptr, std::memory_order_acq_rel);
+    if (gcrdisk != nullptr) {
+      disk.reset(gcrdisk);
+      lastactivity = cycles;
+    }
+    uint64_t horizon = iec.getHorizon();
+    while (iec.nextC64Event(cycles)) {
+      busChanged();
+      lastactivity = cycles;
+    }
+    if (cycles >= horizon) {
+      // caught up with the C64: wait for the next rasterline resp. sleep if
+      // the C64 does not advance
+      if (spins < MAXSPINS) {
+        spins++;
+        std::this_thread::yield();
+      } else {
+        platform.waitMS(1);
+      }
+      continue;
+    }
+    spins = 0;
+    while (cycles < horizon) {
+      while (iec.nextC64Event(cycles)) {
+        busChanged();
+        lastactivity = cycles;
+      }
+      if (cpuhalted ||
+          (!(via2.getPB() & 0x04) && (cycles - lastactivity > IDLECYCLES) &&
+           !(iec.getC64Lines() & IECBus::ATN))) {
+        // idle: skip to the next event of the C64, the timers keep running
+        uint64_t next = iec.nextC64EventCycle();
+        uint64_t target = (next < horizon) ? next : horizon;
+        uint32_t skipped = static_cast<uint32_t>(target - cycles);
+        via1.tick(skipped);
+        via2.tick(skipped);
+        cycles = target;
+        break;
+      }
+      numofcycles = 0;
+      execute(getMem(pc++));
+      if ((!iflag) && (via1.irq() || via2.irq())) {
+        setPCToIntVec(getMem(0xfffe) | (getMem(0xffff) << 8), false);
+      }
+      via1.tick(numofcycles);
+      via2.tick(numofcycles);
+      rotateDisk(numofcycles);
+      cycles += numofcycles;
+      busycycles += numofcycles;
+      iec.setDriveCycle(cycles);
+    }
+    iec.setDriveCycle(cycles);
+    if (busycycles >= 1000000) {
+      // let the idle task run (ESP32)
+      busycycles = 0;
+      platform.feedWDT();
+    }
+  }
+}
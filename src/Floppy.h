@@ -18,14 +18,27 @@
 #define FLOPPY_H
 
 #include "CPU6502.h"
+#include "GCRDisk.h"
 #include "IDebugBus.h"
+#include "IECBus.h"
+#include "IOWorker.h"
+#include "VIA.h"
 #include "fs/FileDriver.h"
 #include "platform/PlatformManager.h"
+#include <atomic>
+#include <bitset>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+// 1541 floppy drive
+// - default: the kernal routines for the serial bus are trapped (see class
+//   Hooks) and the DOS commands are emulated
+// - true drive (Config::TRUEDRIVE and DOSROMFILE available): the drive CPU
+//   runs the DOS ROM with two VIAs and a GCR disk in its own thread (run),
+//   connected to the C64 via the serial bus (IECBus)
 class Floppy : public CPU6502 {
 private:
   static constexpr uint8_t sectorsPerTrack[41] = {
@@ -35,9 +48,34 @@ private:
       18, 18, 18, 18, 18, 18,                // 25–30
       17, 17, 17, 17, 17, 17, 17, 17, 17, 17 // 31–40
   };
+  // number of the first sector of each track in a d64 image
+  static constexpr uint16_t trackStartSector[41] = {
+      0,   0,   21,  42,  63,  84,  105, 126, 147, 168, 189, 210, 231, 252,
+      273, 294, 315, 336, 357, 376, 395, 414, 433, 452, 471, 490, 508, 526,
+      544, 562, 580, 598, 615, 632, 649, 666, 683, 700, 717, 734, 751};
+  // largest d64 image (40 tracks incl. error info)
+  static const uint32_t MAXIMAGESIZE = 197376;
+  // number of sectors of a 40 track image
+  static const uint16_t MAXSECTORS = 768;
+  // the directory uses track 18 except sector 0 (BAM)
+  static const uint8_t MAXDIRBLOCKS = 18;
+  // sector interleave of files (as the 1541 DOS)
+  static const uint8_t INTERLEAVE = 10;
+  // a modified image is written back after FLUSHSECTORS modified sectors or
+  // after FLUSHIDLEUS without further writes (see checkFlush)
+  static const uint16_t FLUSHSECTORS = 256;
+  static const uint32_t FLUSHIDLEUS = 2000000;
+
+  // entry of the directory index
+  struct DirEntry {
+    char name[17];
+    uint8_t fileType;
+    uint8_t startTrack;
+    uint8_t startSector;
+    uint16_t blocks;
+  };
 
   struct Channel {
-    std::unique_ptr<FileDriver> file;
     uint8_t buffernr;
     bool hasChannelName;
     bool isOpen = false;
@@ -46,9 +84,32 @@ private:
   };
 
   std::unique_ptr<FileDriver> d64file;
+  // d64 image held in memory (nullptr: sectors are read from d64file)
+  std::unique_ptr<uint8_t[]> d64image;
+  uint32_t d64imagesize = 0;
+  std::string d64name;
+  uint8_t numtracks = 35;
+  // offset of the BAM entries of the tracks 36-40 (SpeedDOS resp.
+  // DolphinDOS layout), 0: only the tracks 1-35 are managed by the BAM
+  uint8_t extbam = 0;
+  // modified sectors of the image held in memory not yet written back, the
+  // whole image is written to a temporary file which replaces the d64 file
+  std::bitset<MAXSECTORS> dirtysectors;
+  int64_t lastwrite = 0;
+  std::unique_ptr<uint8_t[]> flushbuf;
+  std::unique_ptr<IOWorker::Job> flushjob;
+  // file written by the C64 (SAVE resp. OPEN with ",W"), stored at close
+  uint8_t writesecondary = 0xff;
+  std::string writename;
+  std::vector<uint8_t> writedata;
+  std::unique_ptr<IOWorker::Job> writejob;
   uint8_t *buffer[5];
-  uint8_t errmessage[12];
-  uint8_t errmessageidx;
+  // message of the error channel, an error is reported once, then "00, OK"
+  uint8_t errmessage[32];
+  uint8_t errmessagelen = 0;
+  uint8_t errmessageidx = 0;
+  // status of the last write, reported at the end of the close
+  uint8_t writestatus = 0;
   uint16_t freeBlocks;
   uint8_t track;
   uint8_t sector;
@@ -56,6 +117,13 @@ private:
   uint8_t startSector;
   uint8_t diriterstate;
   uint16_t diriteraddr;
+  uint16_t diriteridx = 0;
+  // directory of the attached image in directory order, built once (see
+  // getDirIndex), entries sorted by name for patterns with a fixed prefix
+  std::vector<DirEntry> direntries;
+  std::unordered_map<std::string, uint16_t> direxact;
+  std::vector<uint16_t> dirsorted;
+  bool dirindexvalid = false;
   Channel channels[16];
   std::string name;
   uint8_t device = 8;
@@ -67,63 +135,58 @@ private:
   bool triggercmdchannel = false;
   IDebugBus *debugBus;
 
-  int64_t calcOffset(uint8_t track, uint8_t sector) {
-    int64_t off = 0;
-    for (uint8_t t = 1; t < track; ++t) {
-      off += static_cast<int64_t>(sectorsPerTrack[t]) * 256;
-    }
-    off += static_cast<int64_t>(sector) * 256;
-    return off;
-  }
+  // file of a "direct" load resp. sector chain of a file of a d64 image not
+  // held in memory, read by the I/O worker at file open, prefetchpos: next
+  // byte resp. block to deliver
+  std::unique_ptr<IOWorker::Job> prefetch;
+  uint32_t prefetchpos = 0;
+  // bulk load in progress (see readFile)
+  std::unique_ptr<IOWorker::Job> readjob;
+  std::string readname;
 
-  void initIterateDirectoryBlk() {
-    track = buffer[4][0];
-    sector = buffer[4][1];
-  }
+  // copies a sector of the attached image to buf
+  bool readSector(uint8_t track, uint8_t sector, uint8_t *buf);
+  // copies the next sector of the file (prefetched chain if available)
+  bool readChainSector(uint8_t track, uint8_t sector, uint8_t *buf);
+  void startPrefetch(std::unique_ptr<IOWorker::Job> job);
+  void stopPrefetch();
+  // completed prefetch job of the given operation, nullptr if not available
+  IOWorker::Job *getPrefetch(IOWorker::Op op);
+  void stopReadJob();
+  bool readChain(uint8_t track, uint8_t sector,
+                 const std::vector<uint8_t> &blocks, std::vector<uint8_t> &data);
+  bool loadImage();
+  // directory starting at the track and sector given in the BAM
+  void buildDirIndex(const uint8_t *bam);
+  const std::vector<DirEntry> &getDirIndex();
+  // index of the first entry matching the pattern, -1 if not found
+  int16_t findDirEntry(const std::string &pattern);
 
-  // variables used outside this method:
-  // startTrack, startSector, buf, track
-  template <typename Callback>
-  bool iterateDirectoryBlk(const std::string &filename, uint8_t *buf,
-                           Callback cb) {
-    if (track != 0) {
-      if (!d64file->seek(calcOffset(track, sector), SEEK_SET)) {
-        PlatformManager::getInstance().log(LOG_ERROR, "Floppy",
-                                           "unsuccessful seek operation");
-        return false;
-      }
-      if (d64file->read(buf, 256) == 0) {
-        PlatformManager::getInstance().log(LOG_ERROR, "Floppy",
-                                           "unsuccessful read operation");
-        return false;
-      }
-      track = buf[0];
-      sector = buf[1];
-      for (uint8_t e = 0; e < 8; e++) {
-        uint8_t base = e * 32;
-        uint8_t fileType = buf[base + 2];
-        uint8_t fileTypeE = fileType & 0x0f;
-        startTrack = buf[base + 3];
-        startSector = buf[base + 4];
-        std::string fname;
-        for (uint8_t i = 0; i < 16; i++) {
-          uint8_t b = buf[base + 5 + i];
-          if (b == 160) {
-            break;
-          }
-          fname.push_back(b);
-        }
-        if ((fileTypeE < 1) || (fileTypeE > 4)) {
-          continue;
-        }
-        uint16_t blocks = buf[base + 30] + (buf[base + 31] << 8);
-        if (cb(fname, filename, blocks, fileType)) {
-          return true;
-        }
-      }
-    }
-    return false;
-  }
+  // write access to the image held in memory
+  // offset of the BAM entry of a track, 0 if not managed by the BAM
+  static uint8_t bamOffset(uint8_t track, uint8_t extbam);
+  static uint8_t detectExtBAM(const uint8_t *bam, uint8_t numtracks);
+  static uint16_t countFreeBlocks(const uint8_t *bam, uint8_t numtracks,
+                                  uint8_t extbam);
+  bool writeSector(uint8_t track, uint8_t sector, const uint8_t *buf);
+  uint8_t *getBAM();
+  void updateBAM();
+  bool allocSector(uint8_t &track, uint8_t &sector);
+  void freeSector(uint8_t track, uint8_t sector);
+  bool allocDirEntry(uint8_t &track, uint8_t &sector, uint8_t &idx);
+  // DOS error code (0: ok), the type of a closed file (0x81: SEQ, 0x82: PRG,
+  // 0x83: USR) is replaced by a type given in the name
+  uint8_t writeFileToImage(const std::string &filename,
+                           const std::vector<uint8_t> &data,
+                           uint8_t fileType);
+  bool findDirSlot(uint16_t entryidx, uint8_t &track, uint8_t &sector,
+                   uint8_t &idx);
+  void freeChain(uint8_t track, uint8_t sector);
+  uint16_t scratch(const std::string &pattern);
+  bool rename(const std::string &newname, const std::string &oldname);
+  void closeWriteFile();
+  void setErrMessage(uint8_t code);
+  void finishFlush();
 
   bool readNextDirBlk();
   bool readNextFileBlk();
@@ -134,8 +197,85 @@ private:
 
   uint8_t ram[0x800];
 
+  // --- true drive ---
+  static constexpr const char *DOSROMFILE = "dos1541.rom";
+  static const uint16_t DOSROMSIZE = 0x4000;
+  // the drive skips time while idle: motor off and no bus activity
+  static const uint32_t IDLECYCLES = 2000000;
+  // number of yields before sleeping if the drive caught up with the C64
+  static const uint16_t MAXSPINS = 1000;
+
+  std::unique_ptr<uint8_t[]> dosrom;
+  VIA via1;
+  VIA via2;
+  // disk in the drive (owned by the drive thread), a new disk is passed
+  // via newdisk (an empty GCRDisk: no disk)
+  std::unique_ptr<GCRDisk> disk;
+  std::atomic<GCRDisk *> newdisk{nullptr};
+  std::atomic<bool> resetrequest{false};
+  uint64_t cycles = 0;
+  uint64_t lastactivity = 0;
+  uint8_t halftrack;
+  uint16_t headpos;
+  uint8_t bytecycles;
+  uint8_t lastbyte;
+  bool sync;
+
+  bool loadDOSROM();
+  void insertDisk(uint8_t numtracks);
+  void resetDrive();
+  void busChanged();
+  void driveOutChanged();
+  void stepHead();
+  void rotateDisk(uint8_t cyc);
+
 public:
+  // state of the floppy incl. channels (see class SaveState)
+  struct State {
+    struct ChannelState {
+      uint8_t buffernr;
+      bool hasChannelName;
+      bool isOpen;
+      uint16_t bufferidx;
+      uint16_t buffersize;
+      int32_t filepos; // position in the file of a "direct" load
+    };
+    uint8_t ram[0x800];
+    uint8_t errmessage[32];
+    uint8_t errmessagelen;
+    uint8_t errmessageidx;
+    uint16_t freeBlocks;
+    uint8_t track;
+    uint8_t sector;
+    uint8_t startTrack;
+    uint8_t startSector;
+    uint8_t diriterstate;
+    uint16_t diriteraddr;
+    uint16_t diriteridx;
+    ChannelState channels[16];
+    char name[64];
+    bool d64attached;
+    char d64name[64];
+    bool listening;
+    bool talking;
+    uint8_t currentSecondary;
+    bool collectName;
+    bool triggererrorchannel;
+    bool triggercmdchannel;
+    uint8_t lastStatus;
+  };
+
   static std::unique_ptr<FileDriver> sysfile;
+  // file operations of the emulation thread (started at the first init)
+  static IOWorker ioworker;
+
+  // offset of a sector in a d64 image, -1 if the track is invalid
+  static int64_t calcOffset(uint8_t track, uint8_t sector) {
+    if ((track == 0) || (track > 40)) {
+      return -1;
+    }
+    return (static_cast<int64_t>(trackStartSector[track]) + sector) * 256;
+  }
 
   Floppy(IDebugBus *debug = nullptr) : debugBus(debug) {}
 
@@ -145,19 +285,50 @@ public:
   bool d64attached = false;
   uint8_t lastStatus = 0;
 
+  // true drive emulation active (kernal is not patched), only set by the
+  // first init (the drive task is started by C64Emu::setup)
+  bool truedrive = false;
+  IECBus iec;
+
   void init(uint8_t device);
   bool attach(const std::string &filename);
   void detach();
   uint8_t iecin();
-  void iecout(uint8_t value);
+  // atn: byte sent under ATN (command) resp. data byte
+  void iecout(uint8_t value, bool atn);
+  // writes a modified d64 image back if due (called once per frame)
+  void checkFlush();
+  // writes a modified d64 image back, wait: until written
+  void flush(bool wait);
   uint16_t load(const std::string &filename, uint8_t *ram);
+  // copies a prg file to its load address, returns the end address (0: not a
+  // prg file)
+  static uint16_t storePrg(const std::vector<uint8_t> &prg, uint8_t *ram);
+  // content of a prg file of the memory from startaddr to endaddr
+  static void makePrg(std::vector<uint8_t> &prg, const uint8_t *ram,
+                      uint16_t startaddr, uint16_t endaddr);
+  enum class ReadStatus : uint8_t { PENDING, FOUND, NOTFOUND };
+  // content of a file incl. load address (bulk load, see class Hooks), the
+  // file is read by the IO worker: PENDING until the read is completed (call
+  // again with the same name)
+  ReadStatus readFile(const std::string &name, std::vector<uint8_t> &data);
+  // a file job is in progress which iecin (read: true) resp. iecout, readFile
+  // would wait for
+  bool isIOPending(bool read) const;
+  // waits until the file jobs are completed
+  void waitIO();
   bool save(const std::string &filename, uint8_t *ram, uint16_t startaddr,
             uint16_t endaddr);
   void rmPrgFromFilename(std::string &filename);
   bool listnextentry(std::string &name, bool start);
+  void saveState(State &state);
+  // false if the d64 file cannot be attached (nothing else is restored)
+  bool loadState(const State &state);
 
+  // drive CPU (true drive)
   uint8_t getMem(uint16_t addr) override;
   void setMem(uint16_t addr, uint8_t val) override;
+  // drive thread, runs forever
   void run() override;
 };
 #endif // FLOPPY_H
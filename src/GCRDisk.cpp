@@ -0,0 +1,138 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "GCRDisk.h"
+#include "platform/PlatformManager.h"
+#include <cstring>
+#include <new>
+
+static const char *TAG = "GCRDisk";
+
+static const uint8_t gcrcode[16] = {0x0a, 0x0b, 0x12, 0x13, 0x0e, 0x0f,
+                                    0x16, 0x17, 0x09, 0x19, 0x1a, 0x1b,
+                                    0x0d, 0x1d, 0x1e, 0x15};
+
+uint8_t GCRDisk::getSectors(uint8_t track) {
+  if (track <= 17) {
+    return 21;
+  } else if (track <= 24) {
+    return 19;
+  } else if (track <= 30) {
+    return 18;
+  }
+  return 17;
+}
+
+uint8_t GCRDisk::getByteCycles(uint8_t track) {
+  if (track <= 17) {
+    return 26;
+  } else if (track <= 24) {
+    return 28;
+  } else if (track <= 30) {
+    return 30;
+  }
+  return 32;
+}
+
+void GCRDisk::encode4(const uint8_t *in, uint8_t *out) {
+  // 4 bytes -> 8 nybbles of 5 bits -> 5 bytes
+  uint64_t bits = 0;
+  for (uint8_t i = 0; i < 4; i++) {
+    bits = (bits << 10) | (gcrcode[in[i] >> 4] << 5) | gcrcode[in[i] & 0x0f];
+  }
+  for (int8_t i = 4; i >= 0; i--) {
+    out[i] = bits & 0xff;
+    bits >>= 8;
+  }
+}
+
+uint8_t *GCRDisk::encodeBlock(const uint8_t *in, uint16_t len, uint8_t *out) {
+  for (uint16_t i = 0; i < len; i += 4) {
+    encode4(in + i, out);
+    out += 5;
+  }
+  return out;
+}
+
+bool GCRDisk::encode(
+    const std::function<bool(uint8_t, uint8_t, uint8_t *)> &readsector,
+    uint8_t numtracks) {
+  if (numtracks > MAXTRACKS) {
+    numtracks = MAXTRACKS;
+  }
+  // track size given by the rotation speed (300 rpm) and the speed zone
+  uint32_t total = 0;
+  for (uint8_t t = 1; t <= numtracks; t++) {
+    trackoffset[t] = total;
+    tracksize[t] = 200000 / getByteCycles(t);
+    total += tracksize[t];
+  }
+  data.reset(new (std::nothrow) uint8_t[total]);
+  if (!data) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "not enough memory for gcr data");
+    memset(tracksize, 0, sizeof(tracksize));
+    return false;
+  }
+  uint8_t bam[256];
+  if (!readsector(18, 0, bam)) {
+    memset(bam, 0, sizeof(bam));
+  }
+  uint8_t id1 = bam[0xa2];
+  uint8_t id2 = bam[0xa3];
+  uint8_t raw[260];
+  for (uint8_t t = 1; t <= numtracks; t++) {
+    uint8_t *out = data.get() + trackoffset[t];
+    uint8_t *end = out + tracksize[t];
+    uint8_t sectors = getSectors(t);
+    // gap between the sectors fills the track
+    uint16_t sectorsize = SYNCBYTES + 10 + HEADERGAPBYTES + SYNCBYTES + 325;
+    uint16_t gap = (tracksize[t] - sectors * sectorsize) / sectors;
+    for (uint8_t s = 0; s < sectors; s++) {
+      memset(out, 0xff, SYNCBYTES);
+      out += SYNCBYTES;
+      raw[0] = 0x08;
+      raw[1] = s ^ t ^ id2 ^ id1;
+      raw[2] = s;
+      raw[3] = t;
+      raw[4] = id2;
+      raw[5] = id1;
+      raw[6] = 0x0f;
+      raw[7] = 0x0f;
+      out = encodeBlock(raw, 8, out);
+      memset(out, 0x55, HEADERGAPBYTES);
+      out += HEADERGAPBYTES;
+      memset(out, 0xff, SYNCBYTES);
+      out += SYNCBYTES;
+      raw[0] = 0x07;
+      if (!readsector(t, s, raw + 1)) {
+        memset(raw + 1, 0, 256);
+      }
+      uint8_t checksum = 0;
+      for (uint16_t i = 1; i <= 256; i++) {
+        checksum ^= raw[i];
+      }
+      raw[257] = checksum;
+      raw[258] = 0;
+      raw[259] = 0;
+      out = encodeBlock(raw, 260, out);
+      memset(out, 0x55, gap);
+      out += gap;
+    }
+    memset(out, 0x55, end - out);
+  }
+  return true;
+}
@@ -0,0 +1,61 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef GCRDISK_H
+#define GCRDISK_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// disk in the format read by the 1541 head (see class Floppy): each track of
+// a d64 image is converted to GCR, each sector consists of
+// - sync, header block (id, track, sector), gap
+// - sync, data block (256 bytes), gap
+// tracks are stored in one allocation (PSRAM on the ESP32)
+class GCRDisk {
+private:
+  static const uint8_t MAXTRACKS = 42;
+  static const uint8_t SYNCBYTES = 5;
+  static const uint8_t HEADERGAPBYTES = 9;
+
+  std::unique_ptr<uint8_t[]> data;
+  uint32_t trackoffset[MAXTRACKS + 1] = {};
+  uint16_t tracksize[MAXTRACKS + 1] = {};
+
+  static void encode4(const uint8_t *in, uint8_t *out);
+  static uint8_t *encodeBlock(const uint8_t *in, uint16_t len, uint8_t *out);
+
+public:
+  static uint8_t getSectors(uint8_t track);
+  // number of cycles per byte of the speed zone of the track (26 - 32)
+  static uint8_t getByteCycles(uint8_t track);
+
+  // readsector(track, sector, buf): reads a sector of the d64 image
+  bool encode(const std::function<bool(uint8_t, uint8_t, uint8_t *)> &readsector,
+              uint8_t numtracks);
+  // data of a track (1 - 42), nullptr if there is no data
+  uint8_t *getTrack(uint8_t track) {
+    return ((track > MAXTRACKS) || (tracksize[track] == 0))
+               ? nullptr
+               : data.get() + trackoffset[track];
+  }
+  uint16_t getTrackSize(uint8_t track) const {
+    return (track > MAXTRACKS) ? 0 : tracksize[track];
+  }
+};
+
+#endif // GCRDISK_H
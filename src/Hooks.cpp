@@ -18,13 +18,25 @@
 
 #include "C64Sys.h"
 #include "platform/PlatformManager.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
 
 static const char *TAG = "Hooks";
 
 static const uint16_t IECINHOOK = 0xee13;
 static const uint16_t IECOUTHOOK = 0xed40;
 static const uint16_t IECWAIT4CLKHOOK = 0xedcc;
+// target of the LOAD vector ($0330), instruction sta $93
+static const uint16_t LOADHOOK = 0xf4a5;
+
+// kernal routines used by LOAD
+static const uint16_t PRINTSEARCHING = 0xf5af;
+static const uint16_t PRINTLOADING = 0xf5d2;
+static const uint16_t LOADEND = 0xf5a9;
+static const uint16_t FILENOTFOUNDERROR = 0xf704;
 
 void Hooks::init(uint8_t *ram, C64Sys *cpu) {
   this->ram = ram;
@@ -36,10 +48,101 @@ void Hooks::patchKernal(uint8_t *kernal_rom) {
   kernal_rom[IECINHOOK - 0xe000] = 0;
   kernal_rom[IECOUTHOOK - 0xe000] = 0;
   kernal_rom[IECWAIT4CLKHOOK - 0xe000] = 0;
+  kernal_rom[LOADHOOK - 0xe000] = 0;
+}
+
+bool Hooks::isHook(uint16_t pc) {
+  return (pc == IECINHOOK + 1) || (pc == IECOUTHOOK + 1) ||
+         (pc == IECWAIT4CLKHOOK + 1) || (pc == LOADHOOK + 1);
+}
+
+bool Hooks::holdForIO(uint16_t pc, bool read) {
+  // a file job of the floppy is in progress: the hook is executed again by
+  // the next instruction (the emulation continues while the worker reads
+  // from the SD card), during movies the emulation waits for the job (the
+  // replay must not depend on the speed of the SD card)
+  if (!cpu->floppy.isIOPending(read)) {
+    return false;
+  }
+  if (cpu->movie.isActive()) {
+    cpu->floppy.waitIO();
+    return false;
+  }
+  // the brk of the hook takes 7 cycles, so the rasterline advances
+  cpu->setPC(pc - 1);
+  cpu->numofcycles += 7;
+  return true;
+}
+
+bool Hooks::bulkLoad(uint16_t pc) {
+  // only LOAD (not VERIFY) of a file from device 8, VERIFY and the directory
+  // are handled by the byte by byte transfer
+  if ((cpu->getA() != 0) || (ram[0xba] != 8) || (ram[0xb7] == 0)) {
+    return false;
+  }
+  uint16_t nameaddr = ram[0xbb] | (ram[0xbc] << 8);
+  std::string name;
+  for (uint8_t i = 0; i < ram[0xb7]; i++) {
+    name.push_back(static_cast<char>(cpu->getMem(nameaddr + i)));
+  }
+  if (name[0] == '$') {
+    return false;
+  }
+  uint8_t secondary = ram[0xb9];
+  std::vector<uint8_t> data;
+  Floppy::ReadStatus status = cpu->floppy.readFile(name, data);
+  if (status == Floppy::ReadStatus::PENDING) {
+    if (holdForIO(pc, false)) {
+      return true;
+    }
+    status = cpu->floppy.readFile(name, data);
+  }
+  PlatformManager::getInstance().log(LOG_INFO, TAG, "bulk load: %s",
+                                     name.c_str());
+  bool found = (status == Floppy::ReadStatus::FOUND);
+  if (found && (data.size() < 2)) {
+    return false;
+  }
+  ram[0x93] = 0;
+  ram[0xb9] = 0x60;
+  if (!found) {
+    // "SEARCHING FOR", then the kernal error (sec, a = 4)
+    ram[0x90] = 0x42;
+    cpu->pushReturnAddr(FILENOTFOUNDERROR);
+    cpu->setPC(PRINTSEARCHING);
+    return true;
+  }
+  // secondary address 0: load to the address given in x/y (stored in $c3/$c4
+  // by the LOAD entry)
+  uint16_t addr = (secondary == 0) ? ram[0xc3] | (ram[0xc4] << 8)
+                                   : data[0] | (data[1] << 8);
+  uint32_t len = data.size() - 2;
+  if ((addr + len <= 0xd000) || (addr >= 0xe000)) {
+    len = std::min<uint32_t>(len, 0x10000 - addr);
+    memcpy(&ram[addr], &data[2], len);
+    addr += len;
+  } else {
+    // may write to I/O
+    for (uint32_t i = 0; i < len; i++) {
+      cpu->setMem(addr++, data[2 + i]);
+    }
+  }
+  ram[0xae] = addr & 0xff;
+  ram[0xaf] = addr >> 8;
+  ram[0x90] = 0x40; // EOI
+  // "SEARCHING FOR", "LOADING" (direct mode only), then the end of the
+  // kernal LOAD (clc, end address in x/y)
+  cpu->pushReturnAddr(LOADEND);
+  cpu->pushReturnAddr(PRINTLOADING);
+  cpu->setPC(PRINTSEARCHING);
+  return true;
 }
 
 bool Hooks::handlehooks(uint16_t pc) {
   if (pc == IECINHOOK + 1) {
+    if (holdForIO(pc, true)) {
+      return true;
+    }
     uint8_t a = cpu->floppy.iecin();
     // PlatformManager::getInstance().log(LOG_INFO, TAG, "iecin hook: %x", a);
     cpu->setA(a);
@@ -49,9 +152,13 @@ bool Hooks::handlehooks(uint16_t pc) {
     cpu->setPC(0xee82);
     return true;
   } else if (pc == IECOUTHOOK + 1) {
+    if (holdForIO(pc, false)) {
+      return true;
+    }
     uint8_t a = ram[0x95];
     PlatformManager::getInstance().log(LOG_INFO, TAG, "iecout hook: %x", a);
-    cpu->floppy.iecout(a);
+    // ATN (bit 3 of $dd00) distinguishes commands from data bytes
+    cpu->floppy.iecout(a, cpu->cia2.ciareg[0x00] & 0x08);
     ram[0xa5] = 0;
     ram[0x90] = cpu->floppy.lastStatus;
     cpu->setPC(0xee82);
@@ -60,6 +167,13 @@ bool Hooks::handlehooks(uint16_t pc) {
     PlatformManager::getInstance().log(LOG_INFO, TAG, "wait4clk hook");
     cpu->setPC(0xeddb);
     return true;
+  } else if (pc == LOADHOOK + 1) {
+    if (!bulkLoad(pc)) {
+      // sta $93
+      ram[0x93] = cpu->getA();
+      cpu->setPC(LOADHOOK + 2);
+    }
+    return true;
   }
   return false;
 }
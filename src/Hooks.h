@@ -26,9 +26,13 @@ private:
   uint8_t *ram;
   C64Sys *cpu;
 
+  bool bulkLoad(uint16_t pc);
+  bool holdForIO(uint16_t pc, bool read);
+
 public:
   void init(uint8_t *ram, C64Sys *cpu);
   void patchKernal(uint8_t *kernal_rom);
+  bool isHook(uint16_t pc);
   bool handlehooks(uint16_t pc);
 };
 
@@ -0,0 +1,115 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "IECBus.h"
+#include "platform/PlatformManager.h"
+#include <chrono>
+#include <thread>
+
+static const char *TAG = "IECBus";
+
+void IECBus::drainDriveEvents(uint64_t cycle) {
+  Event *event;
+  while (((event = driveevents.front()) != nullptr) &&
+         (event->cycle <= cycle)) {
+    drivelinesc64 = event->lines;
+    driveevents.release();
+  }
+}
+
+void IECBus::c64Write(uint64_t cycle, uint8_t lines) {
+  if (lines == c64lines) {
+    return;
+  }
+  c64lines = lines;
+  while (!c64events.push({cycle, lines})) {
+    // let the drive consume the pending events
+    horizon.store(cycle, std::memory_order_release);
+    drainDriveEvents(cycle);
+    std::this_thread::yield();
+  }
+}
+
+uint8_t IECBus::c64Read(uint64_t cycle) {
+  horizon.store(cycle, std::memory_order_release);
+  uint16_t spins = 0;
+  uint16_t timeouts = 0;
+  while (drivecycle.load() < cycle) {
+    drainDriveEvents(cycle);
+    if (drivestalled) {
+      // the drive did not respond to a previous read: last state of the bus
+      break;
+    }
+    if (spins < MAXSPINS) {
+      spins++;
+      continue;
+    }
+    if (timeouts >= MAXTIMEOUTS) {
+      PlatformManager::getInstance().log(
+          LOG_ERROR, TAG, "drive does not respond, last bus state is used");
+      drivestalled = true;
+      break;
+    }
+    // the drive notifies when it reaches waitcycle, the timeout guards
+    // against a drive thread which stalled or is not running
+    std::unique_lock<std::mutex> lock(waitmutex);
+    waitcycle.store(cycle);
+    if (!waitcond.wait_for(lock, std::chrono::milliseconds(1), [this, cycle] {
+          return drivecycle.load() >= cycle;
+        })) {
+      timeouts++;
+    }
+    waitcycle.store(UINT64_MAX);
+  }
+  if (drivecycle.load() >= cycle) {
+    drivestalled = false;
+  }
+  drainDriveEvents(cycle);
+  uint8_t lines = getLines(c64lines, drivelinesc64);
+  return ((lines & CLK) ? 0 : 0x40) | ((lines & DATA) ? 0 : 0x80);
+}
+
+void IECBus::c64Sync(uint64_t cycle) {
+  horizon.store(cycle, std::memory_order_release);
+  drainDriveEvents(cycle);
+}
+
+bool IECBus::nextC64Event(uint64_t cycle) {
+  Event *event = c64events.front();
+  if ((event == nullptr) || (event->cycle > cycle)) {
+    return false;
+  }
+  c64linesdrive = event->lines;
+  c64events.release();
+  return true;
+}
+
+uint64_t IECBus::nextC64EventCycle() {
+  Event *event = c64events.front();
+  return (event == nullptr) ? UINT64_MAX : event->cycle;
+}
+
+bool IECBus::driveWrite(uint64_t cycle, uint8_t lines) {
+  if (lines == drivelines) {
+    return false;
+  }
+  drivelines = lines;
+  while (!driveevents.push({cycle, lines})) {
+    // the C64 consumes events each rasterline
+    std::this_thread::yield();
+  }
+  return true;
+}
@@ -0,0 +1,113 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef IECBUS_H
+#define IECBUS_H
+
+#include "SPSCRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// serial bus between the C64 (CPU thread) and the emulated 1541 (drive
+// thread, see class Floppy)
+// - both sides send the lines they pull low as events stamped with the C64
+//   cycle, the other side applies an event when its clock reaches the stamp
+// - the C64 publishes the cycle up to which all its events are sent
+//   (horizon), the drive runs up to this cycle
+// - a C64 read of the bus waits until the drive has reached the cycle of the
+//   read, so both sides see the same sequence as on real hardware; after a
+//   short spin the C64 blocks until the drive signals the cycle (a yield only
+//   reaches tasks of the same priority on the ESP32)
+class IECBus {
+private:
+  struct Event {
+    uint64_t cycle;
+    uint8_t lines;
+  };
+  static const uint32_t RINGSIZE = 256;
+  static const uint16_t MAXSPINS = 100;
+  // a read gives up after MAXTIMEOUTS ms without progress of the drive
+  static const uint16_t MAXTIMEOUTS = 100;
+
+  SPSCRing<Event, RINGSIZE> c64events;
+  SPSCRing<Event, RINGSIZE> driveevents;
+  std::atomic<uint64_t> horizon{0};
+  std::atomic<uint64_t> drivecycle{0};
+  // cycle the blocked C64 waits for, UINT64_MAX if it does not wait
+  std::atomic<uint64_t> waitcycle{UINT64_MAX};
+  std::mutex waitmutex;
+  std::condition_variable waitcond;
+
+  // C64 side
+  uint8_t c64lines = 0;
+  uint8_t drivelinesc64 = 0;
+  // reads do not wait until the drive reaches the cycle of a read again
+  bool drivestalled = false;
+  // drive side
+  uint8_t c64linesdrive = 0;
+  uint8_t drivelines = 0;
+
+  void drainDriveEvents(uint64_t cycle);
+
+public:
+  // lines pulled low by the C64 ($dd00 bit 3 - 5 >> 3)
+  static const uint8_t ATN = 0x01;
+  static const uint8_t CLK = 0x02;
+  static const uint8_t DATA = 0x04;
+  // drive only: ATN acknowledge, pulls DATA low if it differs from ATN
+  static const uint8_t ATNA = 0x08;
+
+  // lines being low resulting from the lines pulled by both sides
+  static uint8_t getLines(uint8_t c64, uint8_t drive) {
+    uint8_t lines = c64 | (drive & (CLK | DATA));
+    if (((c64 & ATN) != 0) != ((drive & ATNA) != 0)) {
+      lines |= DATA;
+    }
+    return lines;
+  }
+
+  // --- C64 side ---
+  void c64Write(uint64_t cycle, uint8_t lines);
+  // state of the lines at the given cycle: $dd00 bit 6 (CLK) and bit 7
+  // (DATA), 1 = line high
+  uint8_t c64Read(uint64_t cycle);
+  // all events up to the given cycle are sent
+  void c64Sync(uint64_t cycle);
+
+  // --- drive side ---
+  uint64_t getHorizon() const {
+    return horizon.load(std::memory_order_acquire);
+  }
+  void setDriveCycle(uint64_t cycle) {
+    drivecycle.store(cycle);
+    if (cycle >= waitcycle.load()) {
+      std::lock_guard<std::mutex> lock(waitmutex);
+      waitcond.notify_one();
+    }
+  }
+  // applies the next C64 event up to the given cycle, false if there is none
+  bool nextC64Event(uint64_t cycle);
+  // stamp of the next C64 event, UINT64_MAX if none is available
+  uint64_t nextC64EventCycle();
+  // false if the lines did not change
+  bool driveWrite(uint64_t cycle, uint8_t lines);
+  uint8_t getC64Lines() const { return c64linesdrive; }
+  uint8_t getDriveLines() const { return getLines(c64linesdrive, drivelines); }
+};
+
+#endif // IECBUS_H
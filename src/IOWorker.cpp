@@ -0,0 +1,191 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "IOWorker.h"
+#include "Floppy.h"
+#include "fs/FileFactory.h"
+#include "platform/PlatformManager.h"
+#include <functional>
+#include <thread>
+
+static const char *TAG = "IOWorker";
+
+void IOWorker::start() {
+  if (started) {
+    return;
+  }
+  started = true;
+  file = FileSys::create();
+  PlatformManager::getInstance().startTask(
+      std::bind(&IOWorker::run, this), 0, 1);
+}
+
+void IOWorker::submit(Job &job) {
+  job.done.store(false, std::memory_order_release);
+  numofjobs.fetch_add(1, std::memory_order_acq_rel);
+  if (!started) {
+    // no worker yet: execute the job directly
+    std::unique_ptr<FileDriver> ownfile = FileSys::create();
+    execute(job, *ownfile);
+    return;
+  }
+  if (requests.push(&job)) {
+    return;
+  }
+  // queue full: wait for a free slot (jobs are executed in order)
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  while (!requests.push(&job)) {
+    std::this_thread::yield();
+  }
+  addStall(platform.getTimeUS() - start);
+}
+
+void IOWorker::wait(Job &job) {
+  if (job.isDone()) {
+    return;
+  }
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  while (!job.isDone()) {
+    std::this_thread::yield();
+  }
+  addStall(platform.getTimeUS() - start);
+}
+
+void IOWorker::addStall(uint32_t us) {
+  numofstalls.fetch_add(1, std::memory_order_acq_rel);
+  stallus.fetch_add(us, std::memory_order_acq_rel);
+  uint32_t max = maxstallus.load(std::memory_order_acquire);
+  while ((us > max) && !maxstallus.compare_exchange_weak(max, us)) {
+  }
+}
+
+void IOWorker::logPerfValues() {
+  uint32_t jobs = numofjobs.exchange(0, std::memory_order_acq_rel);
+  uint32_t stalls = numofstalls.exchange(0, std::memory_order_acq_rel);
+  uint32_t us = stallus.exchange(0, std::memory_order_acq_rel);
+  uint32_t maxus = maxstallus.exchange(0, std::memory_order_acq_rel);
+  if (jobs == 0) {
+    return;
+  }
+  PlatformManager::getInstance().log(
+      LOG_INFO, TAG, "io jobs: %lu, stalls: %lu, stall time: %lu us (max %lu)",
+      (unsigned long)jobs, (unsigned long)stalls, (unsigned long)us,
+      (unsigned long)maxus);
+}
+
+void IOWorker::readChain(Job &job, FileDriver &file) {
+  // follows the track/sector links of a file in a d64 image
+  job.ok = false;
+  if (!file.open(job.path, "rb")) {
+    return;
+  }
+  uint8_t t = job.track;
+  uint8_t s = job.sector;
+  uint8_t buf[256];
+  // a file has at most 768 blocks (protection against loops)
+  for (uint16_t blk = 0; (t != 0) && (blk < 768); blk++) {
+    int64_t offset = Floppy::calcOffset(t, s);
+    if ((offset < 0) || !file.seek(offset, SEEK_SET) ||
+        (file.read(buf, 256) != 256)) {
+      break;
+    }
+    job.data.insert(job.data.end(), buf, buf + 256);
+    t = buf[0];
+    s = buf[1];
+    job.ok = (t == 0);
+  }
+  file.close();
+}
+
+bool IOWorker::writeFile(Job &job, FileDriver &file,
+                         const std::string &path) {
+  const uint8_t *src = job.src ? job.src : job.data.data();
+  size_t len = job.src ? job.srclen : job.data.size();
+  bool ok = file.open(path, "wb") && (file.write(src, len) == len);
+  file.close();
+  return ok;
+}
+
+void IOWorker::execute(Job &job, FileDriver &file) {
+  switch (job.op) {
+  case Op::READFILE: {
+    job.ok = false;
+    job.data.clear();
+    if (file.open(job.path, "rb")) {
+      int64_t size = file.size();
+      if (size >= 0) {
+        job.data.resize(size);
+        job.ok = (file.read(job.data.data(), size) == (size_t)size);
+      }
+      file.close();
+    }
+    break;
+  }
+  case Op::WRITEFILE:
+    job.ok = writeFile(job, file, job.path);
+    break;
+  case Op::REPLACEFILE: {
+    std::string tmppath = job.path + ".tmp";
+    job.ok = writeFile(job, file, tmppath);
+    if (job.ok && !file.rename(tmppath, job.path)) {
+      // filesystem without replacing rename (the temporary file is used by
+      // Floppy::attach if the power is lost in between)
+      file.remove(job.path);
+      job.ok = file.rename(tmppath, job.path);
+    }
+    break;
+  }
+  case Op::READCHAIN:
+    job.data.clear();
+    readChain(job, file);
+    break;
+  case Op::LISTDIR: {
+    job.names.clear();
+    job.end = false;
+    job.ok = true;
+    bool start = job.start;
+    while (job.names.size() < job.maxentries) {
+      std::string name;
+      if (!file.listnextentry(name, start)) {
+        job.ok = false;
+        break;
+      }
+      start = false;
+      if (name.empty()) {
+        job.end = true;
+        break;
+      }
+      job.names.push_back(name);
+    }
+    break;
+  }
+  }
+  job.done.store(true, std::memory_order_release);
+}
+
+void IOWorker::run() {
+  Platform &platform = PlatformManager::getInstance();
+  while (true) {
+    Job *job;
+    if (requests.pop(job)) {
+      execute(*job, *file);
+    } else {
+      platform.waitMS(1);
+    }
+  }
+}
@@ -0,0 +1,108 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef IOWORKER_H
+#define IOWORKER_H
+
+#include "SPSCRing.h"
+#include "fs/FileDriver.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// file operations of the emulation thread executed by a separate task, so a
+// stalling SD card does not stop video and audio
+// - jobs are submitted via a request queue (only by the emulation thread),
+//   a job is completed when its done flag is set
+// - the submitter owns the job and must keep it until it is completed
+// - the emulation thread does not wait for the jobs of the KERNAL hooks (the
+//   C64 CPU is held at the hook, see Hooks::holdForIO) and of the LOAD, SAVE
+//   and LIST commands (completed in a later frame, see ExternalCmds)
+// - the emulation thread still waits for jobs during movies, when a job is
+//   cancelled (reset, state load, rewind, attach) and for the autorun
+//   program (Floppy::load); save states, movies, the instant boot snapshot,
+//   the program cache and single sectors of a d64 image not kept in memory
+//   (e.g. the directory) are read and written directly
+// - there is at most one job of each kind in flight (prefetch, bulk load,
+//   write and flush of the floppy, command of ExternalCmds), so the queue is
+//   not full in normal operation
+// - the time the emulation thread waits for a job (or for a free slot if the
+//   queue is full) is counted as stall (see logPerfValues)
+class IOWorker {
+public:
+  enum class Op : uint8_t {
+    READFILE,
+    WRITEFILE,
+    // writes a temporary file which then replaces the file (a power-off
+    // leaves the old or the new file)
+    REPLACEFILE,
+    READCHAIN,
+    LISTDIR
+  };
+
+  struct Job {
+    Op op;
+    std::string path;
+    // READFILE: content of the file, WRITEFILE: content to write,
+    // READCHAIN: blocks (256 bytes each) of the chain
+    std::vector<uint8_t> data;
+    // WRITEFILE, REPLACEFILE: content to write instead of data (not copied,
+    // must not change until the job is completed)
+    const uint8_t *src = nullptr;
+    uint32_t srclen = 0;
+    // READCHAIN: first block of the chain, the d64 image is given by path
+    uint8_t track = 0;
+    uint8_t sector = 0;
+    // LISTDIR: (re)start the listing, at most maxentries names are listed,
+    // end: no more names left
+    bool start = false;
+    uint8_t maxentries = 0;
+    std::vector<std::string> names;
+    bool end = false;
+    bool ok = false;
+    std::atomic<bool> done{false};
+
+    Job(Op op, const std::string &path) : op(op), path(path) {}
+    bool isDone() const { return done.load(std::memory_order_acquire); }
+  };
+
+  void start();
+  void submit(Job &job);
+  // waits until the job is completed (counted as stall)
+  void wait(Job &job);
+  void logPerfValues();
+
+private:
+  static const uint32_t QUEUESIZE = 8;
+
+  SPSCRing<Job *, QUEUESIZE> requests;
+  std::unique_ptr<FileDriver> file;
+  bool started = false;
+  std::atomic<uint32_t> numofjobs{0};
+  std::atomic<uint32_t> numofstalls{0};
+  std::atomic<uint32_t> stallus{0};
+  std::atomic<uint32_t> maxstallus{0};
+
+  void execute(Job &job, FileDriver &file);
+  void readChain(Job &job, FileDriver &file);
+  bool writeFile(Job &job, FileDriver &file, const std::string &path);
+  void addStall(uint32_t us);
+  void run();
+};
+
+#endif // IOWORKER_H
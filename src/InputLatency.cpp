@@ -0,0 +1,145 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "InputLatency.h"
+#include "platform/PlatformManager.h"
+#include <cstdio>
+
+static const char *TAG = "InputLatency";
+
+InputLatency::InputLatency()
+    : state(State::IDLE), numofframes(0), inputtime(0), readtime(0),
+      framehash(0), frametime(0), frameinputtime(0) {
+  reset();
+}
+
+void InputLatency::reset() {
+  for (uint8_t stage = 0; stage < NUMOFSTAGES; stage++) {
+    for (uint8_t i = 0; i < NUMOFBUCKETS; i++) {
+      histogram[stage][i].store(0, std::memory_order_relaxed);
+    }
+  }
+  numoftimeouts.store(0, std::memory_order_relaxed);
+}
+
+void InputLatency::record(uint8_t stage, int64_t us) {
+  int64_t bucket = (us > 0) ? us / BUCKETUS : 0;
+  if (bucket >= NUMOFBUCKETS) {
+    bucket = NUMOFBUCKETS - 1;
+  }
+  histogram[stage][bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t InputLatency::hashFrame(const uint16_t *bitmap) {
+  // FNV-1a over the pixels
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < 320 * 200; i++) {
+    hash = (hash ^ bitmap[i]) * 16777619u;
+  }
+  return hash;
+}
+
+void InputLatency::inputChanged(int64_t eventtime, const uint16_t *bitmap) {
+  if (state != State::IDLE) {
+    return;
+  }
+  inputtime = eventtime;
+  framehash = hashFrame(bitmap);
+  numofframes = 0;
+  state = State::LATCHED;
+}
+
+void InputLatency::inputRead() {
+  readtime = PlatformManager::getInstance().getTimeUS();
+  record(INPUTTOREAD, readtime - inputtime);
+  state = State::READ;
+}
+
+void InputLatency::frameEnd(const uint16_t *bitmap) {
+  if (state == State::IDLE) {
+    return;
+  }
+  uint32_t hash = hashFrame(bitmap);
+  if ((state == State::READ) && (hash != framehash)) {
+    int64_t now = PlatformManager::getInstance().getTimeUS();
+    record(READTOFRAME, now - readtime);
+    // hand over to the display side if the previous frame was displayed
+    if (frametime.load(std::memory_order_acquire) == 0) {
+      frameinputtime = inputtime;
+      frametime.store(now, std::memory_order_release);
+    }
+    state = State::IDLE;
+    return;
+  }
+  // frame before the read resp. unchanged frame after the read
+  framehash = hash;
+  if (++numofframes >= MAXFRAMES) {
+    numoftimeouts.fetch_add(1, std::memory_order_relaxed);
+    state = State::IDLE;
+  }
+}
+
+void InputLatency::frameDisplayed(int64_t drawstart) {
+  int64_t frame = frametime.load(std::memory_order_acquire);
+  if ((frame == 0) || (drawstart < frame)) {
+    return;
+  }
+  int64_t now = PlatformManager::getInstance().getTimeUS();
+  record(FRAMETODISPLAY, now - frame);
+  record(TOTAL, now - frameinputtime);
+  frametime.store(0, std::memory_order_release);
+}
+
+uint16_t InputLatency::getHistogram(uint8_t stage, uint8_t *buckets) {
+  uint32_t numofsamples = 0;
+  for (uint8_t i = 0; i < NUMOFBUCKETS; i++) {
+    uint32_t cnt = histogram[stage][i].load(std::memory_order_relaxed);
+    numofsamples += cnt;
+    buckets[i] = (cnt > 255) ? 255 : cnt;
+  }
+  return (numofsamples > 65535) ? 65535 : numofsamples;
+}
+
+void InputLatency::logHistograms() {
+  static const char *stagenames[NUMOFSTAGES] = {
+      "input -> read", "read -> frame", "frame -> display", "total"};
+  Platform &platform = PlatformManager::getInstance();
+  for (uint8_t stage = 0; stage < NUMOFSTAGES; stage++) {
+    // histogram as "count per bucket" list, median from the buckets
+    char line[NUMOFBUCKETS * 11 + 1];
+    uint32_t counts[NUMOFBUCKETS];
+    uint32_t numofsamples = 0;
+    uint16_t pos = 0;
+    for (uint8_t i = 0; i < NUMOFBUCKETS; i++) {
+      counts[i] = histogram[stage][i].load(std::memory_order_relaxed);
+      numofsamples += counts[i];
+      pos += snprintf(&line[pos], sizeof(line) - pos, " %lu",
+                      (unsigned long)counts[i]);
+    }
+    uint32_t sum = 0;
+    uint8_t median = 0;
+    while ((median < NUMOFBUCKETS - 1) && (2 * (sum + counts[median]) <
+                                           numofsamples)) {
+      sum += counts[median++];
+    }
+    platform.log(LOG_INFO, TAG,
+                 "%s: %lu samples, median < %d ms, buckets (%d ms):%s",
+                 stagenames[stage], (unsigned long)numofsamples,
+                 (median + 1) * BUCKETUS / 1000, BUCKETUS / 1000, line);
+  }
+  platform.log(LOG_INFO, TAG, "%lu input changes without visible reaction",
+               (unsigned long)numoftimeouts.load(std::memory_order_relaxed));
+}
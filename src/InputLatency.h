@@ -0,0 +1,78 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef INPUTLATENCY_H
+#define INPUTLATENCY_H
+
+#include <atomic>
+#include <cstdint>
+
+// Measures the latency from a key or joystick event to a changed pixel on
+// the screen. One input change is tracked at a time through the stages
+// - input event (driver timestamp) -> C64 reads the changed matrix value
+// - C64 read -> end of the first frame whose content changed
+// - end of this frame -> display->drawBitmap completed
+// The latencies are collected in histograms (4 ms buckets).
+class InputLatency {
+public:
+  static const uint8_t INPUTTOREAD = 0;
+  static const uint8_t READTOFRAME = 1;
+  static const uint8_t FRAMETODISPLAY = 2;
+  static const uint8_t TOTAL = 3;
+  static const uint8_t NUMOFSTAGES = 4;
+  static const uint8_t NUMOFBUCKETS = 16;
+  static const uint16_t BUCKETUS = 4000;
+
+private:
+  enum class State : uint8_t { IDLE, LATCHED, READ };
+  // give up if the C64 does not react within 50 frames
+  static const uint8_t MAXFRAMES = 50;
+
+  // CPU thread
+  State state;
+  uint8_t numofframes;
+  int64_t inputtime;
+  int64_t readtime;
+  uint32_t framehash;
+
+  // handed over to the display side (0: no frame to track)
+  std::atomic<int64_t> frametime;
+  int64_t frameinputtime;
+
+  std::atomic<uint32_t> histogram[NUMOFSTAGES][NUMOFBUCKETS];
+  std::atomic<uint32_t> numoftimeouts;
+
+  void record(uint8_t stage, int64_t us);
+  uint32_t hashFrame(const uint16_t *bitmap);
+
+public:
+  InputLatency();
+
+  // CPU thread
+  void inputChanged(int64_t eventtime, const uint16_t *bitmap);
+  inline bool isWaitingForRead() const { return state == State::LATCHED; }
+  void inputRead();
+  void frameEnd(const uint16_t *bitmap);
+
+  // display side
+  void frameDisplayed(int64_t drawstart);
+
+  void reset();
+  uint16_t getHistogram(uint8_t stage, uint8_t *buckets);
+  void logHistograms();
+};
+
+#endif // INPUTLATENCY_H
@@ -0,0 +1,166 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "InstantBoot.h"
+#include "Config.h"
+#include "Floppy.h"
+#include "platform/PlatformManager.h"
+#include <cstring>
+
+static const char *TAG = "InstantBoot";
+
+static const char MAGIC[4] = {'C', '6', '4', 'B'};
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+InstantBoot::InstantBoot()
+    : enabled(false), available(false), key(0), coldstart(false),
+      coldstartframes(0), starttime(0), snapshot(nullptr) {}
+
+void InstantBoot::init(bool enabled, uint32_t key) {
+  this->enabled = enabled;
+  if (!enabled) {
+    return;
+  }
+  if (snapshot == nullptr) {
+    snapshot = new Snapshot();
+  }
+  // the state at READY depends on the ROMs and the configuration (the save
+  // state format itself is checked by SaveState)
+  this->key = key;
+}
+
+uint32_t InstantBoot::getMachineKey(const uint8_t *kernalrom,
+                                    const uint8_t *basicrom,
+                                    const uint8_t *charrom, bool truedrive,
+                                    bool sidfixedpoint) {
+  uint32_t key = fnv1a(2166136261u, kernalrom, 0x2000);
+  key = fnv1a(key, basicrom, 0x2000);
+  key = fnv1a(key, charrom, 0x1000);
+  // true drive: unpatched kernal, but the drive state is part of the state
+  const uint8_t config[2] = {(uint8_t)truedrive, (uint8_t)sidfixedpoint};
+  return fnv1a(key, config, sizeof(config));
+}
+
+bool InstantBoot::isWaitingForKey(uint16_t pc, const uint8_t *ram) {
+  return (pc >= WAITKEYSTART) && (pc <= WAITKEYEND) && (ram[0xc6] == 0);
+}
+
+bool InstantBoot::read(std::vector<uint8_t> &savestate) {
+  if (!enabled || !Floppy::fsinitialized) {
+    return false;
+  }
+  std::string path = std::string(Config::PATH) + FILENAME;
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "rb")) {
+    return false;
+  }
+  int64_t size = file.size();
+  std::vector<uint8_t> in(size > HEADERSIZE ? size : 0);
+  bool success =
+      (size > HEADERSIZE) && (file.read(in.data(), size) == (size_t)size);
+  file.close();
+  if (!success || (memcmp(in.data(), MAGIC, 4) != 0)) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "corrupt file %s",
+                                       path.c_str());
+    return false;
+  }
+  if (get32(&in[4]) != key) {
+    PlatformManager::getInstance().log(
+        LOG_INFO, TAG, "%s was taken with different ROMs or configuration", path.c_str());
+    return false;
+  }
+  savestate.assign(in.begin() + HEADERSIZE, in.end());
+  return true;
+}
+
+void InstantBoot::store(const std::vector<uint8_t> &savestate) {
+  Platform &platform = PlatformManager::getInstance();
+  available = true;
+  platform.log(LOG_INFO, TAG, "cold start: READY after %lu frames (%lu ms)",
+               (unsigned long)coldstartframes,
+               (unsigned long)((platform.getTimeUS() - starttime) / 1000));
+  if (!Floppy::fsinitialized) {
+    return;
+  }
+  std::string path = std::string(Config::PATH) + FILENAME;
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "wb")) {
+    platform.log(LOG_ERROR, TAG, "cannot open file %s", path.c_str());
+    return;
+  }
+  uint8_t header[HEADERSIZE];
+  memcpy(header, MAGIC, 4);
+  for (uint8_t i = 0; i < 4; i++) {
+    header[4 + i] = (key >> (i * 8)) & 0xff;
+  }
+  bool success = (file.write(header, HEADERSIZE) == HEADERSIZE) &&
+                 (file.write(savestate.data(), savestate.size()) ==
+                  savestate.size());
+  file.close();
+  if (!success) {
+    platform.log(LOG_ERROR, TAG, "could not write file %s", path.c_str());
+  }
+}
+
+void InstantBoot::loaded(int64_t us) {
+  available = true;
+  PlatformManager::getInstance().log(
+      LOG_INFO, TAG, "READY state loaded from %s%s in %lu us", Config::PATH,
+      FILENAME, (unsigned long)us);
+}
+
+void InstantBoot::restored(int64_t us) {
+  PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                     "READY state restored in %lu us",
+                                     (unsigned long)us);
+}
+
+void InstantBoot::startColdStart() {
+  if (!enabled || available) {
+    return;
+  }
+  coldstart = true;
+  coldstartframes = 0;
+  starttime = PlatformManager::getInstance().getTimeUS();
+}
+
+void InstantBoot::cancelColdStart() { coldstart = false; }
+
+bool InstantBoot::isReady(uint16_t pc, const uint8_t *ram) {
+  if (!coldstart) {
+    return false;
+  }
+  if (++coldstartframes > MAXCOLDSTARTFRAMES) {
+    coldstart = false;
+    return false;
+  }
+  // cursor in the line after READY (nothing typed yet)
+  if (!isWaitingForKey(pc, ram) || (ram[0xd6] != 6) || (ram[0xd3] != 0)) {
+    return false;
+  }
+  coldstart = false;
+  return true;
+}
@@ -0,0 +1,83 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef INSTANTBOOT_H
+#define INSTANTBOOT_H
+
+#include "Snapshot.h"
+#include <cstdint>
+#include <vector>
+
+// Instant boot: the machine state at the READY prompt of a cold start
+// (kernal reset incl. RAM test, about 2.5 s emulated time) is kept in memory
+// and stored to a file in the configured directory. A reset resp. the next
+// start of the emulator restores this state instead of running the cold
+// start again. The file is only used if it was taken with the same ROMs
+// (kernal incl. patches, basic, charset), the same machine configuration
+// (drive emulation, SID engine) and the same save state format, otherwise the emulator falls back to a cold start and takes a new state
+// (see C64Sys::reset, C64Sys::checkColdStart).
+// Format of the file: magic "C64B", key (uint32, little endian, see init),
+// save state (see class SaveState).
+class InstantBoot {
+private:
+  static constexpr const char *FILENAME = "ready.c64b";
+  static const uint8_t HEADERSIZE = 8;
+  // kernal loop waiting for a key (screen editor input)
+  static const uint16_t WAITKEYSTART = 0xe5cd;
+  static const uint16_t WAITKEYEND = 0xe5d4;
+  // frames a cold start may take to reach READY (10 s)
+  static const uint16_t MAXCOLDSTARTFRAMES = 500;
+
+  bool enabled;
+  bool available;
+  uint32_t key;
+  bool coldstart;
+  uint16_t coldstartframes;
+  int64_t starttime;
+
+public:
+  // state at the READY prompt (valid if isAvailable)
+  Snapshot *snapshot;
+
+  InstantBoot();
+  // key: see getMachineKey
+  void init(bool enabled, uint32_t key);
+  bool isEnabled() const { return enabled; }
+  // key of the ROMs (kernal incl. patches, basic, charset) and of the
+  // configuration a state depends on (true drive resp. kernal hooks, fixed
+  // point resp. floating point SID)
+  static uint32_t getMachineKey(const uint8_t *kernalrom,
+                                const uint8_t *basicrom, const uint8_t *charrom,
+                                bool truedrive, bool sidfixedpoint);
+  // kernal waits for a key with an empty keyboard buffer (READY prompt)
+  static bool isWaitingForKey(uint16_t pc, const uint8_t *ram);
+  bool isAvailable() const { return available; }
+  // file: save state without header, false if missing or taken with
+  // different ROMs or configuration
+  bool read(std::vector<uint8_t> &savestate);
+  // snapshot was taken at READY: keep it and write it to the file
+  void store(const std::vector<uint8_t> &savestate);
+  // snapshot was taken after loading the file
+  void loaded(int64_t us);
+  void restored(int64_t us);
+  void startColdStart();
+  // e.g. external commands during the cold start
+  void cancelColdStart();
+  // checked once per frame during a cold start: READY prompt reached?
+  bool isReady(uint16_t pc, const uint8_t *ram);
+};
+
+#endif // INSTANTBOOT_H
@@ -0,0 +1,143 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "LZ.h"
+#include <cstring>
+
+static inline uint32_t read32(const uint8_t *p) {
+  uint32_t val;
+  memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+static inline void writeLength(std::vector<uint8_t> &dst, size_t len) {
+  while (len >= 255) {
+    dst.push_back(255);
+    len -= 255;
+  }
+  dst.push_back(len);
+}
+
+static void writeSequence(std::vector<uint8_t> &dst, const uint8_t *literals,
+                          size_t numofliterals, size_t matchlen,
+                          uint16_t offset, bool lastsequence) {
+  uint8_t token = (numofliterals >= 15 ? 15 : numofliterals) << 4;
+  if (!lastsequence) {
+    token |= (matchlen >= 15) ? 15 : matchlen;
+  }
+  dst.push_back(token);
+  if (numofliterals >= 15) {
+    writeLength(dst, numofliterals - 15);
+  }
+  dst.insert(dst.end(), literals, literals + numofliterals);
+  if (lastsequence) {
+    return;
+  }
+  dst.push_back(offset & 0xff);
+  dst.push_back(offset >> 8);
+  if (matchlen >= 15) {
+    writeLength(dst, matchlen - 15);
+  }
+}
+
+void LZ::compress(const uint8_t *src, size_t len, std::vector<uint8_t> &dst) {
+  // position + 1 of the last occurrence of a 4 byte sequence (0: none)
+  std::vector<uint32_t> hashtable(1 << HASHBITS, 0);
+  dst.clear();
+  dst.reserve(len / 2);
+  size_t pos = 0;
+  size_t literalstart = 0;
+  while (pos + MINMATCH <= len) {
+    uint32_t seq = read32(src + pos);
+    uint32_t hash = (seq * 2654435761u) >> (32 - HASHBITS);
+    uint32_t candidate = hashtable[hash];
+    hashtable[hash] = pos + 1;
+    if ((candidate == 0) || (pos - (candidate - 1) > MAXOFFSET) ||
+        (read32(src + candidate - 1) != seq)) {
+      pos++;
+      continue;
+    }
+    size_t matchpos = candidate - 1;
+    size_t matchlen = MINMATCH;
+    while ((pos + matchlen < len) &&
+           (src[matchpos + matchlen] == src[pos + matchlen])) {
+      matchlen++;
+    }
+    writeSequence(dst, src + literalstart, pos - literalstart,
+                  matchlen - MINMATCH, pos - matchpos, false);
+    pos += matchlen;
+    literalstart = pos;
+  }
+  writeSequence(dst, src + literalstart, len - literalstart, 0, 0, true);
+}
+
+bool LZ::decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                    size_t dstlen) {
+  const uint8_t *srcend = src + len;
+  size_t pos = 0;
+  while (src < srcend) {
+    uint8_t token = *src++;
+    size_t numofliterals = token >> 4;
+    if (numofliterals == 15) {
+      uint8_t b;
+      do {
+        if (src >= srcend) {
+          return false;
+        }
+        b = *src++;
+        numofliterals += b;
+      } while (b == 255);
+    }
+    if ((numofliterals > (size_t)(srcend - src)) ||
+        (numofliterals > dstlen - pos)) {
+      return false;
+    }
+    memcpy(dst + pos, src, numofliterals);
+    src += numofliterals;
+    pos += numofliterals;
+    if (src == srcend) {
+      // last sequence
+      break;
+    }
+    if (srcend - src < 2) {
+      return false;
+    }
+    size_t offset = src[0] | (src[1] << 8);
+    src += 2;
+    size_t matchlen = token & 0x0f;
+    if (matchlen == 15) {
+      uint8_t b;
+      do {
+        if (src >= srcend) {
+          return false;
+        }
+        b = *src++;
+        matchlen += b;
+      } while (b == 255);
+    }
+    matchlen += MINMATCH;
+    if ((offset == 0) || (offset > pos) || (matchlen > dstlen - pos)) {
+      return false;
+    }
+    // byte by byte: the match may overlap the output
+    const uint8_t *match = dst + pos - offset;
+    for (size_t i = 0; i < matchlen; i++) {
+      dst[pos + i] = match[i];
+    }
+    pos += matchlen;
+  }
+  return pos == dstlen;
+}
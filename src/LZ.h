@@ -0,0 +1,42 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Simple and fast LZ77 compression (LZ4 like block format): a sequence
+// consists of a token (upper nibble: number of literals, lower nibble: match
+// length - MINMATCH, 15: length continues in the following bytes), the
+// literals and the 16 bit offset of the match (little endian). The last
+// sequence has no match.
+class LZ {
+private:
+  static const uint8_t MINMATCH = 4;
+  static const uint8_t HASHBITS = 12;
+  static const uint16_t MAXOFFSET = 0xffff;
+
+public:
+  static void compress(const uint8_t *src, size_t len,
+                       std::vector<uint8_t> &dst);
+  static bool decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                         size_t dstlen);
+};
+
+#endif // LZ_H
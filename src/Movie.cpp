@@ -0,0 +1,335 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "Movie.h"
+#include "Config.h"
+#include "Floppy.h"
+#include "platform/PlatformManager.h"
+#include <cstring>
+
+static const char *TAG = "Movie";
+
+static const char MAGIC[4] = {'C', '6', '4', 'M'};
+
+static void put16(std::vector<uint8_t> &out, uint16_t val) {
+  out.push_back(val & 0xff);
+  out.push_back(val >> 8);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t val) {
+  for (uint8_t i = 0; i < 4; i++) {
+    out.push_back((val >> (i * 8)) & 0xff);
+  }
+}
+
+static uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+Movie::Movie()
+    : mode(Mode::OFF), headless(false), inputsize(0), frame(0), starttime(0),
+      numofcmds(0), checksum(0), pos(0), cmdpos(0), cmdsleft(0),
+      mismatches(0), firstmismatch(0), failed(false), finished(false),
+      replayok(false), replayedframes(0) {}
+
+uint32_t Movie::getChecksum(const uint16_t *bitmap) {
+  // FNV-1a (32 bit) over pairs of pixels (first pixel in the low word)
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < 320 * 200; i += 2) {
+    uint32_t pair = bitmap[i] | ((uint32_t)bitmap[i + 1] << 16);
+    hash = (hash ^ pair) * 16777619u;
+  }
+  return hash;
+}
+
+void Movie::startRecording(const std::string &name, uint32_t seed,
+                           uint8_t runahead, const void *input,
+                           uint16_t inputsize,
+                           const std::vector<uint8_t> &savestate) {
+  this->name = name;
+  this->inputsize = inputsize;
+  const uint8_t *inputbytes = static_cast<const uint8_t *>(input);
+  this->input.assign(inputbytes, inputbytes + inputsize);
+  data.clear();
+  data.reserve(HEADERSIZE + inputsize + 4 + savestate.size());
+  data.insert(data.end(), MAGIC, MAGIC + 4);
+  put16(data, VERSION);
+  put16(data, savestate.empty() ? 0 : FLAGSAVESTATE);
+  put32(data, seed);
+  put16(data, inputsize);
+  data.push_back(runahead);
+  data.insert(data.end(), inputbytes, inputbytes + inputsize);
+  if (!savestate.empty()) {
+    put32(data, savestate.size());
+    data.insert(data.end(), savestate.begin(), savestate.end());
+  }
+  // first record: commands before the first frame
+  frameinput.clear();
+  framecmds.clear();
+  numofcmds = 0;
+  checksum = 0;
+  frame = 0;
+  starttime = PlatformManager::getInstance().getTimeUS();
+  mode = Mode::RECORD;
+  PlatformManager::getInstance().log(LOG_INFO, TAG, "recording movie %s",
+                                     name.c_str());
+}
+
+void Movie::recordInput(const void *input) {
+  if (memcmp(input, this->input.data(), inputsize) == 0) {
+    return;
+  }
+  const uint8_t *inputbytes = static_cast<const uint8_t *>(input);
+  this->input.assign(inputbytes, inputbytes + inputsize);
+  frameinput = this->input;
+}
+
+void Movie::recordCommand(const uint8_t *buffer) {
+  if (numofcmds == 255) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "too many commands in frame %lu",
+                                       (unsigned long)frame);
+    return;
+  }
+  // trailing zeros are not stored
+  uint16_t len = ExtCmdQueue::CMDSIZE;
+  while ((len > 1) && (buffer[len - 1] == 0)) {
+    len--;
+  }
+  put16(framecmds, len);
+  framecmds.insert(framecmds.end(), buffer, buffer + len);
+  numofcmds++;
+}
+
+void Movie::commitFrame() {
+  data.push_back((frameinput.empty() ? 0 : FRAMEINPUT) |
+                 (numofcmds == 0 ? 0 : FRAMECMDS));
+  data.insert(data.end(), frameinput.begin(), frameinput.end());
+  if (numofcmds != 0) {
+    data.push_back(numofcmds);
+    data.insert(data.end(), framecmds.begin(), framecmds.end());
+  }
+  put32(data, checksum);
+  frameinput.clear();
+  framecmds.clear();
+  numofcmds = 0;
+}
+
+bool Movie::fail(const char *msg) {
+  PlatformManager::getInstance().log(LOG_ERROR, TAG, "movie %s: %s",
+                                     name.c_str(), msg);
+  failed = true;
+  stop();
+  return false;
+}
+
+bool Movie::startReplay(const std::string &name, bool headless,
+                        uint16_t inputsize) {
+  Platform &platform = PlatformManager::getInstance();
+  this->name = name;
+  this->headless = headless;
+  replayedframes.store(0, std::memory_order_release);
+  replayok.store(false, std::memory_order_release);
+  finished.store(false, std::memory_order_release);
+  failed = false;
+  std::string path = Config::PATH + name + EXTENSION;
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "rb")) {
+    platform.log(LOG_ERROR, TAG, "cannot open file %s", path.c_str());
+    finished.store(true, std::memory_order_release);
+    return false;
+  }
+  int64_t size = file.size();
+  data.resize(size > 0 ? size : 0);
+  bool success = (size > 0) && (file.read(data.data(), size) == (size_t)size);
+  file.close();
+  mode = Mode::REPLAY;
+  if (!success) {
+    return fail("could not read file");
+  }
+  if ((data.size() < HEADERSIZE) || (memcmp(data.data(), MAGIC, 4) != 0)) {
+    return fail("not a movie");
+  }
+  if (get16(&data[4]) != VERSION) {
+    return fail("unsupported version");
+  }
+  if (get16(&data[12]) != inputsize) {
+    return fail("input state of a different build");
+  }
+  this->inputsize = inputsize;
+  pos = HEADERSIZE + inputsize;
+  if (get16(&data[6]) & FLAGSAVESTATE) {
+    if ((pos + 4 > data.size()) || (get32(&data[pos]) > data.size() - pos - 4)) {
+      return fail("truncated save state");
+    }
+    pos += 4 + get32(&data[pos]);
+  }
+  input.assign(data.begin() + HEADERSIZE,
+               data.begin() + HEADERSIZE + inputsize);
+  frameinput.clear();
+  cmdsleft = 0;
+  mismatches = 0;
+  firstmismatch = 0;
+  frame = 0;
+  starttime = platform.getTimeUS();
+  platform.log(LOG_INFO, TAG, "replaying movie %s%s", name.c_str(),
+               headless ? " (headless)" : "");
+  // first record: commands before the first frame
+  return readFrame(nullptr);
+}
+
+uint32_t Movie::getSeed() const { return get32(&data[8]); }
+
+uint8_t Movie::getRunAhead() const { return data[14]; }
+
+void Movie::getStartInput(void *input) const {
+  memcpy(input, this->input.data(), inputsize);
+}
+
+bool Movie::getSaveState(const uint8_t *&state, uint32_t &size) const {
+  if (!(get16(&data[6]) & FLAGSAVESTATE)) {
+    return false;
+  }
+  size = get32(&data[HEADERSIZE + inputsize]);
+  state = &data[HEADERSIZE + inputsize + 4];
+  return true;
+}
+
+bool Movie::nextInput(void *input) {
+  if (frameinput.empty()) {
+    return false;
+  }
+  memcpy(input, frameinput.data(), inputsize);
+  frameinput.clear();
+  return true;
+}
+
+uint8_t *Movie::nextCommand() {
+  if ((mode != Mode::REPLAY) || (cmdsleft == 0)) {
+    return nullptr;
+  }
+  uint16_t len = get16(&data[cmdpos]);
+  memset(cmdbuffer, 0, sizeof(cmdbuffer));
+  memcpy(cmdbuffer, &data[cmdpos + 2], len);
+  cmdpos += 2 + len;
+  cmdsleft--;
+  return cmdbuffer;
+}
+
+bool Movie::readFrame(const uint16_t *bitmap) {
+  if (pos >= data.size()) {
+    return fail("truncated frame");
+  }
+  uint8_t flags = data[pos++];
+  if (flags & FRAMEEND) {
+    stop();
+    return false;
+  }
+  // check the whole frame before it is used
+  size_t end = pos;
+  if (flags & FRAMEINPUT) {
+    end += inputsize;
+  }
+  uint8_t numofcmds = 0;
+  size_t firstcmd = 0;
+  if (flags & FRAMECMDS) {
+    if (end >= data.size()) {
+      return fail("truncated frame");
+    }
+    numofcmds = data[end++];
+    firstcmd = end;
+    for (uint8_t i = 0; i < numofcmds; i++) {
+      if ((end + 2 > data.size()) ||
+          (get16(&data[end]) > ExtCmdQueue::CMDSIZE)) {
+        return fail("truncated frame");
+      }
+      end += 2 + get16(&data[end]);
+    }
+  }
+  if (end + 4 > data.size()) {
+    return fail("truncated frame");
+  }
+  if (flags & FRAMEINPUT) {
+    frameinput.assign(data.begin() + pos, data.begin() + pos + inputsize);
+  }
+  cmdpos = firstcmd;
+  cmdsleft = numofcmds;
+  if ((bitmap != nullptr) && (get32(&data[end]) != getChecksum(bitmap))) {
+    if (mismatches == 0) {
+      firstmismatch = frame;
+    }
+    mismatches++;
+  }
+  pos = end + 4;
+  return true;
+}
+
+void Movie::frameEnd(const uint16_t *bitmap) {
+  if (mode == Mode::RECORD) {
+    // the record of the previous frame is complete
+    commitFrame();
+    checksum = getChecksum(bitmap);
+    frame++;
+  } else if ((mode == Mode::REPLAY) && readFrame(bitmap)) {
+    frame++;
+  }
+}
+
+bool Movie::write() {
+  Platform &platform = PlatformManager::getInstance();
+  std::string path = Config::PATH + name + EXTENSION;
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "wb")) {
+    platform.log(LOG_ERROR, TAG, "cannot open file %s", path.c_str());
+    return false;
+  }
+  bool success = file.write(data.data(), data.size()) == data.size();
+  file.close();
+  if (!success) {
+    platform.log(LOG_ERROR, TAG, "could not write file %s", path.c_str());
+    return false;
+  }
+  platform.log(LOG_INFO, TAG, "movie saved to %s: %lu frames, %lu bytes",
+               path.c_str(), (unsigned long)frame,
+               (unsigned long)data.size());
+  return true;
+}
+
+void Movie::stop() {
+  Platform &platform = PlatformManager::getInstance();
+  if (mode == Mode::RECORD) {
+    mode = Mode::OFF;
+    commitFrame();
+    data.push_back(FRAMEEND);
+    write();
+  } else if (mode == Mode::REPLAY) {
+    mode = Mode::OFF;
+    int64_t us = platform.getTimeUS() - starttime;
+    platform.log(LOG_INFO, TAG,
+                 "replay of %s finished: %lu frames, %lu fps, %lu checksum "
+                 "mismatches (first in frame %lu)",
+                 name.c_str(), (unsigned long)frame,
+                 (unsigned long)(us > 0 ? frame * 1000000LL / us : 0),
+                 (unsigned long)mismatches, (unsigned long)firstmismatch);
+    replayedframes.store(frame, std::memory_order_release);
+    replayok.store(!failed && (mismatches == 0), std::memory_order_release);
+    finished.store(true, std::memory_order_release);
+  }
+  data.clear();
+  data.shrink_to_fit();
+}
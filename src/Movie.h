@@ -0,0 +1,126 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "ExtCmdQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Movies: recordings of the input of the emulator (latched once per frame
+// while a movie is active, see C64Sys::latchMovieInput) and of the external
+// commands, starting from a reset or from a save state. All other inputs of
+// the emulation derive from emulated time (TOD, envelope of SID voice 3)
+// resp. from a seeded random generator (SID register 0x1b), so a replay
+// reproduces the recorded session exactly. The shown frames depend on the
+// number of run-ahead frames, which is taken from the movie when replaying.
+// A checksum of each frame is recorded and compared during the replay to
+// check builds for bit-exact output.
+// Format (little endian):
+// - header: magic "C64M", version (uint16), flags (uint16, bit 0: starts from
+//   a save state), seed of the random generator (uint32), size of the input
+//   state (uint16), run-ahead frames (uint8), input state at the start,
+//   [size of the save state (uint32), save state (see class SaveState)]
+// - per frame: flags (uint8, bit 0: input changed, bit 1: external commands,
+//   bit 7: end of movie), [input state], [number of commands (uint8), each:
+//   length (uint16) + data], checksum of the frame (uint32)
+// The input and the commands of a frame are applied at its end. Commands
+// executed before the first frame (resp. while the emulator is paused) are
+// part of the first record (resp. the record of the last frame), its
+// checksum is not used.
+class Movie {
+private:
+  static const uint16_t VERSION = 2;
+  static constexpr uint16_t FLAGSAVESTATE = 1;
+  static constexpr uint8_t FRAMEINPUT = 0x01;
+  static constexpr uint8_t FRAMECMDS = 0x02;
+  static constexpr uint8_t FRAMEEND = 0x80;
+  static const uint8_t HEADERSIZE = 15;
+
+  enum class Mode { OFF, RECORD, REPLAY };
+
+  Mode mode;
+  bool headless;
+  std::string name;
+  std::vector<uint8_t> data;
+  uint16_t inputsize;
+  std::vector<uint8_t> input;
+  uint32_t frame;
+  int64_t starttime;
+
+  // record: data of the actual frame
+  std::vector<uint8_t> frameinput;
+  std::vector<uint8_t> framecmds;
+  uint8_t numofcmds;
+  uint32_t checksum;
+
+  // replay: position in data, commands of the actual frame
+  size_t pos;
+  size_t cmdpos;
+  uint8_t cmdsleft;
+  uint8_t cmdbuffer[ExtCmdQueue::CMDSIZE];
+  uint32_t mismatches;
+  uint32_t firstmismatch;
+  bool failed;
+
+  void commitFrame();
+  bool readFrame(const uint16_t *bitmap);
+  bool write();
+  bool fail(const char *msg);
+
+public:
+  static constexpr const char *EXTENSION = ".c64m";
+
+  // result of the last replay
+  std::atomic<bool> finished;
+  std::atomic<bool> replayok;
+  std::atomic<uint32_t> replayedframes;
+
+  Movie();
+  bool isActive() const { return mode != Mode::OFF; }
+  bool isRecording() const { return mode == Mode::RECORD; }
+  bool isReplaying() const { return mode == Mode::REPLAY; }
+  // replay as fast as possible without sound
+  bool isHeadless() const { return (mode == Mode::REPLAY) && headless; }
+  static uint32_t getChecksum(const uint16_t *bitmap);
+
+  void startRecording(const std::string &name, uint32_t seed,
+                      uint8_t runahead, const void *input, uint16_t inputsize,
+                      const std::vector<uint8_t> &savestate);
+  void recordInput(const void *input);
+  void recordCommand(const uint8_t *buffer);
+
+  // loads the movie, the caller restores the start state (getSeed,
+  // getRunAhead, getStartInput, getSaveState)
+  bool startReplay(const std::string &name, bool headless, uint16_t inputsize);
+  uint32_t getSeed() const;
+  uint8_t getRunAhead() const;
+  void getStartInput(void *input) const;
+  bool getSaveState(const uint8_t *&state, uint32_t &size) const;
+  // replay: input resp. commands of the actual frame
+  bool nextInput(void *input);
+  uint8_t *nextCommand();
+
+  // checksum of the finished frame (record: stored, replay: compared), reads
+  // the input and the commands of the frame when replaying
+  void frameEnd(const uint16_t *bitmap);
+  void stop();
+};
+
+#endif // MOVIE_H
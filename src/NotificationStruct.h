@@ -70,4 +70,11 @@ struct NotificationStruct5 : NotificationStruct {
   uint8_t batteryVolHi;
 };
 
+// input latency histogram (buckets of 4 ms, counts saturated at 255)
+struct NotificationStruct6 : NotificationStruct {
+  uint8_t stage;
+  uint16_t numofsamples;
+  uint8_t buckets[16];
+};
+
 #endif // NOTIFICATIONSTRUCT_H
@@ -0,0 +1,254 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "ProgramCache.h"
+#include "Config.h"
+#include "Floppy.h"
+#include "platform/PlatformManager.h"
+#include <cstring>
+
+static const char *TAG = "ProgramCache";
+
+static const char MAGIC[4] = {'C', '6', '4', 'C'};
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32(uint8_t *p, uint32_t val) {
+  for (uint8_t i = 0; i < 4; i++) {
+    p[i] = (val >> (i * 8)) & 0xff;
+  }
+}
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t *data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static bool hasExtension(const std::string &name, const char *ext) {
+  size_t len = strlen(ext);
+  return (name.size() > len) &&
+         (name.compare(name.size() - len, len, ext) == 0);
+}
+
+ProgramCache::ProgramCache()
+    : frames(0), maxsize(0), machinekey(0), state(State::IDLE), key(0),
+      framecnt(0) {}
+
+void ProgramCache::init(uint32_t frames, uint32_t maxkb,
+                        uint32_t machinekey) {
+  this->frames = frames;
+  this->maxsize = maxkb * 1024;
+  this->machinekey = machinekey;
+  state = State::IDLE;
+}
+
+bool ProgramCache::lookup(const std::string &filename,
+                          std::vector<uint8_t> &savestate) {
+  state = State::IDLE;
+  if (!isEnabled() || !Floppy::fsinitialized) {
+    return false;
+  }
+  this->filename = filename;
+  // key: content of the program file, ROMs, frames after RUN
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(Config::PATH + filename, "rb")) {
+    return false;
+  }
+  int64_t size = file.size();
+  uint8_t buf[256];
+  uint8_t sizebuf[4];
+  put32(sizebuf, (uint32_t)size);
+  key = fnv1a(2166136261u, sizebuf, 4);
+  size_t len;
+  while ((len = file.read(buf, sizeof(buf))) > 0) {
+    key = fnv1a(key, buf, len);
+  }
+  file.close();
+  put32(sizebuf, machinekey);
+  key = fnv1a(key, sizebuf, 4);
+  put32(sizebuf, frames);
+  key = fnv1a(key, sizebuf, 4);
+  std::string path = Config::PATH + filename + EXTENSION;
+  if (!file.open(path, "rb")) {
+    return false;
+  }
+  size = file.size();
+  std::vector<uint8_t> in(size > HEADERSIZE ? size : 0);
+  bool success =
+      (size > HEADERSIZE) && (file.read(in.data(), size) == (size_t)size);
+  file.close();
+  if (!success || (memcmp(in.data(), MAGIC, 4) != 0)) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "corrupt file %s",
+                                       path.c_str());
+    return false;
+  }
+  if (get32(&in[4]) != key) {
+    // program file (or ROMs) changed: a new entry is taken
+    PlatformManager::getInstance().log(LOG_INFO, TAG, "%s is stale",
+                                       path.c_str());
+    return false;
+  }
+  savestate.assign(in.begin() + HEADERSIZE, in.end());
+  return true;
+}
+
+void ProgramCache::restored(int64_t us) {
+  PlatformManager::getInstance().log(LOG_INFO, TAG, "%s restored in %lu us",
+                                     filename.c_str(), (unsigned long)us);
+}
+
+void ProgramCache::startLoading() {
+  // also without cache: RUN is typed after the load
+  state = State::LOADING;
+  framecnt = 0;
+}
+
+void ProgramCache::startRunning() {
+  if (!isEnabled()) {
+    return;
+  }
+  state = State::RUNNING;
+  framecnt = 0;
+}
+
+void ProgramCache::cancel() { state = State::IDLE; }
+
+ProgramCache::Action ProgramCache::frameEnd(bool waitingforkey) {
+  if (state == State::LOADING) {
+    // LOAD"*",8 was typed: wait for the READY prompt after the load
+    framecnt++;
+    if (framecnt > MAXLOADFRAMES) {
+      state = State::IDLE;
+    } else if (waitingforkey && (framecnt > 1)) {
+      state = State::IDLE;
+      startRunning();
+      return Action::RUN;
+    }
+  } else if (state == State::RUNNING) {
+    if (++framecnt >= frames) {
+      state = State::IDLE;
+      return Action::STORE;
+    }
+  }
+  return Action::NONE;
+}
+
+bool ProgramCache::readHeader(const std::string &path, uint32_t &key,
+                              uint32_t &generation, int64_t &size) {
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "rb")) {
+    return false;
+  }
+  uint8_t header[HEADERSIZE];
+  size = file.size();
+  bool success = (file.read(header, HEADERSIZE) == HEADERSIZE) &&
+                 (memcmp(header, MAGIC, 4) == 0);
+  file.close();
+  key = get32(&header[4]);
+  generation = get32(&header[8]);
+  return success;
+}
+
+uint32_t ProgramCache::makeRoom(uint32_t size) {
+  struct Entry {
+    std::string path;
+    uint32_t generation;
+    int64_t size;
+  };
+  // collect the names first (the directory is iterated by the file driver)
+  std::vector<std::string> names;
+  std::string name;
+  bool start = true;
+  while (Floppy::sysfile->listnextentry(name, start) && !name.empty()) {
+    start = false;
+    if (hasExtension(name, EXTENSION)) {
+      names.push_back(name);
+    }
+  }
+  std::vector<Entry> entries;
+  std::string ownpath = Config::PATH + filename + EXTENSION;
+  int64_t total = 0;
+  uint32_t maxgeneration = 0;
+  for (const std::string &n : names) {
+    Entry entry;
+    uint32_t entrykey;
+    entry.path = Config::PATH + n;
+    if ((entry.path == ownpath) ||
+        !readHeader(entry.path, entrykey, entry.generation, entry.size)) {
+      continue;
+    }
+    total += entry.size;
+    if (entry.generation > maxgeneration) {
+      maxgeneration = entry.generation;
+    }
+    entries.push_back(entry);
+  }
+  // remove the oldest entries until the new one fits
+  while ((total + size > maxsize) && !entries.empty()) {
+    size_t oldest = 0;
+    for (size_t i = 1; i < entries.size(); i++) {
+      if (entries[i].generation < entries[oldest].generation) {
+        oldest = i;
+      }
+    }
+    if (Floppy::sysfile->remove(entries[oldest].path)) {
+      PlatformManager::getInstance().log(LOG_INFO, TAG, "%s removed",
+                                         entries[oldest].path.c_str());
+    }
+    total -= entries[oldest].size;
+    entries.erase(entries.begin() + oldest);
+  }
+  return maxgeneration + 1;
+}
+
+void ProgramCache::store(const std::vector<uint8_t> &savestate) {
+  Platform &platform = PlatformManager::getInstance();
+  if (!Floppy::fsinitialized) {
+    return;
+  }
+  uint32_t size = HEADERSIZE + savestate.size();
+  if (size > maxsize) {
+    platform.log(LOG_INFO, TAG, "state of %s exceeds the size limit",
+                 filename.c_str());
+    return;
+  }
+  uint32_t generation = makeRoom(size);
+  std::string path = Config::PATH + filename + EXTENSION;
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "wb")) {
+    platform.log(LOG_ERROR, TAG, "cannot open file %s", path.c_str());
+    return;
+  }
+  uint8_t header[HEADERSIZE];
+  memcpy(header, MAGIC, 4);
+  put32(&header[4], key);
+  put32(&header[8], generation);
+  bool success = (file.write(header, HEADERSIZE) == HEADERSIZE) &&
+                 (file.write(savestate.data(), savestate.size()) ==
+                  savestate.size());
+  file.close();
+  if (!success) {
+    platform.log(LOG_ERROR, TAG, "could not write file %s", path.c_str());
+    Floppy::sysfile->remove(path);
+    return;
+  }
+  platform.log(LOG_INFO, TAG, "%s stored (%lu bytes)", path.c_str(),
+               (unsigned long)size);
+}
@@ -0,0 +1,80 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Program cache: programs started by a launcher (ExtCmd LOAD with the run
+// flag, joystick only file chooser, Config::AUTORUN, see
+// C64Sys::launchProgram) are snapshotted a configurable number of frames
+// after RUN. The next launch of the same program restores the snapshot
+// instead of loading (d64: via the kernal hooks) and starting the program.
+// Entries are stored next to the program in the configured directory
+// (NAME.prg.c64c resp. NAME.d64.c64c) and are keyed by a hash of the
+// program file (incl. its size), the ROMs, the machine configuration (see
+// InstantBoot::getMachineKey) and the number of frames, so a changed file
+// yields a new entry. If the entries exceed the size limit, the
+// oldest ones are removed.
+// Format of an entry: magic "C64C", key (uint32), generation (uint32, age
+// of the entry), little endian, save state (see class SaveState).
+class ProgramCache {
+public:
+  enum class Action { NONE, RUN, STORE };
+
+private:
+  static constexpr const char *EXTENSION = ".c64c";
+  static const uint8_t HEADERSIZE = 12;
+  // frames the load of a d64 program may take (60 s)
+  static const uint16_t MAXLOADFRAMES = 3000;
+
+  enum class State { IDLE, LOADING, RUNNING };
+
+  uint32_t frames;
+  uint32_t maxsize;
+  uint32_t machinekey;
+  State state;
+  std::string filename;
+  uint32_t key;
+  uint32_t framecnt;
+
+  bool readHeader(const std::string &path, uint32_t &key,
+                  uint32_t &generation, int64_t &size);
+  uint32_t makeRoom(uint32_t size);
+
+public:
+  ProgramCache();
+  // frames: frames after RUN (0: off), maxkb: size limit of all entries
+  void init(uint32_t frames, uint32_t maxkb, uint32_t machinekey);
+  bool isEnabled() const { return frames != 0; }
+  // hashes the program file (name incl. extension), savestate is filled if
+  // a valid entry exists
+  bool lookup(const std::string &filename, std::vector<uint8_t> &savestate);
+  // us: time of lookup and restore
+  void restored(int64_t us);
+  // program of the last lookup: load (d64) resp. RUN started
+  void startLoading();
+  void startRunning();
+  void cancel();
+  // checked once per frame, waitingforkey: see InstantBoot::isWaitingForKey
+  Action frameEnd(bool waitingforkey);
+  void store(const std::vector<uint8_t> &savestate);
+};
+
+#endif // PROGRAMCACHE_H
@@ -0,0 +1,261 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "Rewind.h"
+#include "C64Sys.h"
+#include "LZ.h"
+#include "platform/PlatformManager.h"
+#include <cstring>
+#include <memory>
+#include <new>
+
+static const char *TAG = "Rewind";
+
+Rewind::Rewind()
+    : ram(nullptr), colorram(nullptr), buffer(nullptr), buffersize(0),
+      head(0), shadow(nullptr), framessincekey(0), numofrecords(0),
+      numofframes(0), numofbytes(0), captureus(0) {
+  memset(dirty, 0, sizeof(dirty));
+}
+
+void Rewind::init(uint32_t buffersize, uint8_t *ram, uint8_t *colorram) {
+  this->ram = ram;
+  this->colorram = colorram;
+  if (buffersize == 0) {
+    return;
+  }
+  if (buffersize < MINBUFFERSIZE) {
+    buffersize = MINBUFFERSIZE;
+  }
+  // large allocations are placed in PSRAM on the ESP32
+  buffer = new (std::nothrow) uint8_t[buffersize];
+  shadow = new (std::nothrow) Snapshot();
+  if ((buffer == nullptr) || (shadow == nullptr)) {
+    delete[] buffer;
+    delete shadow;
+    buffer = nullptr;
+    shadow = nullptr;
+    PlatformManager::getInstance().log(
+        LOG_ERROR, TAG, "cannot allocate %lu bytes for rewind",
+        (unsigned long)buffersize);
+    return;
+  }
+  this->buffersize = buffersize;
+  record.reserve(MINBUFFERSIZE / 2);
+  // first record: all pages compared to the (empty) shadow memory
+  markAllDirty();
+  PlatformManager::getInstance().log(LOG_INFO, TAG, "rewind: %lu KB",
+                                     (unsigned long)(buffersize / 1024));
+}
+
+void Rewind::markAllDirty() { memset(dirty, 0xff, sizeof(dirty)); }
+
+uint8_t *Rewind::getPage(uint8_t *mem, uint8_t *colormem, uint16_t page) {
+  return (page < 256) ? mem + (page << 8) : colormem + ((page - 256) << 8);
+}
+
+void Rewind::encodePage(const uint8_t *actual, const uint8_t *prev) {
+  // (number of unchanged bytes, number of changed bytes, XORed changed
+  // bytes) until the end of the page
+  uint16_t pos = 0;
+  while (pos < 256) {
+    uint8_t same = 0;
+    while ((pos < 256) && (same < 255) && (actual[pos] == prev[pos])) {
+      pos++;
+      same++;
+    }
+    record.push_back(same);
+    size_t cntidx = record.size();
+    record.push_back(0);
+    uint8_t changed = 0;
+    while ((pos < 256) && (changed < 255) && (actual[pos] != prev[pos])) {
+      record.push_back(actual[pos] ^ prev[pos]);
+      pos++;
+      changed++;
+    }
+    record[cntidx] = changed;
+  }
+}
+
+void Rewind::decodePage(const uint8_t *&src, uint8_t *dst) {
+  uint16_t pos = 0;
+  while (pos < 256) {
+    pos += *src++;
+    uint8_t changed = *src++;
+    for (uint8_t i = 0; i < changed; i++) {
+      dst[pos++] ^= *src++;
+    }
+  }
+}
+
+uint32_t Rewind::addKeyframe() {
+  // LZ compressed ram (size of the compressed data first), color ram
+  LZ::compress(shadow->ram, sizeof(shadow->ram), keyframe);
+  uint32_t size = keyframe.size();
+  const uint8_t *sizebytes = reinterpret_cast<const uint8_t *>(&size);
+  record.insert(record.end(), sizebytes, sizebytes + sizeof(size));
+  record.insert(record.end(), keyframe.begin(), keyframe.end());
+  record.insert(record.end(), shadow->colorram,
+                shadow->colorram + sizeof(shadow->colorram));
+  return sizeof(size) + size + sizeof(shadow->colorram);
+}
+
+void Rewind::store(uint32_t keysize) {
+  uint32_t size = record.size();
+  if (size > buffersize) {
+    // the chain of deltas is broken
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "record too large: %lu bytes",
+                                       (unsigned long)size);
+    records.clear();
+    head = 0;
+    return;
+  }
+  if (head + size > buffersize) {
+    // wrap around, the records at the end of the buffer are the oldest ones
+    while (!records.empty() && (records.front().offset >= head)) {
+      records.pop_front();
+    }
+    head = 0;
+  }
+  // overwrite the oldest records
+  while (!records.empty() && (records.front().offset < head + size) &&
+         (records.front().offset + records.front().size > head)) {
+    records.pop_front();
+  }
+  memcpy(buffer + head, record.data(), size);
+  records.push_back({head, size, keysize});
+  head += size;
+  numofrecords.store(records.size(), std::memory_order_release);
+}
+
+void Rewind::capture(C64Sys &sys) {
+  if (buffersize == 0) {
+    return;
+  }
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  sys.saveState(*shadow, false);
+  record.clear();
+  Registers regs = {shadow->cpu, shadow->vic, shadow->cia1, shadow->cia2,
+                    shadow->sid};
+  const uint8_t *regbytes = reinterpret_cast<const uint8_t *>(&regs);
+  record.insert(record.end(), regbytes, regbytes + sizeof(regs));
+  // changed pages: page number (uint16), encoded XOR of the page
+  for (uint16_t page = 0; page < NUMOFPAGES; page++) {
+    if (!(dirty[page >> 5] & (1u << (page & 31)))) {
+      continue;
+    }
+    uint8_t *actual = getPage(ram, colorram, page);
+    uint8_t *prev = getPage(shadow->ram, shadow->colorram, page);
+    if (memcmp(actual, prev, 256) == 0) {
+      continue;
+    }
+    record.push_back(page & 0xff);
+    record.push_back(page >> 8);
+    encodePage(actual, prev);
+    memcpy(prev, actual, 256);
+  }
+  memset(dirty, 0, sizeof(dirty));
+  uint32_t keysize = 0;
+  if (++framessincekey >= KEYFRAMESECONDS * FRAMESPERSECOND) {
+    framessincekey = 0;
+    keysize = addKeyframe();
+  }
+  store(keysize);
+  numofframes.fetch_add(1, std::memory_order_release);
+  numofbytes.fetch_add(record.size(), std::memory_order_release);
+  captureus.fetch_add(platform.getTimeUS() - start, std::memory_order_release);
+}
+
+uint32_t Rewind::rewind(C64Sys &sys, uint32_t numofframes) {
+  if ((buffersize == 0) || records.empty()) {
+    return 0;
+  }
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  // the shadow memory corresponds to the last record
+  size_t last = records.size() - 1;
+  size_t target = (numofframes >= last) ? 0 : last - numofframes;
+  // start at the next keyframe (if any), go back applying the deltas
+  size_t first = last;
+  for (size_t i = target; i < last; i++) {
+    const Record &rec = records[i];
+    if (rec.keysize != 0) {
+      const uint8_t *key = buffer + rec.offset + rec.size - rec.keysize;
+      uint32_t size;
+      memcpy(&size, key, sizeof(size));
+      LZ::decompress(key + sizeof(size), size, shadow->ram,
+                     sizeof(shadow->ram));
+      memcpy(shadow->colorram, key + sizeof(size) + size,
+             sizeof(shadow->colorram));
+      first = i;
+      break;
+    }
+  }
+  for (size_t i = first; i > target; i--) {
+    const Record &rec = records[i];
+    const uint8_t *src = buffer + rec.offset + sizeof(Registers);
+    const uint8_t *end = buffer + rec.offset + rec.size - rec.keysize;
+    while (src < end) {
+      uint16_t page = src[0] | (src[1] << 8);
+      src += 2;
+      decodePage(src, getPage(shadow->ram, shadow->colorram, page));
+    }
+  }
+  Registers regs;
+  memcpy(&regs, buffer + records[target].offset, sizeof(regs));
+  shadow->cpu = regs.cpu;
+  shadow->vic = regs.vic;
+  shadow->cia1 = regs.cia1;
+  shadow->cia2 = regs.cia2;
+  shadow->sid = regs.sid;
+  sys.loadState(*shadow);
+  // continue the SID synthesis with the restored registers
+  std::unique_ptr<SIDVoiceState> voices(new SIDVoiceState());
+  sys.sid.saveVoiceState(*voices);
+  sys.sid.loadVoiceState(*voices);
+  // the frames after the target are discarded
+  records.erase(records.begin() + target + 1, records.end());
+  head = records.back().offset + records.back().size;
+  framessincekey = 0;
+  for (size_t i = target; (i > 0) && (records[i].keysize == 0); i--) {
+    framessincekey++;
+  }
+  memset(dirty, 0, sizeof(dirty));
+  numofrecords.store(records.size(), std::memory_order_release);
+  platform.log(LOG_INFO, TAG, "rewound %lu frames in %lu us",
+               (unsigned long)(last - target),
+               (unsigned long)(platform.getTimeUS() - start));
+  return last - target;
+}
+
+void Rewind::logPerfValues() {
+  if (buffersize == 0) {
+    return;
+  }
+  uint32_t num = numofframes.exchange(0, std::memory_order_acq_rel);
+  uint32_t bytes = numofbytes.exchange(0, std::memory_order_acq_rel);
+  uint32_t us = captureus.exchange(0, std::memory_order_acq_rel);
+  uint32_t recs = numofrecords.load(std::memory_order_acquire);
+  PlatformManager::getInstance().log(
+      LOG_INFO, TAG,
+      "rewind frames: %lu, bytes per frame: %lu, capture: %lu us per frame, "
+      "ring: %lu frames (%lu s)",
+      (unsigned long)num, (unsigned long)(num > 0 ? bytes / num : 0),
+      (unsigned long)(num > 0 ? us / num : 0), (unsigned long)recs,
+      (unsigned long)(recs / FRAMESPERSECOND));
+}
@@ -0,0 +1,107 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "Snapshot.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class C64Sys; // forward declaration
+
+// Rewind ring: at the end of each frame the chip registers are stored fully,
+// ram and color ram as the 256 byte pages written during the frame, XORed
+// with the previous content of the page and run length encoded. Every
+// KEYFRAMESECONDS seconds the whole memory is stored additionally (LZ
+// compressed), so going back is limited to the deltas since the next
+// keyframe. All records are kept in one ring buffer of a configurable size,
+// the oldest records are overwritten. Floppy state and SID synthesis are not
+// part of the records.
+class Rewind {
+private:
+  static const uint8_t KEYFRAMESECONDS = 5;
+  static const uint8_t FRAMESPERSECOND = 50;
+  static const uint16_t NUMOFPAGES = 256 + 4; // ram + color ram
+  // the largest possible record (all pages changed + keyframe) must fit
+  static const uint32_t MINBUFFERSIZE = 512 * 1024;
+
+  // chip registers of a frame
+  struct Registers {
+    Snapshot::CPUState cpu;
+    VIC::State vic;
+    CIA::State cia1;
+    CIA::State cia2;
+    SID::State sid;
+  };
+
+  struct Record {
+    uint32_t offset;
+    uint32_t size;
+    uint32_t keysize; // size of the keyframe at the end of the record
+  };
+
+  // pages written since the last frame
+  uint32_t dirty[(NUMOFPAGES + 31) / 32];
+
+  uint8_t *ram;
+  uint8_t *colorram;
+  uint8_t *buffer;
+  uint32_t buffersize;
+  uint32_t head;
+  std::deque<Record> records;
+  // machine state of the last record
+  Snapshot *shadow;
+  std::vector<uint8_t> record;
+  std::vector<uint8_t> keyframe;
+  uint16_t framessincekey;
+
+  // statistics (reset by logPerfValues)
+  std::atomic<uint32_t> numofrecords;
+  std::atomic<uint32_t> numofframes;
+  std::atomic<uint32_t> numofbytes;
+  std::atomic<uint32_t> captureus;
+
+  uint8_t *getPage(uint8_t *mem, uint8_t *colormem, uint16_t page);
+  void encodePage(const uint8_t *actual, const uint8_t *prev);
+  void decodePage(const uint8_t *&src, uint8_t *dst);
+  uint32_t addKeyframe();
+  void store(uint32_t keysize);
+
+public:
+  Rewind();
+  // buffersize in bytes (0: off)
+  void init(uint32_t buffersize, uint8_t *ram, uint8_t *colorram);
+  bool isActive() const { return buffersize != 0; }
+  void markDirty(uint16_t addr) {
+    dirty[addr >> 13] |= 1u << ((addr >> 8) & 31);
+  }
+  void markColorRAMDirty(uint16_t idx) {
+    uint16_t page = 256 + (idx >> 8);
+    dirty[page >> 5] |= 1u << (page & 31);
+  }
+  void markAllDirty();
+  // record the frame just finished
+  void capture(C64Sys &sys);
+  // go back numofframes frames (at most to the oldest record), returns the
+  // number of frames gone back
+  uint32_t rewind(C64Sys &sys, uint32_t numofframes);
+  void logPerfValues();
+};
+
+#endif // REWIND_H
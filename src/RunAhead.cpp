@@ -0,0 +1,78 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "RunAhead.h"
+#include "platform/PlatformManager.h"
+
+static const char *TAG = "RunAhead";
+
+RunAhead::RunAhead()
+    : pause(0), numofframes(0), numofaborts(0), emulationus(0), stateus(0),
+      frames(0), snapshot(nullptr) {}
+
+void RunAhead::init(uint8_t frames) {
+  this->frames = frames;
+  pause = 0;
+  if ((frames != 0) && (snapshot == nullptr)) {
+    snapshot = new Snapshot();
+  }
+  if (frames != 0) {
+    PlatformManager::getInstance().log(LOG_INFO, TAG, "run-ahead: %d frames",
+                                       frames);
+  }
+}
+
+bool RunAhead::isActive() {
+  if (frames == 0) {
+    return false;
+  }
+  if (pause != 0) {
+    pause--;
+    return false;
+  }
+  return true;
+}
+
+void RunAhead::abort() {
+  // e.g. kernal hooks (floppy access) which are not part of the snapshot
+  pause = PAUSEFRAMES;
+  numofaborts.fetch_add(1, std::memory_order_release);
+}
+
+void RunAhead::addStatistics(uint8_t numofframes, uint32_t emulationus,
+                             uint32_t stateus) {
+  this->numofframes.fetch_add(numofframes, std::memory_order_release);
+  this->emulationus.fetch_add(emulationus, std::memory_order_release);
+  this->stateus.fetch_add(stateus, std::memory_order_release);
+}
+
+void RunAhead::logPerfValues() {
+  if (frames == 0) {
+    return;
+  }
+  uint32_t num = numofframes.exchange(0, std::memory_order_acq_rel);
+  uint32_t emus = emulationus.exchange(0, std::memory_order_acq_rel);
+  uint32_t stus = stateus.exchange(0, std::memory_order_acq_rel);
+  // host cpu time per run-ahead frame (emulation + share of save/restore)
+  PlatformManager::getInstance().log(
+      LOG_INFO, TAG,
+      "run-ahead frames: %lu, cost per frame: %lu us (save/restore: %lu us), "
+      "cpu load: %lu%%, aborts: %lu",
+      (unsigned long)num, (unsigned long)(num > 0 ? (emus + stus) / num : 0),
+      (unsigned long)(num > 0 ? stus / num : 0),
+      (unsigned long)((emus + stus) / 10000),
+      (unsigned long)numofaborts.exchange(0, std::memory_order_acq_rel));
+}
@@ -0,0 +1,56 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include "Snapshot.h"
+#include <atomic>
+#include <cstdint>
+
+// Run-ahead: at the end of each frame the machine state is saved, the next
+// frames are emulated with the actual input (audio and video suppressed
+// except for the last frame, which is shown) and the state is restored.
+// Games reacting to the input one or more frames later appear to react
+// immediately. The emulation itself is done by C64Sys::runAhead.
+class RunAhead {
+private:
+  // frames without run-ahead after an abort
+  static const uint8_t PAUSEFRAMES = 50;
+
+  uint8_t pause;
+
+  // statistics (reset by logPerfValues)
+  std::atomic<uint32_t> numofframes;
+  std::atomic<uint32_t> numofaborts;
+  std::atomic<uint32_t> emulationus;
+  std::atomic<uint32_t> stateus;
+
+public:
+  // number of frames to run ahead (0: off)
+  uint8_t frames;
+  Snapshot *snapshot;
+
+  RunAhead();
+  void init(uint8_t frames);
+  bool isActive();
+  void abort();
+  void addStatistics(uint8_t numofframes, uint32_t emulationus,
+                     uint32_t stateus);
+  void logPerfValues();
+};
+
+#endif // RUNAHEAD_H
@@ -16,9 +16,11 @@
 */
 
 #include "SID.h"
+#include "Capture.h"
 #include "platform/PlatformManager.h"
 #include "sound/SoundFactory.h"
 #include <cmath>
+#include <cstring>
 
 static const float attackLUT[16] = {
     0.002f, 0.008f, 0.016f, 0.024f, 0.038f, 0.056f, 0.068f, 0.080f,
@@ -28,6 +30,41 @@ static const float releaseDecayLUT[16] = {
     0.008f, 0.024f, 0.048f, 0.072f, 0.114f, 0.168f, 0.204f, 0.24f,
     0.3f,   0.75f,  1.5f,   2.4f,   3.0f,   9.0f,   15.0f,  24.0f};
 
+// envelope rate tables of the fixed point engine (increment per sample for a
+// full 0 -> ENVMAX sweep within the attack / decay / release time)
+static constexpr uint32_t envStep(uint32_t ms) {
+  return (uint32_t)((uint64_t)SIDVoiceFP::ENVMAX * 1000 /
+                    ((uint64_t)ms * AUDIO_SAMPLE_RATE));
+}
+
+static const uint32_t attackStepLUT[16] = {
+    envStep(2),   envStep(8),   envStep(16),   envStep(24),
+    envStep(38),  envStep(56),  envStep(68),   envStep(80),
+    envStep(100), envStep(250), envStep(500),  envStep(800),
+    envStep(1000), envStep(3000), envStep(5000), envStep(8000)};
+
+static const uint32_t releaseDecayStepLUT[16] = {
+    envStep(8),    envStep(24),   envStep(48),    envStep(72),
+    envStep(114),  envStep(168),  envStep(204),   envStep(240),
+    envStep(300),  envStep(750),  envStep(1500),  envStep(2400),
+    envStep(3000), envStep(9000), envStep(15000), envStep(24000)};
+
+// cycles per step of the envelope of the SID
+static const uint16_t ratePeriodLUT[16] = {9,    32,   63,   95,    149,  220,
+                                           267,  313,  392,  977,   1954, 3126,
+                                           3907, 11720, 19532, 31251};
+
+// filter damping (1 / Q in Q12) per resonance value, Q = 0.707 .. 1.707
+static constexpr int32_t resDamping(uint8_t res) {
+  return (int32_t)(4096.0 * 15.0 / (0.707 * 15.0 + res));
+}
+
+static const int32_t resonanceLUT[16] = {
+    resDamping(0),  resDamping(1),  resDamping(2),  resDamping(3),
+    resDamping(4),  resDamping(5),  resDamping(6),  resDamping(7),
+    resDamping(8),  resDamping(9),  resDamping(10), resDamping(11),
+    resDamping(12), resDamping(13), resDamping(14), resDamping(15)};
+
 SIDVoice::SIDVoice() { init(); }
 
 void SIDVoice::init() {
@@ -44,6 +81,7 @@ void SIDVoice::init() {
   attackAdd = 0.0f;
   decayAdd = 0.0f;
   releaseAdd = 0.0f;
+  decay = 0;
   noiseValue = 0.0f;
 }
 
@@ -57,19 +95,25 @@ void SIDVoice::updVarPulseWidth(uint16_t pw) {
   pulseWidth = (float)(pw & 0x0fff) / 4095.0;
 }
 
+void SIDVoice::updDecayAdd() {
+  decayAdd =
+      (1.0f - sustainVolume) / (releaseDecayLUT[decay] * AUDIO_SAMPLE_RATE);
+}
+
 void SIDVoice::updVarEnvelopeAD(uint8_t val) {
   attackAdd = 1.0f / (attackLUT[(val >> 4) & 0x0f] * AUDIO_SAMPLE_RATE);
-  decayAdd = (1.0f - sustainVolume) /
-             (releaseDecayLUT[val & 0x0f] * AUDIO_SAMPLE_RATE);
+  decay = val & 0x0f;
+  updDecayAdd();
 }
 
 void SIDVoice::updVarEnvelopeSR(uint8_t val) {
-  sustainVolume = (float)(val & 0x0f) / 15.0;
+  sustainVolume = (float)(val >> 4) / 15.0;
   float time = releaseDecayLUT[val & 0x0f];
   // special case: sustainVolume may be 0 -> enforce some reasonable value for
   // releaseAdd
   releaseAdd = sustainVolume > 0.0f ? sustainVolume / (time * AUDIO_SAMPLE_RATE)
                                     : 1.0f / (time * AUDIO_SAMPLE_RATE);
+  updDecayAdd();
 }
 
 void SIDVoice::updVarControl(uint8_t val) {
@@ -164,8 +208,8 @@ float SIDVoice::generateSample() {
   // 0 <= phase <= 1
   // -1 <= sample < 1
   phase += phaseIncrement;
-  if (phase > 1.0f) {
-    phase = 0.0f;
+  if (phase >= 1.0f) {
+    phase -= 1.0f;
     if (syncNextVoice) { // syncNextVoice is never true for voice 3 (index 2)
       nextVoice->phase = 0.0f;
     }
@@ -213,23 +257,324 @@ float SIDVoice::generateSample() {
   return sample;
 }
 
-void SID::init() {
-#ifdef HAS_DEFAULT_VOLUME
-  setEmuVolume(Config::DEFAULT_VOLUME);
-#else
-  setEmuVolume(128);
-#endif
-  c64Volume = 0.0f;
-  actSampleIdx = 0;
-  for (uint16_t i = 0; i < NUMSAMPLESPERFRAME; i++) {
-    samples[i] = 0;
+void SIDEnvelope::init() {
+  ratecounter = 0;
+  expcounter = 0;
+  state = RELEASE;
+  attackdecay = 0;
+  sustainrelease = 0;
+  level = 0;
+}
+
+void SIDEnvelope::setControl(uint8_t val) {
+  if (val & 0x01) {
+    if (state == RELEASE) {
+      state = ATTACK;
+    }
+  } else {
+    state = RELEASE;
+  }
+}
+
+void SIDEnvelope::clock(uint8_t cycles) {
+  while (cycles > 0) {
+    uint8_t rate = (state == ATTACK)         ? attackdecay >> 4
+                   : (state == DECAYSUSTAIN) ? attackdecay & 0x0f
+                                             : sustainrelease & 0x0f;
+    uint16_t period = ratePeriodLUT[rate];
+    if (ratecounter >= period) {
+      ratecounter = 0;
+    }
+    // nothing to do at the sustain level resp. at zero
+    if ((state != ATTACK) &&
+        ((level == 0) || ((state == DECAYSUSTAIN) &&
+                          (level == (sustainrelease >> 4) * 0x11)))) {
+      ratecounter = (ratecounter + cycles) % period;
+      return;
+    }
+    uint16_t left = period - ratecounter;
+    if (cycles < left) {
+      ratecounter += cycles;
+      return;
+    }
+    cycles -= left;
+    ratecounter = 0;
+    if (state == ATTACK) {
+      if (++level == 0xff) {
+        state = DECAYSUSTAIN;
+        expcounter = 0;
+      }
+      continue;
+    }
+    // exponential decay: the period depends on the level
+    uint8_t expperiod = (level >= 0x5d)   ? 1
+                        : (level >= 0x36) ? 2
+                        : (level >= 0x1a) ? 4
+                        : (level >= 0x0e) ? 8
+                        : (level >= 0x06) ? 16
+                                          : 30;
+    if (++expcounter >= expperiod) {
+      expcounter = 0;
+      level--;
+    }
+  }
+}
+
+SIDVoiceFP::SIDVoiceFP() { init(); }
+
+void SIDVoiceFP::init() {
+  adsrState = IDLE;
+  control = 0;
+  lfsr = 0x7FFFF8;
+  accumulator = 0;
+  accIncrement = 0;
+  envelope = 0;
+  syncNextVoice = false;
+  ringmod = false;
+  pulseWidth = 0;
+  sustainLevel = 0;
+  attackStep = 0;
+  decayStep = 0;
+  releaseStep = 0;
+  decay = 0;
+  noiseValue = 0;
+}
+
+bool SIDVoiceFP::isActive() { return adsrState != IDLE; }
+
+void SIDVoiceFP::updVarFrequency(uint16_t freq) {
+  // accumulator increment per sample in 24.8 format
+  accIncrement =
+      (uint32_t)((((uint64_t)freq * 985248) << 8) / AUDIO_SAMPLE_RATE);
+}
+
+void SIDVoiceFP::updVarPulseWidth(uint16_t pw) { pulseWidth = pw & 0x0fff; }
+
+void SIDVoiceFP::updDecayStep() {
+  uint64_t step =
+      (uint64_t)releaseDecayStepLUT[decay] * (ENVMAX - sustainLevel) / ENVMAX;
+  decayStep = step > 0 ? step : 1;
+}
+
+void SIDVoiceFP::updVarEnvelopeAD(uint8_t val) {
+  attackStep = attackStepLUT[(val >> 4) & 0x0f];
+  decay = val & 0x0f;
+  updDecayStep();
+}
+
+void SIDVoiceFP::updVarEnvelopeSR(uint8_t val) {
+  sustainLevel = (val >> 4) * (ENVMAX / 15);
+  uint32_t step = releaseDecayStepLUT[val & 0x0f];
+  // special case: sustainLevel may be 0 -> enforce some reasonable value for
+  // releaseStep
+  releaseStep = sustainLevel > 0
+                    ? (uint32_t)((uint64_t)step * sustainLevel / ENVMAX)
+                    : step;
+  updDecayStep();
+}
+
+void SIDVoiceFP::updVarControl(uint8_t val) {
+  uint8_t oldControl = control;
+  control = val;
+  bool oldGate = oldControl & 0x01;
+  bool newGate = control & 0x01;
+  // bit 0 (gate bit)
+  if (!oldGate && newGate) {
+    adsrState = ATTACK;
+    envelope = 0;
+  } else if (oldGate && !newGate) {
+    adsrState = RELEASE;
+  }
+  // bit 1 (sync)
+  if (voice != 0) {
+    prevVoice->syncNextVoice = control & 0x02;
+  }
+  // bit 2 (ringmod)
+  ringmod = control & 0x04;
+  // bit 3 (test)
+  bool oldTest = oldControl & 0x08;
+  bool newTest = control & 0x08;
+  if (!oldTest && newTest) {
+    accumulator = 0;
+    accIncrement = 0;
+    lfsr = 0x7FFFF8;
+  }
+  // bit 4-7 (waveform)
+  uint8_t oldWave = oldControl & 0xf0;
+  uint8_t newWave = control & 0xf0;
+  if (newGate && (oldWave != newWave)) {
+    adsrState = ATTACK;
+    accumulator = 0;
+  }
+}
+
+uint32_t SIDVoiceFP::updateEnvelope() {
+  switch (adsrState) {
+  case ATTACK:
+    if (envelope >= ENVMAX - attackStep) {
+      envelope = ENVMAX;
+      adsrState = DECAY;
+    } else {
+      envelope += attackStep;
+    }
+    break;
+  case DECAY:
+    if (envelope <= sustainLevel + decayStep) {
+      envelope = sustainLevel;
+      adsrState = SUSTAIN;
+    } else {
+      envelope -= decayStep;
+    }
+    break;
+  case SUSTAIN:
+    break;
+  case RELEASE:
+    if (envelope <= releaseStep) {
+      envelope = 0;
+      adsrState = IDLE;
+    } else {
+      envelope -= releaseStep;
+    }
+    break;
+  case IDLE:
+    envelope = 0;
+    break;
+  }
+  return envelope;
+}
+
+void SIDVoiceFP::nextLFSR() {
+  bool bit22 = (lfsr >> 22) & 1;
+  bool bit17 = (lfsr >> 17) & 1;
+  lfsr = ((lfsr << 1) | (bit22 ^ bit17));
+}
+
+int16_t SIDVoiceFP::getNoise() const {
+  uint16_t noise12bit = (((lfsr >> 22) & 1) << 11) |
+                        (((lfsr >> 20) & 1) << 10) | (((lfsr >> 16) & 1) << 9) |
+                        (((lfsr >> 13) & 1) << 8) | (((lfsr >> 11) & 1) << 7) |
+                        (((lfsr >> 7) & 1) << 6) | (((lfsr >> 6) & 1) << 5) |
+                        (((lfsr >> 3) & 1) << 4) | (((lfsr >> 1) & 1) << 3) |
+                        (((lfsr >> 0) & 1) << 2) | (((lfsr >> 18) & 1) << 1) |
+                        (((lfsr >> 14) & 1) << 0);
+  return (int16_t)noise12bit - 2048;
+}
+
+int16_t SIDVoiceFP::generateSample() {
+  // waveforms are 12 bit values (-2048 <= sample < 2048)
+  uint32_t oldAccumulator = accumulator;
+  accumulator += accIncrement;
+  bool overflow = accumulator < oldAccumulator;
+  if (overflow && syncNextVoice) {
+    // syncNextVoice is never true for voice 3 (index 2)
+    nextVoice->accumulator = 0;
   }
+  bool active = isActive();
+  int32_t sample = 0;
+  uint8_t wavecnt = 0;
+  uint16_t acc12 = accumulator >> 20;
+  if (active) {
+    // triangle
+    if (control & 0x10) {
+      bool msb = accumulator & 0x80000000;
+      if (ringmod) {
+        msb ^= (bool)(prevVoice->accumulator & 0x80000000);
+      }
+      uint16_t triangle = ((accumulator >> 19) & 0x0fff) ^ (msb ? 0 : 0x0fff);
+      sample += triangle - 2048;
+      wavecnt++;
+    }
+    // saw
+    if (control & 0x20) {
+      sample += acc12 - 2048;
+      wavecnt++;
+    }
+    // pulse
+    if (control & 0x40) {
+      sample += (acc12 < pulseWidth) ? 2047 : -2048;
+      wavecnt++;
+    }
+  }
+  // noise
+  if (control & 0x80) {
+    if (overflow) {
+      nextLFSR();
+      if (active) {
+        noiseValue = getNoise();
+      }
+    }
+    if (active) {
+      sample += noiseValue;
+      wavecnt++;
+    }
+  }
+  switch (wavecnt) {
+  case 2:
+    sample >>= 1;
+    break;
+  case 3:
+    sample = (sample * 21845) >> 16;
+    break;
+  case 4:
+    sample >>= 2;
+    break;
+  }
+  return sample;
+}
+
+SIDFilter::SIDFilter() { init(); }
+
+void SIDFilter::init() {
+  lp = 0;
+  bp = 0;
+  routing = 0;
+  mode = 0;
+  updCutoff(0);
+  updResonance(0);
+}
+
+void SIDFilter::updCutoff(uint16_t fc) {
+  // linear approximation of the cutoff curve: 30 Hz .. 12 kHz
+  float freq = 30.0f + fc * 5.8f;
+  int32_t coeff = (int32_t)(8192.0f * sinf(M_PI * freq / AUDIO_SAMPLE_RATE));
+  // the filter is stable for f < 1 at all resonance settings (fc <= 7.3 kHz)
+  f = (coeff > 4096) ? 4096 : coeff;
+}
+
+void SIDFilter::updResonance(uint8_t res) { q = resonanceLUT[res & 0x0f]; }
+
+int32_t SIDFilter::clock(int32_t in) {
+  // Chamberlin state variable filter
+  lp += (bp * f) >> 12;
+  int32_t hp = in - lp - ((bp * q) >> 12);
+  bp += (hp * f) >> 12;
+  int32_t out = 0;
+  if (mode & 0x01) {
+    out += lp;
+  }
+  if (mode & 0x02) {
+    out += bp;
+  }
+  if (mode & 0x04) {
+    out += hp;
+  }
+  return out;
+}
+
+void SID::initSynthesis() {
+  c64Volume = 0.0f;
+  volume = 0;
+  voice2silent = false;
+  actEmuVolumeScaled = emuVolumeScaled.load(std::memory_order_acquire);
+  emuVolume = (float)(actEmuVolumeScaled * VOLUME_MULTIPLICATOR);
   for (uint8_t i = 0; i < 0x20; i++) {
-    sidreg[i] = 0;
+    synthreg[i] = 0;
   }
   for (int i = 0; i < 3; i++) {
     sidVoice[i].init();
+    sidVoiceFP[i].init();
   }
+  filter.init();
   sidVoice[0].voice = 0;
   sidVoice[1].voice = 1;
   sidVoice[2].voice = 2;
@@ -239,16 +584,55 @@ void SID::init() {
   sidVoice[0].prevVoice = &sidVoice[2];
   sidVoice[1].prevVoice = &sidVoice[0];
   sidVoice[2].prevVoice = &sidVoice[1];
+  sidVoiceFP[0].voice = 0;
+  sidVoiceFP[1].voice = 1;
+  sidVoiceFP[2].voice = 2;
+  sidVoiceFP[0].nextVoice = &sidVoiceFP[1];
+  sidVoiceFP[1].nextVoice = &sidVoiceFP[2];
+  sidVoiceFP[2].nextVoice = nullptr;
+  sidVoiceFP[0].prevVoice = &sidVoiceFP[2];
+  sidVoiceFP[1].prevVoice = &sidVoiceFP[0];
+  sidVoiceFP[2].prevVoice = &sidVoiceFP[1];
+  updMixScale();
+}
+
+void SID::init() {
+#ifdef HAS_DEFAULT_VOLUME
+  setEmuVolume(Config::DEFAULT_VOLUME);
+#else
+  setEmuVolume(128);
+#endif
+  for (uint8_t i = 0; i < 0x20; i++) {
+    sidreg[i] = 0;
+  }
+  envelope3.init();
+  pushLog({0, LOGRESET, 0});
 }
 
-SID::SID() {
-  sound = Sound::create();
-  sound->init();
+SID::SID() : SID(Sound::create()) {}
+
+SID::SID(SoundDriver *sound) : sound(sound) {
+  fixedpoint = Config::SIDFIXEDPOINT;
+  suppressed = false;
+  publishedseq.store(0, std::memory_order_release);
+  voicespending.store(false, std::memory_order_release);
+  this->sound->init();
   init();
+  // synthesis task is not running yet
+  SIDRegWrite entry;
+  while (reglog.pop(entry)) {
+  }
+  initSynthesis();
+  publishVoices();
+  actSampleIdx = 0;
+  for (uint16_t i = 0; i < NUMSAMPLESPERFRAME; i++) {
+    samples[i] = 0;
+  }
 }
 
 int16_t SID::generateSample() {
   float sample = 0.0f;
+  float filtered = 0.0f;
   uint8_t cnt = 0;
   for (int i = 0; i < 3; i++) {
     if (sidVoice[i].isActive()) {
@@ -256,39 +640,294 @@ int16_t SID::generateSample() {
     }
     float env = sidVoice[i].updateEnvelope();
     float sample0 = sidVoice[i].generateSample();
+#ifdef USE_SIDFILTER
+    if (filter.routing & (1 << i)) {
+      filtered += env * sample0;
+      continue;
+    }
+#endif
     if ((i == 2) && voice2silent) {
       sample0 = 0.0f;
     }
     sample += env * sample0;
   }
-  if (cnt == 0) {
-    return 0;
+#ifdef USE_SIDFILTER
+  // same scale as the fixed point engine (a voice is within +-16320)
+  if (filter.routing) {
+    sample += filter.clock((int32_t)(filtered * 16320.0f)) * (1.0f / 16320.0f);
   }
-  sample /= cnt;
-  return static_cast<int16_t>(sample * c64Volume * emuVolume);
+#endif
+  if (cnt > 1) {
+    sample /= cnt;
+  }
+  float out = (sample + DCOFFSET) * c64Volume * emuVolume;
+  if (out > 32767.0f) {
+    return 32767;
+  } else if (out < -32768.0f) {
+    return -32768;
+  }
+  return static_cast<int16_t>(out);
 }
 
-void SID::fillBuffer(uint16_t rasterline) {
-  voice2silent = sidreg[0x18] & 0x80;
-  uint16_t targetSampleIdx = rasterline * NUMSAMPLESPERFRAME / 312 + 1;
-  uint16_t numOfSamples = 2;
-  if (actSampleIdx < targetSampleIdx) {
-    numOfSamples++;
+// Scale factor of the fixed point mix: a voice sample (12 bit) multiplied by
+// its envelope (ENVMAX >> 16 = 65280 for 1.0) and shifted right by 12 is
+// within +-32640, multiplied with mixScale and shifted right by 15 this
+// gives the same output level as the float engine (c64Volume * emuVolume).
+void SID::updMixScale() {
+  int32_t volFactor = volume * actEmuVolumeScaled * VOLUME_MULTIPLICATOR;
+  mixScale = (int32_t)(((int64_t)volFactor << 16) / (15 * 65280));
+}
+
+int16_t SID::generateSampleFP() {
+  int32_t sample = 0;
+  int32_t filtered = 0;
+  uint8_t cnt = 0;
+  for (int i = 0; i < 3; i++) {
+    if (sidVoiceFP[i].isActive()) {
+      cnt++;
+    }
+    uint32_t env = sidVoiceFP[i].updateEnvelope() >> 16;
+    int32_t sample0 = sidVoiceFP[i].generateSample();
+#ifdef USE_SIDFILTER
+    if (filter.routing & (1 << i)) {
+      filtered += (sample0 * (int32_t)env) >> 13;
+      continue;
+    }
+#endif
+    if ((i == 2) && voice2silent) {
+      sample0 = 0;
+    }
+    sample += (sample0 * (int32_t)env) >> 12;
+  }
+#ifdef USE_SIDFILTER
+  // filter input at half scale to keep the state within 32 bit
+  if (filter.routing) {
+    sample += filter.clock(filtered) << 1;
+  }
+#endif
+  if (cnt == 2) {
+    sample >>= 1;
+  } else if (cnt == 3) {
+    sample = ((sample >> 2) * 21845) >> 14;
   }
-  for (uint8_t i = 0; i < numOfSamples; i++) {
-    samples[actSampleIdx + i] = generateSample();
+  sample += (int32_t)(DCOFFSET * 32640);
+  // 64 bit product: resonant filtered voices at full volume exceed 32 bit
+  int64_t out = ((int64_t)sample * mixScale) >> 15;
+  if (out > 32767) {
+    return 32767;
+  } else if (out < -32768) {
+    return -32768;
   }
-  actSampleIdx += numOfSamples;
+  return (int16_t)out;
 }
 
-void SID::playAudio() {
-  sound->playAudio(samples, NUMSAMPLESPERFRAME * sizeof(int16_t));
-  actSampleIdx = 0;
+void SID::generateSamples(int16_t *buffer, uint16_t numOfSamples) {
+  uint8_t vol = emuVolumeScaled.load(std::memory_order_acquire);
+  if (vol != actEmuVolumeScaled) {
+    actEmuVolumeScaled = vol;
+    emuVolume = (float)(actEmuVolumeScaled * VOLUME_MULTIPLICATOR);
+    updMixScale();
+  }
+  if (fixedpoint) {
+    for (uint16_t i = 0; i < numOfSamples; i++) {
+      buffer[i] = generateSampleFP();
+    }
+  } else {
+    for (uint16_t i = 0; i < numOfSamples; i++) {
+      buffer[i] = generateSample();
+    }
+  }
+}
+
+void SID::setReg(uint8_t sididx, uint8_t val) {
+  synthreg[sididx] = val;
+  // both engines are kept up to date, so the engine can be switched at any
+  // time
+  if (sididx <= 0x14) {
+    uint8_t voice = sididx / 7;
+    int regInVoice = sididx % 7;
+    switch (regInVoice) {
+    case 0:
+    case 1: {
+      uint16_t freq = synthreg[voice * 7] | (synthreg[1 + voice * 7] << 8);
+      sidVoice[voice].updVarFrequency(freq);
+      sidVoiceFP[voice].updVarFrequency(freq);
+      break;
+    }
+    case 2:
+    case 3: {
+      uint16_t pw = synthreg[2 + voice * 7] | (synthreg[3 + voice * 7] << 8);
+      sidVoice[voice].updVarPulseWidth(pw);
+      sidVoiceFP[voice].updVarPulseWidth(pw);
+      break;
+    }
+    case 4:
+      sidVoice[voice].updVarControl(val);
+      sidVoiceFP[voice].updVarControl(val);
+      break;
+    case 5:
+      sidVoice[voice].updVarEnvelopeAD(val);
+      sidVoiceFP[voice].updVarEnvelopeAD(val);
+      break;
+    case 6:
+      sidVoice[voice].updVarEnvelopeSR(val);
+      sidVoiceFP[voice].updVarEnvelopeSR(val);
+      break;
+    }
+  } else if ((sididx == 0x15) || (sididx == 0x16)) {
+    filter.updCutoff((synthreg[0x15] & 0x07) | (synthreg[0x16] << 3));
+  } else if (sididx == 0x17) {
+    filter.updResonance(val >> 4);
+    filter.routing = val & 0x07;
+  } else if (sididx == 0x18) {
+    volume = val & 0x0f;
+    filter.mode = (val >> 4) & 0x07;
+    voice2silent = val & 0x80;
+    c64Volume = (float)volume / 15.0;
+    updMixScale();
+  }
+}
+
+void SID::pushLog(const SIDRegWrite &entry) {
+#ifndef USE_NOSOUND
+  if (suppressed) {
+    return;
+  }
+  while (!reglog.push(entry)) {
+    // synthesis task is behind
+    PlatformManager::getInstance().waitUS(100);
+  }
+#endif
 }
 
-uint8_t SID::getEmuVolume() { return emuVolumeScaled; }
+void SID::writeReg(uint8_t sididx, uint8_t val, uint16_t cycle) {
+  sidreg[sididx] = val;
+  if (sididx == 0x12) {
+    envelope3.setControl(val);
+  } else if (sididx == 0x13) {
+    envelope3.setAttackDecay(val);
+  } else if (sididx == 0x14) {
+    envelope3.setSustainRelease(val);
+  }
+  pushLog({cycle, sididx, val});
+}
+
+void SID::endFrame(uint8_t capturesession) {
+  pushLog({NUMCYCLESPERFRAME, LOGENDOFFRAME, capturesession});
+}
+
+uint8_t SID::getEmuVolume() {
+  return emuVolumeScaled.load(std::memory_order_acquire);
+}
 
 void SID::setEmuVolume(uint8_t volume) {
-  emuVolumeScaled = volume;
-  emuVolume = (float)(emuVolumeScaled * VOLUME_MULTIPLICATOR);
+  emuVolumeScaled.store(volume, std::memory_order_release);
+}
+
+void SID::setSuppressed(bool suppressed) { this->suppressed = suppressed; }
+
+void SID::saveState(State &state) const {
+  memcpy(state.sidreg, sidreg, sizeof(sidreg));
+  state.envelope3 = envelope3;
+}
+
+void SID::loadState(const State &state) {
+  memcpy(sidreg, state.sidreg, sizeof(sidreg));
+  envelope3 = state.envelope3;
+}
+
+void SID::saveVoiceState(SIDVoiceState &state) {
+  // state of the last frame rendered by the synthesis task
+  uint32_t seq;
+  do {
+    seq = publishedseq.load(std::memory_order_acquire);
+    memcpy(&state, &publishedvoices, sizeof(state));
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || (seq != publishedseq.load(std::memory_order_relaxed)));
+}
+
+void SID::loadVoiceState(const SIDVoiceState &state) {
+#ifndef USE_NOSOUND
+  // wait until a previous load is done by the synthesis task
+  while (voicespending.load(std::memory_order_acquire)) {
+    PlatformManager::getInstance().waitMS(1);
+  }
+  memcpy(&pendingvoices, &state, sizeof(pendingvoices));
+  voicespending.store(true, std::memory_order_release);
+  // reset synthesis, apply the actual registers, then the voice state
+  pushLog({0, LOGRESET, 0});
+  for (uint8_t i = 0; i <= 0x18; i++) {
+    pushLog({0, i, sidreg[i]});
+  }
+  pushLog({0, LOGLOADVOICES, 0});
+#endif
+}
+
+void SID::publishVoices() {
+  uint32_t seq = publishedseq.load(std::memory_order_relaxed);
+  publishedseq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(publishedvoices.voice, sidVoice, sizeof(sidVoice));
+  memcpy(publishedvoices.voiceFP, sidVoiceFP, sizeof(sidVoiceFP));
+  memcpy(&publishedvoices.filter, &filter, sizeof(filter));
+  publishedseq.store(seq + 2, std::memory_order_release);
+}
+
+void SID::loadPendingVoices() {
+  for (uint8_t i = 0; i < 3; i++) {
+    // keep the links between the voices
+    SIDVoice *nextVoice = sidVoice[i].nextVoice;
+    SIDVoice *prevVoice = sidVoice[i].prevVoice;
+    sidVoice[i] = pendingvoices.voice[i];
+    sidVoice[i].nextVoice = nextVoice;
+    sidVoice[i].prevVoice = prevVoice;
+    SIDVoiceFP *nextVoiceFP = sidVoiceFP[i].nextVoice;
+    SIDVoiceFP *prevVoiceFP = sidVoiceFP[i].prevVoice;
+    sidVoiceFP[i] = pendingvoices.voiceFP[i];
+    sidVoiceFP[i].nextVoice = nextVoiceFP;
+    sidVoiceFP[i].prevVoice = prevVoiceFP;
+  }
+  filter = pendingvoices.filter;
+  voicespending.store(false, std::memory_order_release);
+}
+
+int16_t SID::getFillLevel() { return sound->getFillLevel(); }
+
+void SID::logPerfValues() { sound->logPerfValues(); }
+
+void SID::run() {
+  // synthesis task: renders the samples of a frame and applies the logged
+  // register writes at their sample position
+  SIDRegWrite entry;
+  while (true) {
+    if (!reglog.pop(entry)) {
+      PlatformManager::getInstance().waitMS(1);
+      continue;
+    }
+    uint16_t sampleIdx =
+        (uint32_t)entry.cycle * NUMSAMPLESPERFRAME / NUMCYCLESPERFRAME;
+    if (sampleIdx > NUMSAMPLESPERFRAME) {
+      sampleIdx = NUMSAMPLESPERFRAME;
+    }
+    if (sampleIdx > actSampleIdx) {
+      generateSamples(&samples[actSampleIdx], sampleIdx - actSampleIdx);
+      actSampleIdx = sampleIdx;
+    }
+    if (entry.reg == LOGENDOFFRAME) {
+#ifdef USE_CAPTURE
+      if (entry.val && capture) {
+        capture->captureAudio(samples, entry.val);
+      }
+#endif
+      sound->playAudio(samples, NUMSAMPLESPERFRAME * sizeof(int16_t));
+      actSampleIdx = 0;
+      publishVoices();
+    } else if (entry.reg == LOGRESET) {
+      initSynthesis();
+    } else if (entry.reg == LOGLOADVOICES) {
+      loadPendingVoices();
+    } else {
+      setReg(entry.reg, entry.val);
+    }
+  }
 }
@@ -18,8 +18,11 @@
 #define SID_H
 
 #include "Config.h"
+#include "SPSCRing.h"
 #include "sound/SoundDriver.h"
+#include <atomic>
 #include <cstdint>
+#include <memory>
 
 class SIDVoice {
 private:
@@ -32,6 +35,8 @@ private:
   float attackAdd;
   float decayAdd;
   float releaseAdd;
+  // decay nibble of AD, the decay rate depends on the sustain level of SR
+  uint8_t decay;
   ADSRState adsrState;
   float noiseValue;
   uint32_t lfsr;
@@ -40,6 +45,7 @@ private:
 
   void nextLFSR();
   float getNoiseNormalized() const;
+  void updDecayAdd();
 
 public:
   uint8_t control;
@@ -61,31 +67,196 @@ public:
   float generateSample();
 };
 
+// fixed point variant of SIDVoice (24 bit phase accumulator, integer
+// envelope with rate tables)
+class SIDVoiceFP {
+private:
+  enum ADSRState { ATTACK, DECAY, SUSTAIN, RELEASE, IDLE };
+
+  // upper 24 bits: accumulator of the SID, lower 8 bits: fraction
+  uint32_t accumulator;
+  uint32_t accIncrement;
+  uint16_t pulseWidth;
+  uint32_t sustainLevel;
+  uint32_t attackStep;
+  uint32_t decayStep;
+  uint32_t releaseStep;
+  // decay nibble of AD, the decay step depends on the sustain level of SR
+  uint8_t decay;
+  ADSRState adsrState;
+  int16_t noiseValue;
+  uint32_t lfsr;
+  bool syncNextVoice;
+  bool ringmod;
+
+  void nextLFSR();
+  int16_t getNoise() const;
+  void updDecayStep();
+
+public:
+  // envelope: 0xff000000 corresponds to 1.0
+  static const uint32_t ENVMAX = 0xff000000;
+
+  uint8_t control;
+  uint8_t voice;
+  uint32_t envelope;
+  SIDVoiceFP *nextVoice;
+  SIDVoiceFP *prevVoice;
+
+  SIDVoiceFP();
+  void init();
+  bool isActive();
+  void updVarFrequency(uint16_t freq);
+  void updVarPulseWidth(uint16_t pw);
+  void updVarEnvelopeAD(uint8_t val);
+  void updVarEnvelopeSR(uint8_t val);
+  void updVarControl(uint8_t val);
+  uint32_t updateEnvelope();
+  int16_t generateSample();
+};
+
+// 2-pole state variable filter (fixed point, coefficients in Q12)
+class SIDFilter {
+private:
+  int32_t lp;
+  int32_t bp;
+  int32_t f; // cutoff: 2 * sin(pi * fc / fs)
+  int32_t q; // damping: 1 / Q
+
+public:
+  uint8_t routing; // bit 0-2: voice is routed through the filter
+  uint8_t mode;    // bit 0: low pass, bit 1: band pass, bit 2: high pass
+
+  SIDFilter();
+  void init();
+  void updCutoff(uint16_t fc);
+  void updResonance(uint8_t res);
+  int32_t clock(int32_t in);
+};
+
+// envelope generator of voice 3 as read by the CPU (register 0x1c), clocked
+// by the emulation (rate counter periods in cycles and exponential decay of
+// the SID), so the value does not depend on the synthesis task
+class SIDEnvelope {
+private:
+  enum ADSRState : uint8_t { ATTACK, DECAYSUSTAIN, RELEASE };
+
+  uint16_t ratecounter;
+  uint8_t expcounter;
+  ADSRState state;
+  uint8_t attackdecay;
+  uint8_t sustainrelease;
+
+public:
+  uint8_t level;
+
+  void init();
+  void setControl(uint8_t val);
+  void setAttackDecay(uint8_t val) { attackdecay = val; }
+  void setSustainRelease(uint8_t val) { sustainrelease = val; }
+  void clock(uint8_t cycles);
+};
+
+// SID register write (or control entry) in the register log
+struct SIDRegWrite {
+  uint16_t cycle; // cycle within the frame
+  uint8_t reg;
+  uint8_t val;
+};
+
+class Capture; // forward declaration
+
+// state of the SID synthesis (see SID::saveVoiceState)
+struct SIDVoiceState {
+  SIDVoice voice[3];
+  SIDVoiceFP voiceFP[3];
+  SIDFilter filter;
+};
+
 class SID {
 private:
   static constexpr uint8_t VOLUME_MULTIPLICATOR = 120;
   static const uint16_t NUMSAMPLESPERFRAME = AUDIO_SAMPLE_RATE / 50;
+  static const uint16_t NUMCYCLESPERFRAME = 63 * 312;
+  // control entries of the register log
+  static const uint8_t LOGENDOFFRAME = 0x20;
+  static const uint8_t LOGRESET = 0x21;
+  static const uint8_t LOGLOADVOICES = 0x22;
+  // dc offset of the SID output (makes $d418 digis audible)
+  static constexpr float DCOFFSET = 0.125f;
+
+  // CPU side
+  SPSCRing<SIDRegWrite, 4096> reglog;
+  bool suppressed;
+  std::atomic<uint8_t> emuVolumeScaled;
+  SIDEnvelope envelope3;
+  // synthesis state published at the end of each frame (seqlock, odd
+  // sequence number: update in progress) resp. to be loaded
+  SIDVoiceState publishedvoices;
+  std::atomic<uint32_t> publishedseq;
+  SIDVoiceState pendingvoices;
+  std::atomic<bool> voicespending;
+
+  // synthesis side
   int16_t samples[NUMSAMPLESPERFRAME];
-  SoundDriver *sound;
+  std::unique_ptr<SoundDriver> sound;
   uint16_t actSampleIdx;
   bool voice2silent;
+  uint8_t volume;
+  uint8_t actEmuVolumeScaled;
+  uint8_t synthreg[0x20];
+  float c64Volume;
+  float emuVolume;
+  int32_t mixScale;
 
+  void initSynthesis();
+  void publishVoices();
+  void loadPendingVoices();
+  void pushLog(const SIDRegWrite &entry);
   int16_t generateSample();
+  int16_t generateSampleFP();
+  void updMixScale();
 
 public:
+  // state of the SID as seen by the CPU (see class Snapshot)
+  struct State {
+    uint8_t sidreg[0x20];
+    SIDEnvelope envelope3;
+  };
+
   SIDVoice sidVoice[3];
-  float c64Volume;
-  float emuVolume;
-  uint8_t emuVolumeScaled;
+  SIDVoiceFP sidVoiceFP[3];
+  SIDFilter filter;
   uint8_t sidreg[0x20];
+  bool fixedpoint;
+  Capture *capture = nullptr;
 
   SID();
+  // takes the ownership of the sound driver (offline rendering: NoSound)
+  explicit SID(SoundDriver *sound);
+
+  // CPU side: register writes are logged with their cycle within the frame
+  // and applied by the synthesis task at the corresponding sample position
   void init();
-  void startSound(uint8_t voice, uint8_t val);
-  void stopSound(uint8_t voice);
-  void fillBuffer(uint16_t rasterline);
-  void playAudio();
+  void writeReg(uint8_t sididx, uint8_t val, uint16_t cycle);
+  void endFrame(uint8_t capturesession = 0);
+  // advances the envelope of voice 3 (called once per rasterline)
+  void clockEnvelope3(uint8_t cycles) { envelope3.clock(cycles); }
+  uint8_t getEnvelope3() const { return envelope3.level; }
   uint8_t getEmuVolume();
   void setEmuVolume(uint8_t volume);
+  int16_t getFillLevel();
+  void logPerfValues();
+  // suppress audio output (register writes are not logged)
+  void setSuppressed(bool suppressed);
+  void saveState(State &state) const;
+  void loadState(const State &state);
+  void saveVoiceState(SIDVoiceState &state);
+  void loadVoiceState(const SIDVoiceState &state);
+
+  // synthesis side
+  void run();
+  void setReg(uint8_t sididx, uint8_t val);
+  void generateSamples(int16_t *buffer, uint16_t numOfSamples);
 };
 #endif // SID_H
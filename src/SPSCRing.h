@@ -0,0 +1,163 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Lock-free ring buffer for exactly one producer and one consumer
+ * thread.
+ *
+ * @tparam T Element type (trivially copyable).
+ * @tparam N Capacity, must be a power of 2.
+ */
+template <typename T, uint32_t N> class SPSCRing {
+private:
+  static_assert((N & (N - 1)) == 0, "capacity must be a power of 2");
+  T buffer[N];
+  // head is only written by the producer, tail only by the consumer
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+
+public:
+  /**
+   * @brief Appends an element (producer side).
+   *
+   * @return false if the ring is full.
+   */
+  bool push(const T &item) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    buffer[h & (N - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Removes the oldest element (consumer side).
+   *
+   * @return false if the ring is empty.
+   */
+  bool pop(T &item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) {
+      return false;
+    }
+    item = buffer[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Appends up to n elements (producer side, bulk copy).
+   *
+   * @return Number of elements actually appended.
+   */
+  uint32_t push(const T *items, uint32_t n) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t free = N - (h - tail.load(std::memory_order_acquire));
+    if (n > free) {
+      n = free;
+    }
+    uint32_t idx = h & (N - 1);
+    uint32_t first = (n < N - idx) ? n : N - idx;
+    memcpy(&buffer[idx], items, first * sizeof(T));
+    memcpy(&buffer[0], items + first, (n - first) * sizeof(T));
+    head.store(h + n, std::memory_order_release);
+    return n;
+  }
+
+  /**
+   * @brief Removes up to n elements (consumer side, bulk copy).
+   *
+   * @return Number of elements actually removed.
+   */
+  uint32_t pop(T *items, uint32_t n) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t avail = head.load(std::memory_order_acquire) - t;
+    if (n > avail) {
+      n = avail;
+    }
+    uint32_t idx = t & (N - 1);
+    uint32_t first = (n < N - idx) ? n : N - idx;
+    memcpy(items, &buffer[idx], first * sizeof(T));
+    memcpy(items + first, &buffer[0], (n - first) * sizeof(T));
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  /**
+   * @brief Returns the slot of the next element to be appended (producer
+   * side), the element is appended by calling commit().
+   *
+   * Avoids copying large elements.
+   *
+   * @return nullptr if the ring is full.
+   */
+  T *reserve() {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N) {
+      return nullptr;
+    }
+    return &buffer[h & (N - 1)];
+  }
+
+  /**
+   * @brief Appends the element returned by reserve() (producer side).
+   */
+  void commit() {
+    head.store(head.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  /**
+   * @brief Returns the oldest element without removing it (consumer side),
+   * the element is removed by calling release().
+   *
+   * @return nullptr if the ring is empty.
+   */
+  T *front() {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) {
+      return nullptr;
+    }
+    return &buffer[t & (N - 1)];
+  }
+
+  /**
+   * @brief Removes the element returned by front() (consumer side).
+   */
+  void release() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+  }
+
+  /**
+   * @brief Returns the number of elements currently stored.
+   */
+  uint32_t size() const {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,260 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "SaveState.h"
+#include "C64Sys.h"
+#include "Config.h"
+#include "Floppy.h"
+#include "LZ.h"
+#include "Snapshot.h"
+#include "platform/PlatformManager.h"
+#include <cstring>
+#include <memory>
+
+static const char *TAG = "SaveState";
+
+static const char MAGIC[4] = {'C', '6', '4', 'S'};
+static const uint8_t NUMOFCHUNKS = 9;
+// space for unknown chunks of a save state (see maxPayloadSize)
+static const uint32_t MAXUNKNOWNCHUNKS = 4096;
+
+static void put16(std::vector<uint8_t> &out, uint16_t val) {
+  out.push_back(val & 0xff);
+  out.push_back(val >> 8);
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t val) {
+  for (uint8_t i = 0; i < 4; i++) {
+    out.push_back((val >> (i * 8)) & 0xff);
+  }
+}
+
+static uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t maxPayloadSize() {
+  // the chunks written by serialize (upper bound) and unknown chunks
+  return sizeof(Snapshot) + sizeof(SIDVoiceState) + sizeof(Floppy::State) +
+         NUMOFCHUNKS * 8 + MAXUNKNOWNCHUNKS;
+}
+
+void SaveState::addChunk(std::vector<uint8_t> &payload, const char *id,
+                         const void *data, uint32_t size) {
+  payload.insert(payload.end(), id, id + 4);
+  put32(payload, size);
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  payload.insert(payload.end(), bytes, bytes + size);
+}
+
+const uint8_t *SaveState::findChunk(const std::vector<uint8_t> &payload,
+                                    const char *id, uint32_t size) {
+  size_t pos = 0;
+  while (pos + 8 <= payload.size()) {
+    uint32_t chunksize = get32(&payload[pos + 4]);
+    if (chunksize > payload.size() - pos - 8) {
+      break;
+    }
+    if (memcmp(&payload[pos], id, 4) == 0) {
+      if (chunksize != size) {
+        PlatformManager::getInstance().log(
+            LOG_ERROR, TAG, "chunk %.4s: size %lu, expected %lu", id,
+            (unsigned long)chunksize, (unsigned long)size);
+        return nullptr;
+      }
+      return &payload[pos + 8];
+    }
+    pos += 8 + chunksize;
+  }
+  PlatformManager::getInstance().log(LOG_ERROR, TAG, "chunk %.4s missing", id);
+  return nullptr;
+}
+
+void SaveState::serialize(C64Sys &sys, std::vector<uint8_t> &out,
+                          bool compress) {
+  std::unique_ptr<Snapshot> snapshot(new Snapshot());
+  std::unique_ptr<SIDVoiceState> voices(new SIDVoiceState());
+  std::unique_ptr<Floppy::State> floppy(new Floppy::State());
+  sys.saveState(*snapshot);
+  sys.sid.saveVoiceState(*voices);
+  sys.floppy.saveState(*floppy);
+  std::vector<uint8_t> payload;
+  payload.reserve(maxPayloadSize());
+  addChunk(payload, "CPU ", &snapshot->cpu, sizeof(snapshot->cpu));
+  addChunk(payload, "VIC ", &snapshot->vic, sizeof(snapshot->vic));
+  addChunk(payload, "CIA1", &snapshot->cia1, sizeof(snapshot->cia1));
+  addChunk(payload, "CIA2", &snapshot->cia2, sizeof(snapshot->cia2));
+  addChunk(payload, "SID ", &snapshot->sid, sizeof(snapshot->sid));
+  addChunk(payload, "SIDV", voices.get(), sizeof(SIDVoiceState));
+  addChunk(payload, "RAM ", snapshot->ram, sizeof(snapshot->ram));
+  addChunk(payload, "COLR", snapshot->colorram, sizeof(snapshot->colorram));
+  addChunk(payload, "FLPY", floppy.get(), sizeof(Floppy::State));
+  std::vector<uint8_t> compressed;
+  if (compress) {
+    LZ::compress(payload.data(), payload.size(), compressed);
+    if (compressed.size() >= payload.size()) {
+      compress = false;
+    }
+  }
+  const std::vector<uint8_t> &data = compress ? compressed : payload;
+  out.clear();
+  out.reserve(HEADERSIZE + data.size());
+  out.insert(out.end(), MAGIC, MAGIC + 4);
+  put16(out, VERSION);
+  put16(out, compress ? FLAGCOMPRESSED : 0);
+  put32(out, payload.size());
+  out.insert(out.end(), data.begin(), data.end());
+}
+
+bool SaveState::deserialize(C64Sys &sys, const uint8_t *data, size_t len) {
+  if ((len < HEADERSIZE) || (memcmp(data, MAGIC, 4) != 0)) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG, "not a save state");
+    return false;
+  }
+  uint16_t version = get16(data + 4);
+  if (version != VERSION) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "unsupported version %d", version);
+    return false;
+  }
+  uint16_t flags = get16(data + 6);
+  uint32_t payloadsize = get32(data + 8);
+  // the size is checked before the payload is allocated
+  if (payloadsize > maxPayloadSize()) {
+    PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                       "payload too large (%lu bytes)",
+                                       (unsigned long)payloadsize);
+    return false;
+  }
+  std::vector<uint8_t> payload;
+  if (flags & FLAGCOMPRESSED) {
+    // decompress fails if the decompressed length differs from payloadsize
+    payload.resize(payloadsize);
+    if (!LZ::decompress(data + HEADERSIZE, len - HEADERSIZE, payload.data(),
+                        payloadsize)) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG,
+                                         "corrupt compressed data");
+      return false;
+    }
+  } else {
+    if (len - HEADERSIZE != payloadsize) {
+      PlatformManager::getInstance().log(LOG_ERROR, TAG, "truncated file");
+      return false;
+    }
+    payload.assign(data + HEADERSIZE, data + len);
+  }
+  // check all chunks before anything is changed
+  std::unique_ptr<Snapshot> snapshot(new Snapshot());
+  const uint8_t *cpu = findChunk(payload, "CPU ", sizeof(snapshot->cpu));
+  const uint8_t *vic = findChunk(payload, "VIC ", sizeof(snapshot->vic));
+  const uint8_t *cia1 = findChunk(payload, "CIA1", sizeof(snapshot->cia1));
+  const uint8_t *cia2 = findChunk(payload, "CIA2", sizeof(snapshot->cia2));
+  const uint8_t *sid = findChunk(payload, "SID ", sizeof(snapshot->sid));
+  const uint8_t *voices = findChunk(payload, "SIDV", sizeof(SIDVoiceState));
+  const uint8_t *ram = findChunk(payload, "RAM ", sizeof(snapshot->ram));
+  const uint8_t *colorram =
+      findChunk(payload, "COLR", sizeof(snapshot->colorram));
+  const uint8_t *floppy = findChunk(payload, "FLPY", sizeof(Floppy::State));
+  if (!cpu || !vic || !cia1 || !cia2 || !sid || !voices || !ram || !colorram ||
+      !floppy) {
+    return false;
+  }
+  memcpy(&snapshot->cpu, cpu, sizeof(snapshot->cpu));
+  memcpy(&snapshot->vic, vic, sizeof(snapshot->vic));
+  memcpy(&snapshot->cia1, cia1, sizeof(snapshot->cia1));
+  memcpy(&snapshot->cia2, cia2, sizeof(snapshot->cia2));
+  memcpy(&snapshot->sid, sid, sizeof(snapshot->sid));
+  memcpy(snapshot->ram, ram, sizeof(snapshot->ram));
+  memcpy(snapshot->colorram, colorram, sizeof(snapshot->colorram));
+  std::unique_ptr<SIDVoiceState> voicestate(new SIDVoiceState());
+  memcpy(voicestate.get(), voices, sizeof(SIDVoiceState));
+  std::unique_ptr<Floppy::State> floppystate(new Floppy::State());
+  memcpy(floppystate.get(), floppy, sizeof(Floppy::State));
+  // the floppy first, the d64 file may be missing
+  if (!sys.floppy.loadState(*floppystate)) {
+    return false;
+  }
+  sys.loadState(*snapshot);
+  sys.sid.loadVoiceState(*voicestate);
+  return true;
+}
+
+bool SaveState::save(C64Sys &sys, const std::string &name, bool compress) {
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  std::vector<uint8_t> out;
+  serialize(sys, out, compress);
+  int64_t serialized = platform.getTimeUS();
+  // one buffered write
+  std::string path = Config::PATH + name + EXTENSION;
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "wb")) {
+    platform.log(LOG_ERROR, TAG, "cannot open file %s", path.c_str());
+    return false;
+  }
+  bool success = file.write(out.data(), out.size()) == out.size();
+  file.close();
+  if (!success) {
+    platform.log(LOG_ERROR, TAG, "could not write file %s", path.c_str());
+    return false;
+  }
+  int64_t end = platform.getTimeUS();
+  platform.log(LOG_INFO, TAG,
+               "state saved to %s: %lu bytes, serialize: %lu us, write: %lu us",
+               path.c_str(), (unsigned long)out.size(),
+               (unsigned long)(serialized - start),
+               (unsigned long)(end - serialized));
+  return true;
+}
+
+bool SaveState::load(C64Sys &sys, const std::string &name) {
+  Platform &platform = PlatformManager::getInstance();
+  int64_t start = platform.getTimeUS();
+  std::string path = Config::PATH + name + EXTENSION;
+  FileDriver &file = *Floppy::sysfile;
+  if (!file.open(path, "rb")) {
+    platform.log(LOG_ERROR, TAG, "cannot open file %s", path.c_str());
+    return false;
+  }
+  int64_t size = file.size();
+  if ((size <= 0) || (size > HEADERSIZE + maxPayloadSize())) {
+    file.close();
+    platform.log(LOG_ERROR, TAG, "not a save state: %s", path.c_str());
+    return false;
+  }
+  std::vector<uint8_t> in(size);
+  bool success = file.read(in.data(), size) == (size_t)size;
+  file.close();
+  if (!success) {
+    platform.log(LOG_ERROR, TAG, "could not read file %s", path.c_str());
+    return false;
+  }
+  int64_t read = platform.getTimeUS();
+  if (!deserialize(sys, in.data(), in.size())) {
+    platform.log(LOG_ERROR, TAG, "could not load state from %s",
+                 path.c_str());
+    return false;
+  }
+  int64_t end = platform.getTimeUS();
+  platform.log(LOG_INFO, TAG,
+               "state loaded from %s: %lu bytes, read: %lu us, "
+               "deserialize: %lu us",
+               path.c_str(), (unsigned long)in.size(),
+               (unsigned long)(read - start), (unsigned long)(end - read));
+  return true;
+}
@@ -0,0 +1,58 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class C64Sys; // forward declaration
+
+// Save states of the whole machine (see struct Snapshot) incl. the SID
+// synthesis and the floppy state in a versioned, chunked binary format:
+// - header: magic "C64S", version (uint16), flags (uint16, bit 0: payload is
+//   LZ compressed), size of the uncompressed payload (uint32), little endian
+// - payload: chunks, each consisting of an id (4 chars), the size of the
+//   data (uint32, little endian) and the data
+// The chunk data are the state structs of the components in host layout, so
+// save states can only be exchanged between builds with the same struct
+// layout (the version and the size of each chunk are checked). Unknown
+// chunks are skipped.
+class SaveState {
+private:
+  static const uint16_t VERSION = 6;
+  static const uint16_t FLAGCOMPRESSED = 1;
+  static const uint8_t HEADERSIZE = 12;
+
+  static void addChunk(std::vector<uint8_t> &payload, const char *id,
+                       const void *data, uint32_t size);
+  static const uint8_t *findChunk(const std::vector<uint8_t> &payload,
+                                  const char *id, uint32_t size);
+
+public:
+  static constexpr const char *EXTENSION = ".c64s";
+
+  static void serialize(C64Sys &sys, std::vector<uint8_t> &out,
+                        bool compress);
+  static bool deserialize(C64Sys &sys, const uint8_t *data, size_t len);
+  static bool save(C64Sys &sys, const std::string &name, bool compress);
+  static bool load(C64Sys &sys, const std::string &name);
+};
+
+#endif // SAVESTATE_H
@@ -0,0 +1,63 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "CIA.h"
+#include "SID.h"
+#include "VIC.h"
+#include <cstdint>
+
+// Machine state of the C64: CPU, memory configuration, VIC, CIAs, SID
+// registers, ram and color ram. ROMs and host side state (drivers,
+// caches, statistics, SID synthesis) are not part of the snapshot. Taken and
+// restored by C64Sys::saveState resp. C64Sys::loadState.
+struct Snapshot {
+  // CPU, memory configuration, NMI
+  struct CPUState {
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t sr;
+    uint16_t pc;
+    bool cflag;
+    bool zflag;
+    bool dflag;
+    bool bflag;
+    bool vflag;
+    bool nflag;
+    bool iflag;
+    bool cpuhalted;
+    uint8_t numofcycles;
+    uint8_t adjustcycles;
+    uint8_t register1;
+    bool nmiAck;
+    bool restorenmi;
+    uint32_t randomstate;
+  };
+
+  CPUState cpu;
+  VIC::State vic;
+  CIA::State cia1;
+  CIA::State cia2;
+  SID::State sid;
+  uint8_t ram[1 << 16];
+  uint8_t colorram[1024];
+};
+
+#endif // SNAPSHOT_H
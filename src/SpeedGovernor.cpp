@@ -0,0 +1,98 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "SpeedGovernor.h"
+#include "platform/PlatformManager.h"
+
+static const char *TAG = "SpeedGovernor";
+
+SpeedGovernor::SpeedGovernor()
+    : framestart(0), frameus(FRAMEUS), avgfill(1000), numofsyncs(0),
+      jittersum(0), jittermax(0), numofresyncs(0), actfill(-1),
+      actframeus(FRAMEUS) {}
+
+void SpeedGovernor::init() {
+  framestart = PlatformManager::getInstance().getTimeUS();
+  frameus = FRAMEUS;
+  avgfill = 1000;
+}
+
+uint32_t SpeedGovernor::sync(uint16_t rasterline) {
+  Platform &platform = PlatformManager::getInstance();
+  int64_t deadline =
+      framestart + (int64_t)frameus * (rasterline + 1) / LINESPERFRAME;
+  int64_t now = platform.getTimeUS();
+  uint32_t waited = 0;
+  if (deadline > now) {
+    // hybrid wait: sleep most of the time, wait the rest precisely
+    waited = deadline - now;
+    if (waited > SPINUS + 1000) {
+      platform.waitMS((waited - SPINUS) / 1000);
+    }
+    now = platform.getTimeUS();
+    if (deadline > now) {
+      platform.waitUS(deadline - now);
+      now = platform.getTimeUS();
+    }
+    uint32_t jitter = (now > deadline) ? now - deadline : 0;
+    jittersum.fetch_add(jitter, std::memory_order_release);
+    if (jitter > jittermax.load(std::memory_order_acquire)) {
+      jittermax.store(jitter, std::memory_order_release);
+    }
+  } else if (now - deadline > MAXLAGUS) {
+    // too slow (or emulation was paused) -> don't try to catch up
+    framestart += now - deadline;
+    numofresyncs.fetch_add(1, std::memory_order_release);
+  }
+  numofsyncs.fetch_add(1, std::memory_order_release);
+  if (rasterline == LINESPERFRAME - 1) {
+    framestart += frameus;
+  }
+  return waited;
+}
+
+void SpeedGovernor::adjust(int16_t fill) {
+  actfill.store(fill, std::memory_order_release);
+  if (fill < 0) {
+    // no audio clock available
+    frameus = FRAMEUS;
+  } else {
+    // buffer too full -> slow down, buffer too empty -> speed up
+    avgfill += (fill - avgfill) / 8;
+    int32_t adjustus = (avgfill - 1000) / 5;
+    if (adjustus > MAXADJUSTUS) {
+      adjustus = MAXADJUSTUS;
+    } else if (adjustus < -MAXADJUSTUS) {
+      adjustus = -MAXADJUSTUS;
+    }
+    frameus = FRAMEUS + adjustus;
+  }
+  actframeus.store(frameus, std::memory_order_release);
+}
+
+void SpeedGovernor::logPerfValues() {
+  uint32_t syncs = numofsyncs.exchange(0, std::memory_order_acq_rel);
+  uint32_t sum = jittersum.exchange(0, std::memory_order_acq_rel);
+  PlatformManager::getInstance().log(
+      LOG_INFO, TAG,
+      "frame: %ld us, audio fill: %d, jitter avg: %lu us, max: %lu us, "
+      "resyncs: %lu",
+      (long)actframeus.load(std::memory_order_acquire),
+      actfill.load(std::memory_order_acquire),
+      (unsigned long)(syncs > 0 ? sum / syncs : 0),
+      (unsigned long)jittermax.exchange(0, std::memory_order_acq_rel),
+      (unsigned long)numofresyncs.exchange(0, std::memory_order_acq_rel));
+}
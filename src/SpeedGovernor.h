@@ -0,0 +1,61 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef SPEEDGOVERNOR_H
+#define SPEEDGOVERNOR_H
+
+#include <atomic>
+#include <cstdint>
+
+// Keeps the emulation at C64 speed. The emulation task synchronizes with
+// the host clock a few times per frame only (instead of after each
+// rasterline). The frame period is fine tuned by the fill level of the
+// audio output buffer, so emulation and audio clock cannot drift apart.
+class SpeedGovernor {
+private:
+  static const int32_t FRAMEUS = 20000; // 882 samples at 44.1 kHz
+  static const uint16_t LINESPERFRAME = 312;
+  // remaining time waited with waitUS (spin on ESP32) instead of waitMS
+  static const int32_t SPINUS = 1000;
+  // max. correction of the frame period (0.5%, not audible)
+  static const int32_t MAXADJUSTUS = 100;
+  // lag after which the governor gives up to catch up
+  static const int64_t MAXLAGUS = 2 * FRAMEUS;
+
+  int64_t framestart; // nominal start time of actual frame
+  int32_t frameus;    // actual frame period
+  int32_t avgfill;    // smoothed audio fill level (permille)
+
+  // jitter statistics (reset by logPerfValues)
+  std::atomic<uint32_t> numofsyncs;
+  std::atomic<uint32_t> jittersum;
+  std::atomic<uint32_t> jittermax;
+  std::atomic<uint32_t> numofresyncs;
+  std::atomic<int16_t> actfill;
+  std::atomic<int32_t> actframeus;
+
+public:
+  // sync with host clock every LINESPERSYNC rasterlines
+  static const uint16_t LINESPERSYNC = 78;
+
+  SpeedGovernor();
+  void init();
+  uint32_t sync(uint16_t rasterline);
+  void adjust(int16_t fill);
+  void logPerfValues();
+};
+
+#endif // SPEEDGOVERNOR_H
@@ -0,0 +1,184 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "VIA.h"
+
+void VIA::init() {
+  ora = 0;
+  orb = 0;
+  ddra = 0;
+  ddrb = 0;
+  acr = 0;
+  pcr = 0;
+  ifr = 0;
+  ier = 0;
+  pain = 0xff;
+  pbin = 0xff;
+  timer1 = 0xffff;
+  timer2 = 0xffff;
+  latch1lo = 0xff;
+  latch1hi = 0xff;
+  latch2lo = 0xff;
+  timer1running = false;
+  timer2running = false;
+  ca1 = true;
+}
+
+uint8_t VIA::getReg(uint8_t idx) {
+  switch (idx & 0x0f) {
+  case 0x00:
+    ifr &= ~0x18; // CB1, CB2
+    return (orb & ddrb) | (pbin & ~ddrb);
+  case 0x01:
+    ifr &= ~0x03; // CA1, CA2
+    return (ora & ddra) | (pain & ~ddra);
+  case 0x02:
+    return ddrb;
+  case 0x03:
+    return ddra;
+  case 0x04:
+    ifr &= ~0x40;
+    return timer1 & 0xff;
+  case 0x05:
+    return timer1 >> 8;
+  case 0x06:
+    return latch1lo;
+  case 0x07:
+    return latch1hi;
+  case 0x08:
+    ifr &= ~0x20;
+    return timer2 & 0xff;
+  case 0x09:
+    return timer2 >> 8;
+  case 0x0a:
+    return 0;
+  case 0x0b:
+    return acr;
+  case 0x0c:
+    return pcr;
+  case 0x0d:
+    return (ifr & 0x7f) | (irq() ? 0x80 : 0);
+  case 0x0e:
+    return ier | 0x80;
+  default: // 0x0f: port A without handshake
+    return (ora & ddra) | (pain & ~ddra);
+  }
+}
+
+void VIA::setReg(uint8_t idx, uint8_t val) {
+  switch (idx & 0x0f) {
+  case 0x00:
+    ifr &= ~0x18;
+    orb = val;
+    break;
+  case 0x01:
+    ifr &= ~0x03;
+    ora = val;
+    break;
+  case 0x02:
+    ddrb = val;
+    break;
+  case 0x03:
+    ddra = val;
+    break;
+  case 0x04:
+  case 0x06:
+    latch1lo = val;
+    break;
+  case 0x05:
+    latch1hi = val;
+    timer1 = (latch1hi << 8) | latch1lo;
+    timer1running = true;
+    ifr &= ~0x40;
+    break;
+  case 0x07:
+    latch1hi = val;
+    ifr &= ~0x40;
+    break;
+  case 0x08:
+    latch2lo = val;
+    break;
+  case 0x09:
+    timer2 = (val << 8) | latch2lo;
+    timer2running = true;
+    ifr &= ~0x20;
+    break;
+  case 0x0a:
+    break;
+  case 0x0b:
+    acr = val;
+    break;
+  case 0x0c:
+    pcr = val;
+    break;
+  case 0x0d:
+    ifr &= ~val;
+    break;
+  case 0x0e:
+    if (val & 0x80) {
+      ier |= val & 0x7f;
+    } else {
+      ier &= ~val;
+    }
+    break;
+  default:
+    ora = val;
+    break;
+  }
+}
+
+void VIA::tick(uint32_t cycles) {
+  // timer 1: one-shot or free-running (acr bit 6), underflow after n + 1.5
+  // cycles is approximated by n + 1
+  int32_t t1 = static_cast<int32_t>(timer1) - static_cast<int32_t>(cycles);
+  if (t1 < 0) {
+    if (timer1running) {
+      ifr |= 0x40;
+    }
+    if (acr & 0x40) {
+      uint32_t period = ((latch1hi << 8) | latch1lo) + 2;
+      t1 = period - 1 - ((-t1 - 1) % period);
+    } else {
+      timer1running = false;
+      t1 &= 0xffff;
+    }
+  }
+  timer1 = t1;
+  // timer 2: one-shot (counting PB6 pulses is not emulated)
+  if (acr & 0x20) {
+    return;
+  }
+  int32_t t2 = static_cast<int32_t>(timer2) - static_cast<int32_t>(cycles);
+  if (t2 < 0) {
+    if (timer2running) {
+      ifr |= 0x20;
+      timer2running = false;
+    }
+    t2 &= 0xffff;
+  }
+  timer2 = t2;
+}
+
+void VIA::setCA1(bool level) {
+  if (level == ca1) {
+    return;
+  }
+  ca1 = level;
+  // pcr bit 0: 0 = negative edge, 1 = positive edge
+  if (level == ((pcr & 0x01) != 0)) {
+    ifr |= 0x02;
+  }
+}
@@ -0,0 +1,68 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef VIA_H
+#define VIA_H
+
+#include <cstdint>
+
+// MOS 6522 VIA as used in the 1541 (see class Floppy)
+// - timers are clocked once per instruction with the number of cycles used
+// - shift register, handshake and pulse modes of CA2/CB2 are not emulated,
+//   manual output modes of CA2/CB2 are available via getCA2/getCB2
+// - ports: inputs are set by the owner (pain, pbin), outputs read via
+//   getPA/getPB (pins configured as inputs are pulled up)
+
+class VIA {
+private:
+  uint16_t timer1;
+  uint16_t timer2;
+  uint8_t latch1lo;
+  uint8_t latch1hi;
+  uint8_t latch2lo;
+  bool timer1running;
+  bool timer2running;
+  bool ca1;
+
+public:
+  uint8_t ora;
+  uint8_t orb;
+  uint8_t ddra;
+  uint8_t ddrb;
+  uint8_t acr;
+  uint8_t pcr;
+  uint8_t ifr;
+  uint8_t ier;
+  // input pins of port A and port B
+  uint8_t pain;
+  uint8_t pbin;
+
+  VIA() { init(); }
+  void init();
+  uint8_t getReg(uint8_t idx);
+  void setReg(uint8_t idx, uint8_t val);
+  void tick(uint32_t cycles);
+  // CA1 input, sets interrupt flag 1 on the active edge (pcr bit 0)
+  void setCA1(bool level);
+
+  uint8_t getPA() const { return ora | ~ddra; }
+  uint8_t getPB() const { return orb | ~ddrb; }
+  // CA2 resp. CB2 output, high unless in manual output mode "low"
+  bool getCA2() const { return (pcr & 0x0e) != 0x0c; }
+  bool getCB2() const { return (pcr & 0xe0) != 0xc0; }
+  bool irq() const { return (ifr & ier & 0x7f) != 0; }
+};
+#endif // VIA_H
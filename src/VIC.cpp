@@ -16,6 +16,7 @@
 */
 #include "VIC.h"
 #include "Config.h"
+#include "InputLatency.h"
 #include "display/DisplayFactory.h"
 #include "platform/PlatformManager.h"
 #include <cstring>
@@ -112,44 +113,118 @@ void VIC::drawidleline(uint8_t ghostbyte) {
   }
 }
 
-void VIC::drawStdCharModeInt(uint8_t *screenMap, uint16_t bgcol, uint8_t row,
+void VIC::invalidateGlyphCache() {
+  for (GlyphRow &glyphrow : glyphcache) {
+    glyphrow.tag = 0;
+  }
+}
+
+// The cache is keyed by the fetched data byte and the colors (not by the
+// charset address), so writes to charset RAM or a charset switch never
+// return stale pixels.
+const VIC::GlyphRow &VIC::getGlyphRowStd(uint8_t data, uint8_t fgColor,
+                                         uint8_t bgColor) {
+  uint32_t tag = 0x01000000 | (data << 8) | (fgColor << 4) | bgColor;
+  GlyphRow &glyphrow =
+      glyphcache[(data ^ (fgColor * 0x1d) ^ (bgColor * 0x93)) &
+                 (GLYPHCACHESIZE - 1)];
+  if (glyphrow.tag != tag) {
+    uint16_t col = tftColorFromC64ColorArr[fgColor];
+    uint16_t bgcol = tftColorFromC64ColorArr[bgColor];
+    uint8_t bitval = 128;
+    for (uint8_t i = 0; i < 8; i++) {
+      bool set = data & bitval;
+      glyphrow.pixels[i] = set ? col : bgcol;
+      glyphrow.coll[i] = set;
+      bitval >>= 1;
+    }
+    glyphrow.tag = tag;
+  }
+  return glyphrow;
+}
+
+// mcColors: color indices of bit pairs 00, 01, 10, 11 (4 bits each)
+const VIC::GlyphRow &VIC::getGlyphRowMC(uint8_t data, uint16_t mcColors) {
+  uint32_t tag = 0x02000000 | (data << 16) | mcColors;
+  GlyphRow &glyphrow =
+      glyphcache[(data ^ (mcColors >> 8) ^ (mcColors * 0x35) ^ 0x80) &
+                 (GLYPHCACHESIZE - 1)];
+  if (glyphrow.tag != tag) {
+    uint8_t bitshift = 6;
+    for (uint8_t i = 0; i < 8; i += 2) {
+      uint8_t bitpair = (data >> bitshift) & 0x03;
+      uint16_t tftcolor =
+          tftColorFromC64ColorArr[(mcColors >> (bitpair << 2)) & 15];
+      glyphrow.pixels[i] = tftcolor;
+      glyphrow.pixels[i + 1] = tftcolor;
+      glyphrow.coll[i] = collArr[bitpair];
+      glyphrow.coll[i + 1] = collArr[bitpair];
+      bitshift -= 2;
+    }
+    glyphrow.tag = tag;
+  }
+  return glyphrow;
+}
+
+void VIC::drawGlyphRow(const GlyphRow &glyphrow, uint16_t &idx,
+                       uint16_t &xp) {
+  memcpy(&bitmap[idx], glyphrow.pixels, sizeof(glyphrow.pixels));
+  memcpy(&spritedatacoll[xp], glyphrow.coll, sizeof(glyphrow.coll));
+  idx += 8;
+  xp += 8;
+}
+
+void VIC::drawStdCharModeInt(uint8_t *screenMap, uint8_t bgColor, uint8_t row,
                              uint8_t dx, uint16_t &xp, uint16_t yidx,
                              uint16_t &idx) {
-  uint16_t col = tftColorFromC64ColorArr[colormap[yidx] & 15];
+  uint8_t colc64 = colormap[yidx] & 15;
   uint8_t ch = screenMap[yidx];
   uint16_t idxch = ch << 3;
   uint8_t chardata = charset[idxch + row];
-  drawByteStdData(chardata, idx, xp, col, bgcol, dx);
+  if (dx == 0) {
+    drawGlyphRow(getGlyphRowStd(chardata, colc64, bgColor), idx, xp);
+  } else {
+    drawByteStdData(chardata, idx, xp, tftColorFromC64ColorArr[colc64],
+                    tftColorFromC64ColorArr[bgColor], dx);
+  }
 }
 
 void VIC::drawStdCharMode(uint8_t *screenMap, uint8_t bgColor) {
-  uint16_t bgcol = tftColorFromC64ColorArr[bgColor & 15];
+  bgColor &= 15;
+  uint16_t bgcol = tftColorFromC64ColorArr[bgColor];
   if (shiftDy(bgcol)) {
     return;
   }
   shiftDx(bgcol, idx);
-  drawStdCharModeInt(screenMap, bgcol, row, 0, xp, yidx++, idx);
+  drawStdCharModeInt(screenMap, bgColor, row, 0, xp, yidx++, idx);
   drawOnly38ColsFrame(idx - 8 - deltax);
   for (uint8_t x = 1; x < 39; x++) {
-    drawStdCharModeInt(screenMap, bgcol, row, 0, xp, yidx++, idx);
+    drawStdCharModeInt(screenMap, bgColor, row, 0, xp, yidx++, idx);
   }
-  drawStdCharModeInt(screenMap, bgcol, row, deltax, xp, yidx, idx);
+  drawStdCharModeInt(screenMap, bgColor, row, deltax, xp, yidx, idx);
   drawOnly38ColsFrame(idx - 8);
 }
 
-void VIC::drawMCCharModeInt(uint8_t *screenMap, uint16_t bgcol,
+void VIC::drawMCCharModeInt(uint8_t *screenMap, uint16_t mcColors,
                             uint16_t *tftColArr, uint8_t row, uint8_t dx,
                             uint16_t &xp, uint16_t yidx, uint16_t &idx) {
   uint8_t colc64 = colormap[yidx] & 15;
   uint8_t ch = screenMap[yidx];
   uint16_t idxch = ch << 3;
   uint8_t chardata = charset[idxch + row];
-  if (colc64 & 8) {
+  if (dx == 0) {
+    if (colc64 & 8) {
+      drawGlyphRow(getGlyphRowMC(chardata, mcColors | ((colc64 & 7) << 12)),
+                   idx, xp);
+    } else {
+      drawGlyphRow(getGlyphRowStd(chardata, colc64, mcColors & 15), idx, xp);
+    }
+  } else if (colc64 & 8) {
     tftColArr[3] = tftColorFromC64ColorArr[colc64 & 7];
     drawByteMCData(chardata, idx, xp, tftColArr, collArr, dx);
   } else {
-    drawByteStdData(chardata, idx, xp, tftColorFromC64ColorArr[colc64], bgcol,
-                    dx);
+    drawByteStdData(chardata, idx, xp, tftColorFromC64ColorArr[colc64],
+                    tftColArr[0], dx);
   }
 }
 
@@ -164,25 +239,33 @@ void VIC::drawMCCharMode(uint8_t *screenMap, uint8_t bgColor, uint8_t color1,
   tftColArr[0] = bgcol;
   tftColArr[1] = tftColorFromC64ColorArr[color1 & 15];
   tftColArr[2] = tftColorFromC64ColorArr[color2 & 15];
-  drawMCCharModeInt(screenMap, bgcol, tftColArr, row, 0, xp, yidx++, idx);
+  uint16_t mcColors =
+      (bgColor & 15) | ((color1 & 15) << 4) | ((color2 & 15) << 8);
+  drawMCCharModeInt(screenMap, mcColors, tftColArr, row, 0, xp, yidx++, idx);
   drawOnly38ColsFrame(idx - 8 - deltax);
   for (uint8_t x = 1; x < 39; x++) {
-    drawMCCharModeInt(screenMap, bgcol, tftColArr, row, 0, xp, yidx++, idx);
+    drawMCCharModeInt(screenMap, mcColors, tftColArr, row, 0, xp, yidx++, idx);
   }
-  drawMCCharModeInt(screenMap, bgcol, tftColArr, row, deltax, xp, yidx, idx);
+  drawMCCharModeInt(screenMap, mcColors, tftColArr, row, deltax, xp, yidx,
+                    idx);
   drawOnly38ColsFrame(idx - 8);
 }
 
 void VIC::drawExtBGColCharModeInt(uint8_t *screenMap, uint8_t *bgColArr,
                                   uint8_t row, uint8_t dx, uint16_t &xp,
                                   uint16_t yidx, uint16_t &idx) {
-  uint16_t col = tftColorFromC64ColorArr[colormap[yidx] & 15];
+  uint8_t colc64 = colormap[yidx] & 15;
   uint8_t ch = screenMap[yidx];
   uint8_t ch6bits = ch & 0x3f;
-  uint16_t bgcol = tftColorFromC64ColorArr[bgColArr[ch >> 6] & 15];
+  uint8_t bgColor = bgColArr[ch >> 6] & 15;
   uint16_t idxch = ch6bits << 3;
   uint8_t chardata = charset[idxch + row];
-  drawByteStdData(chardata, idx, xp, col, bgcol, dx);
+  if (dx == 0) {
+    drawGlyphRow(getGlyphRowStd(chardata, colc64, bgColor), idx, xp);
+  } else {
+    drawByteStdData(chardata, idx, xp, tftColorFromC64ColorArr[colc64],
+                    tftColorFromC64ColorArr[bgColor], dx);
+  }
 }
 
 void VIC::drawExtBGColCharMode(uint8_t *screenMap, uint8_t *bgColArr) {
@@ -526,6 +609,8 @@ void VIC::initVarsAndRegs() {
   vicreg[0x18] = 0x15;
   vicreg[0x19] = 0x71;
   vicreg[0x1a] = 0xf0;
+  latchd011 = 0;
+  latchd012 = 0;
 
   cntRefreshs.store(0, std::memory_order_release);
   vicmem = 0;
@@ -534,6 +619,9 @@ void VIC::initVarsAndRegs() {
   rasterline = 0;
   charset = chrom;
   vertborder = true;
+  lineC64map = 0;
+  denbadline = false;
+  caccbadlinecnt = 0;
   doiactive[0] = false;
   doiactive[1] = false;
 }
@@ -547,7 +635,9 @@ void VIC::init(uint8_t *ram, const uint8_t *charrom) {
   this->chrom = charrom;
 
   // allocate bitmap memory to be transfered to LCD
-  bitmap = new uint16_t[320 * 200]();
+  visiblebitmap = new uint16_t[320 * 200]();
+  hiddenbitmap = nullptr;
+  bitmap = visiblebitmap;
 
   // init display
   display = Display::create();
@@ -555,17 +645,63 @@ void VIC::init(uint8_t *ram, const uint8_t *charrom) {
 
   // div init
   colormap = new uint8_t[1024]();
+  overlaysenabled = true;
   tftColorFromC64ColorArr = display->getC64Colors();
+  invalidateGlyphCache();
   initVarsAndRegs();
 }
 
 void VIC::refresh() {
   dispOverlayInfo();
-  display->drawBitmap(bitmap);
+  int64_t drawstart = PlatformManager::getInstance().getTimeUS();
+  display->drawBitmap(visiblebitmap);
+  if (inputlatency != nullptr) {
+    inputlatency->frameDisplayed(drawstart);
+  }
   display->drawFrame(tftColorFromC64ColorArr[vicreg[0x20] & 15]);
   cntRefreshs.fetch_add(1, std::memory_order_release);
 }
 
+void VIC::setSuppressed(bool suppressed) {
+  if (suppressed && (hiddenbitmap == nullptr)) {
+    hiddenbitmap = new uint16_t[320 * 200]();
+  }
+  bitmap = suppressed ? hiddenbitmap : visiblebitmap;
+}
+
+void VIC::saveState(State &state) const {
+  memcpy(state.vicreg, vicreg, sizeof(vicreg));
+  state.latchd011 = latchd011;
+  state.latchd012 = latchd012;
+  state.vicmem = vicmem;
+  state.bitmapstart = bitmapstart;
+  state.screenmemstart = screenmemstart;
+  state.rasterline = rasterline;
+  // charset points to the character rom or to ram
+  state.charsetinrom = (charset >= chrom) && (charset < chrom + 0x1000);
+  state.charsetoffset = state.charsetinrom ? charset - chrom : charset - ram;
+  state.vertborder = vertborder;
+  state.lineC64map = lineC64map;
+  state.denbadline = denbadline;
+  state.caccbadlinecnt = caccbadlinecnt;
+}
+
+void VIC::loadState(const State &state) {
+  memcpy(vicreg, state.vicreg, sizeof(vicreg));
+  latchd011 = state.latchd011;
+  latchd012 = state.latchd012;
+  vicmem = state.vicmem;
+  bitmapstart = state.bitmapstart;
+  screenmemstart = state.screenmemstart;
+  rasterline = state.rasterline;
+  charset = state.charsetinrom ? chrom + state.charsetoffset
+                               : ram + state.charsetoffset;
+  vertborder = state.vertborder;
+  lineC64map = state.lineC64map;
+  denbadline = state.denbadline;
+  caccbadlinecnt = state.caccbadlinecnt;
+}
+
 void VIC::drawOverlay(uint8_t doiidx) {
   if (!doiactive[doiidx]) {
     return;
@@ -699,8 +835,10 @@ void VIC::drawRasterline() {
       }
       drawSprites(rasterline - 1);
       // draw overlay
-      drawOverlay(0);
-      drawOverlay(1);
+      if (overlaysenabled) {
+        drawOverlay(0);
+        drawOverlay(1);
+      }
     } else {
       drawemptyline(tftColorFromC64ColorArr[vicreg[0x20] & 15]);
     }
@@ -21,10 +21,24 @@
 #include <atomic>
 #include <cstdint>
 
+class InputLatency; // forward declaration
+
 class VIC {
 private:
+  // pre-expanded 8 pixel row of character data for a given combination of
+  // data byte and colors (text modes)
+  struct GlyphRow {
+    uint32_t tag;
+    uint16_t pixels[8];
+    bool coll[8];
+  };
+  static const uint16_t GLYPHCACHESIZE = 256;
+  GlyphRow glyphcache[GLYPHCACHESIZE];
+
   uint8_t *ram;
-  uint16_t *bitmap;
+  uint16_t *bitmap; // bitmap to draw to
+  uint16_t *visiblebitmap;
+  uint16_t *hiddenbitmap; // frames not to be shown (run-ahead)
   uint8_t spritespritecoll[320];
   bool spritedatacoll[320];
   uint8_t startbyte;
@@ -61,6 +75,14 @@ private:
   inline void drawByteMCData(uint8_t data, uint16_t &idx, uint16_t &xp,
                              uint16_t *tftColArr, bool *collArr, uint8_t dx)
       __attribute__((always_inline));
+  void invalidateGlyphCache();
+  inline const GlyphRow &getGlyphRowStd(uint8_t data, uint8_t fgColor,
+                                        uint8_t bgColor)
+      __attribute__((always_inline));
+  inline const GlyphRow &getGlyphRowMC(uint8_t data, uint16_t mcColors)
+      __attribute__((always_inline));
+  inline void drawGlyphRow(const GlyphRow &glyphrow, uint16_t &idx,
+                           uint16_t &xp) __attribute__((always_inline));
   void drawemptyline(uint16_t colBM);
   void drawidleline(uint8_t ghostbyte);
   inline bool shiftDy(uint16_t bgcol) __attribute__((always_inline));
@@ -68,7 +90,7 @@ private:
       __attribute__((always_inline));
   inline void drawOnly38ColsFrame(uint16_t tmpidx)
       __attribute__((always_inline));
-  inline void drawStdCharModeInt(uint8_t *screenMap, uint16_t bgcol,
+  inline void drawStdCharModeInt(uint8_t *screenMap, uint8_t bgColor,
                                  uint8_t row, uint8_t dx, uint16_t &xp,
                                  uint16_t idxmap, uint16_t &idx)
       __attribute__((always_inline));
@@ -78,7 +100,7 @@ private:
                                       uint16_t idxmap, uint16_t &idx)
       __attribute__((always_inline));
   void drawExtBGColCharMode(uint8_t *screenMap, uint8_t *bgColArr);
-  inline void drawMCCharModeInt(uint8_t *screenMap, uint16_t bgcol,
+  inline void drawMCCharModeInt(uint8_t *screenMap, uint16_t mcColors,
                                 uint16_t *tftColArr, uint8_t row, uint8_t dx,
                                 uint16_t &xp, uint16_t idxmap, uint16_t &idx)
       __attribute__((always_inline));
@@ -117,8 +139,26 @@ private:
   void drawOverlay(uint8_t doiidx);
 
 public:
+  // state of the VIC (see class Snapshot)
+  struct State {
+    uint8_t vicreg[0x40];
+    uint8_t latchd011;
+    uint8_t latchd012;
+    uint16_t vicmem;
+    uint16_t bitmapstart;
+    uint16_t screenmemstart;
+    uint16_t rasterline;
+    bool charsetinrom;
+    uint16_t charsetoffset;
+    bool vertborder;
+    uint8_t lineC64map;
+    bool denbadline;
+    uint8_t caccbadlinecnt;
+  };
+
   // profiling info
   std::atomic<uint8_t> cntRefreshs;
+  InputLatency *inputlatency = nullptr;
 
   uint8_t *colormap;
   const uint8_t *charset;
@@ -133,11 +173,18 @@ public:
   uint16_t rasterline;
 
   bool doiactive[2];
+  // overlays are drawn to the bitmap (off during movies: host timed)
+  bool overlaysenabled;
 
   VIC();
   void initVarsAndRegs();
   void init(uint8_t *ram, const uint8_t *charrom);
   void refresh();
+  const uint16_t *getBitmap() const { return visiblebitmap; }
+  // draw to a hidden bitmap instead of the visible one
+  void setSuppressed(bool suppressed);
+  void saveState(State &state) const;
+  void loadState(const State &state);
   uint8_t nextRasterline();
   void drawRasterline();
   void drawDOIBox(uint8_t *box, uint8_t x, uint8_t y, uint8_t w, uint8_t h,
@@ -1,13 +1,250 @@
 #if defined(PLATFORM_LINUX) || defined(_WIN32)
 #include "C64Emu.h"
+#include "ExtCmd.h"
+#include "SID.h"
+#include "display/SDLDisplay.h"
+#include "keyboard/KeyEventQueue.h"
+#include "sound/NoSound.h"
+#include "platform/PlatformFactory.h"
 #include "platform/PlatformManager.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 static const char *TAG = "c64linux";
 
 C64Emu c64Emu;
 
+// measures the time needed to display a frame with the renderer scaling
+// (current SDL path) and with the software scaler
+static void benchmarkDisplay() {
+  const uint16_t numofframes = 500;
+  static uint16_t bitmap[320 * 200];
+  for (uint32_t i = 0; i < 320 * 200; i++) {
+    bitmap[i] = (uint16_t)(i * 2654435761u >> 16);
+  }
+  for (bool swscale : {false, true}) {
+    Config::SWSCALE = swscale;
+    SDLDisplay display;
+    display.init();
+    auto start = std::chrono::steady_clock::now();
+    for (uint16_t i = 0; i < numofframes; i++) {
+      display.drawBitmap(bitmap);
+      display.drawFrame(i & 1 ? 0x0014 : 0x043f);
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::printf("%s scaling x%d%s: %lld us per frame\n",
+           swscale ? "software" : "renderer", Config::LCDSCALE,
+           Config::SCANLINES ? " (scanlines)" : "", (long long)(us.count() / numofframes));
+  }
+}
+
+// renders a fixed sequence of notes (optionally through the filter with a
+// cutoff sweep, resfilt / modevol: values of $d417 / $d418) and returns the
+// time needed for the synthesis
+static double renderSID(bool fixedpoint, uint8_t resfilt, uint8_t modevol,
+                        uint8_t emuvolume, std::vector<int16_t> &out) {
+  bool filter = (resfilt != 0);
+  const uint16_t numofframes = 1000;
+  const uint16_t samplesperframe = AUDIO_SAMPLE_RATE / 50;
+  static const uint8_t waves[] = {0x41, 0x21, 0x11, 0x15, 0x81, 0x61, 0x43};
+  static const uint16_t freqs[] = {0x1167, 0x1387, 0x15ed, 0x1a9c,
+                                   0x0c8f, 0x2327, 0x08b4, 0x4e8c};
+  SID sid(new NoSound());
+  sid.fixedpoint = fixedpoint;
+  sid.setEmuVolume(emuvolume);
+  sid.setReg(0x18, modevol);
+  sid.setReg(0x17, resfilt);
+  out.resize(numofframes * samplesperframe);
+  int16_t *buffer = out.data();
+  double elapsed = 0;
+  for (uint16_t frame = 0; frame < numofframes; frame++) {
+    for (uint8_t voice = 0; voice < 3; voice++) {
+      uint8_t base = voice * 7;
+      uint16_t note = (frame + voice * 3) / 10;
+      if ((frame + voice * 3) % 10 == 0) {
+        uint16_t freq = freqs[note & 7] >> voice;
+        uint16_t pw = 0x0800 + ((frame * 16) & 0x07ff);
+        sid.setReg(base, freq & 0xff);
+        sid.setReg(base + 1, freq >> 8);
+        sid.setReg(base + 2, pw & 0xff);
+        sid.setReg(base + 3, pw >> 8);
+        sid.setReg(base + 5, 0x19 + voice * 0x20);
+        sid.setReg(base + 6, 0xa4 - voice * 0x10);
+        sid.setReg(base + 4, waves[note % 7]);
+      } else if ((frame + voice * 3) % 10 == 6) {
+        sid.setReg(base + 4, waves[note % 7] & 0xfe);
+      }
+    }
+    if (filter) {
+      uint16_t fc = (frame * 8) & 0x7ff;
+      sid.setReg(0x15, fc & 0x07);
+      sid.setReg(0x16, fc >> 3);
+    }
+    auto start = std::chrono::steady_clock::now();
+    sid.generateSamples(buffer, samplesperframe);
+    elapsed += std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+    buffer += samplesperframe;
+  }
+  return elapsed;
+}
+
+// prints the rms of a and the rms of the difference between a and b
+static void compareSID(const char *name, const std::vector<int16_t> &a,
+                       const std::vector<int16_t> &b) {
+  double sumsq = 0;
+  double sumsqdiff = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    double d = (double)a[i] - b[i];
+    sumsq += (double)a[i] * a[i];
+    sumsqdiff += d * d;
+  }
+  double numofsamples = (double)a.size();
+  std::printf("A/B%s: rms float %.1f, rms difference %.1f (%.1f dB)\n", name,
+              std::sqrt(sumsq / numofsamples),
+              std::sqrt(sumsqdiff / numofsamples),
+              10 * std::log10(sumsq / (sumsqdiff > 0 ? sumsqdiff : 1)));
+}
+
+// measures the synthesis speed of the float and the fixed point SID engine
+// (without and with filter) and compares the output of both engines
+static void benchmarkSID() {
+  std::vector<int16_t> out[2];
+  std::vector<int16_t> outfilter[2];
+  std::vector<int16_t> outresonance[2];
+  for (uint8_t engine = 0; engine < 2; engine++) {
+    double seconds = renderSID(engine == 1, 0x00, 0x0f, 128, out[engine]);
+    double secondsfilter =
+        renderSID(engine == 1, 0x87, 0x1f, 128, outfilter[engine]);
+    // worst case of the mixer: all voices filtered with full resonance
+    // through all filter outputs at full volume
+    renderSID(engine == 1, 0xf7, 0x7f, 255, outresonance[engine]);
+    double numofsamples = (double)out[engine].size();
+    double nsfilter = (secondsfilter - seconds) * 1e9 / numofsamples;
+    std::printf("%s SID: %.0f samples/s (%.1f x realtime), filter: %.1f ns "
+                "per sample (%.2f%% of the sample period)\n",
+                engine == 1 ? "fixed point" : "float",
+                numofsamples / seconds,
+                numofsamples / seconds / AUDIO_SAMPLE_RATE, nsfilter,
+                nsfilter * AUDIO_SAMPLE_RATE / 1e7);
+  }
+  compareSID("", out[0], out[1]);
+  compareSID(" (filter)", outfilter[0], outfilter[1]);
+  compareSID(" (full resonance)", outresonance[0], outresonance[1]);
+}
+
+// feeds the key event queue from a synthetic producer thread at maximum rate
+// (key presses, releases and joystick events) and checks that each key press
+// is seen by the keyboard scan in order and for exactly MINHOLDSCANS scans
+static bool benchmarkInput() {
+  const uint32_t numofkeys = 50000;
+  PlatformManager::initialize(PlatformNS::create());
+  KeyEventQueue keyEvents;
+  uint32_t producerretries = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < numofkeys; i++) {
+      while (!keyEvents.pushKeyPress(i & 0xff, (i >> 8) & 0xff, i % 5)) {
+        producerretries++;
+        std::this_thread::yield();
+      }
+      while (!keyEvents.pushJoystick(i & 0x1f)) {
+        producerretries++;
+        std::this_thread::yield();
+      }
+      while (!keyEvents.pushKeyRelease()) {
+        producerretries++;
+        std::this_thread::yield();
+      }
+    }
+  });
+  uint32_t numofscans = 0;
+  uint32_t numofpresses = 0;
+  uint32_t errors = 0;
+  uint8_t holdscans = 0;
+  bool pressed = false;
+  double scantime = 0;
+  while (numofpresses < numofkeys || pressed) {
+    auto scanstart = std::chrono::steady_clock::now();
+    keyEvents.scan();
+    scantime += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - scanstart)
+                    .count();
+    numofscans++;
+    bool active = (keyEvents.getDC00() != 0xff) || (keyEvents.getDC01() != 0xff);
+    if (active && !pressed) {
+      // new key press: must be the next key of the sequence
+      uint32_t i = numofpresses++;
+      if ((keyEvents.getDC00() != (i & 0xff)) ||
+          (keyEvents.getDC01() != ((i >> 8) & 0xff)) ||
+          (keyEvents.getShiftctrlcode() != i % 5)) {
+        errors++;
+      }
+      holdscans = 0;
+    }
+    if (active) {
+      holdscans++;
+    } else if (pressed && (holdscans != KeyEventQueue::MINHOLDSCANS)) {
+      errors++;
+    }
+    pressed = active;
+    if (!active && (numofpresses < numofkeys)) {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  uint32_t numofevents = numofkeys * 3;
+  std::printf("input: %u events in %.2f s (%.0f events/s), %u producer "
+              "retries (queue full), %u scans (%.0f ns per scan)\n",
+              numofevents, seconds, numofevents / seconds, producerretries,
+              numofscans, scantime * 1e9 / numofscans);
+  std::printf("input: %u/%u key presses seen, %u errors: %s\n", numofpresses,
+              numofkeys, errors, errors == 0 ? "OK" : "FAILED");
+  return errors == 0;
+}
+
+// replays a movie headless (no window, no audio output, no throttling) and
+// checks the frame checksums
+static bool replayMovie(const char *name) {
+  SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+  SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+  c64Emu.setup();
+  if (!Floppy::fsinitialized) {
+    return false;
+  }
+  uint8_t cmd[ExtCmdQueue::CMDSIZE] = {};
+  cmd[0] = static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::MOVIE);
+  cmd[1] = 3;
+  cmd[2] = 1;
+  std::snprintf(reinterpret_cast<char *>(&cmd[3]), sizeof(cmd) - 3, "%s",
+                name);
+  c64Emu.cpu.extCmdQueue.push(cmd, sizeof(cmd));
+  Movie &movie = c64Emu.cpu.movie;
+  while (!movie.finished.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  bool ok = movie.replayok.load(std::memory_order_acquire);
+  std::printf("replay of %s: %lu frames, %s\n", name,
+              (unsigned long)movie.replayedframes.load(std::memory_order_acquire),
+              ok ? "all checksums match" : "FAILED");
+  return ok;
+}
+
 int main(int argc, char *argv[]) {
   // parse arguments
+  bool benchdisplay = false;
+  bool benchsid = false;
+  bool benchinput = false;
+  const char *replay = nullptr;
   for (int i = 1; i < argc; i++) {
     if (std::string(argv[i]) == "-scale" && i + 1 < argc) {
       int val = std::atoi(argv[i + 1]);
@@ -15,6 +252,84 @@ int main(int argc, char *argv[]) {
         Config::LCDSCALE = val;
       }
       i++;
+    } else if (std::string(argv[i]) == "-scanlines") {
+      Config::SCANLINES = true;
+    } else if (std::string(argv[i]) == "-gpuscale") {
+      Config::SWSCALE = false;
+    } else if (std::string(argv[i]) == "-benchdisplay") {
+      benchdisplay = true;
+    } else if (std::string(argv[i]) == "-sidfixed") {
+      Config::SIDFIXEDPOINT = true;
+    } else if (std::string(argv[i]) == "-benchsid") {
+      benchsid = true;
+    } else if (std::string(argv[i]) == "-benchinput") {
+      benchinput = true;
+    } else if (std::string(argv[i]) == "-capture" && i + 1 < argc) {
+      Config::CAPTUREFILE = argv[i + 1];
+      i++;
+    } else if (std::string(argv[i]) == "-coldstart") {
+      Config::INSTANTBOOT = false;
+    } else if (std::string(argv[i]) == "-prgcache" && i + 1 < argc) {
+      int val = std::atoi(argv[i + 1]);
+      if (val >= 0 && val <= 60000) {
+        Config::PRGCACHEFRAMES = val;
+      }
+      i++;
+    } else if (std::string(argv[i]) == "-truedrive") {
+      Config::TRUEDRIVE = true;
+    } else if (std::string(argv[i]) == "-run" && i + 1 < argc) {
+      Config::AUTORUN = argv[i + 1];
+      i++;
+    } else if (std::string(argv[i]) == "-replay" && i + 1 < argc) {
+      replay = argv[i + 1];
+      i++;
+    } else if (std::string(argv[i]) == "-runahead" && i + 1 < argc) {
+      int val = std::atoi(argv[i + 1]);
+      if (val >= 0 && val <= 4) {
+        Config::RUNAHEADFRAMES = val;
+      }
+      i++;
+    } else if (std::string(argv[i]) == "-rewind" && i + 1 < argc) {
+      int val = std::atoi(argv[i + 1]);
+      if (val >= 0 && val <= 1024 * 1024) {
+        Config::REWINDBUFFERKB = val;
+      }
+      i++;
+    } else if (std::string(argv[i]) == "-audiolatency" && i + 1 < argc) {
+      int val = std::atoi(argv[i + 1]);
+      if (val >= 20 && val <= 300) {
+        Config::AUDIOLATENCYMS = val;
+      }
+      i++;
+    }
+  }
+  if (benchdisplay) {
+    try {
+      benchmarkDisplay();
+    } catch (...) {
+      std::printf("display benchmark failed\n");
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+  if (benchsid) {
+    try {
+      benchmarkSID();
+    } catch (...) {
+      std::printf("SID benchmark failed\n");
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+  if (benchinput) {
+    return benchmarkInput() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (replay) {
+    try {
+      return replayMovie(replay) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (...) {
+      std::printf("replay failed\n");
+      return EXIT_FAILURE;
     }
   }
 
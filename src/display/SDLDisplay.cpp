@@ -2,7 +2,9 @@
 #ifdef USE_SDL_DISPLAY
 #include "../roms/charset.h"
 #include "SDLDisplay.h"
+#include "SDLScaler.h"
 #include <SDL2/SDL.h>
+#include <algorithm>
 
 void drawChar(SDL_Renderer *ren, uint16_t c, uint16_t x, uint16_t y,
               uint8_t charpixsize) {
@@ -20,7 +22,9 @@ void drawChar(SDL_Renderer *ren, uint16_t c, uint16_t x, uint16_t y,
   }
 }
 
-SDLDisplay::SDLDisplay() {}
+SDLDisplay::SDLDisplay()
+    : swscale(Config::SWSCALE), scanlines(Config::SCANLINES),
+      scale(Config::LCDSCALE) {}
 
 SDLDisplay::~SDLDisplay() {
   if (texture) {
@@ -63,9 +67,17 @@ void SDLDisplay::init() {
   if (!renderer) {
     throw std::runtime_error("SDL_CreateRenderer failed");
   }
-  SDL_RenderSetLogicalSize(renderer, Config::LCDWIDTH, Config::LCDHEIGHT);
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB565,
-                              SDL_TEXTUREACCESS_STREAMING, 320, 200);
+  if (swscale) {
+    // texture has the size of the window, so the renderer just copies it
+    screen.reset(new uint16_t[Config::LCDWIDTH * Config::LCDHEIGHT]());
+    texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_RGB565, SDL_TEXTUREACCESS_STREAMING,
+        Config::LCDWIDTH * scale, Config::LCDHEIGHT * scale);
+  } else {
+    SDL_RenderSetLogicalSize(renderer, Config::LCDWIDTH, Config::LCDHEIGHT);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB565,
+                                SDL_TEXTUREACCESS_STREAMING, 320, 200);
+  }
   if (!texture) {
     throw std::runtime_error("SDL_CreateTexture failed");
   }
@@ -79,6 +91,19 @@ static inline void setDrawColor565(SDL_Renderer *r, uint16_t c) {
 }
 
 void SDLDisplay::drawFrame(uint16_t frameColor) {
+  if (swscale) {
+    uint16_t *p = screen.get();
+    std::fill(p, p + Config::LCDWIDTH * BORDERHEIGHT, frameColor);
+    p += Config::LCDWIDTH * BORDERHEIGHT;
+    for (uint16_t y = 0; y < 200; y++) {
+      std::fill(p, p + BORDERWIDTH, frameColor);
+      std::fill(p + BORDERWIDTH + 320, p + Config::LCDWIDTH, frameColor);
+      p += Config::LCDWIDTH;
+    }
+    std::fill(p, screen.get() + Config::LCDWIDTH * Config::LCDHEIGHT,
+              frameColor);
+    return;
+  }
   setDrawColor565(renderer, frameColor);
   SDL_Rect top{0, 0, Config::LCDWIDTH, BORDERHEIGHT};
   SDL_RenderFillRect(renderer, &top);
@@ -91,6 +116,23 @@ void SDLDisplay::drawFrame(uint16_t frameColor) {
 }
 
 void SDLDisplay::drawBitmap(uint16_t *bitmap) {
+  if (swscale) {
+    uint16_t *p = screen.get() + BORDERHEIGHT * Config::LCDWIDTH + BORDERWIDTH;
+    for (uint16_t y = 0; y < 200; y++) {
+      memcpy(p, bitmap + y * 320, 320 * sizeof(uint16_t));
+      p += Config::LCDWIDTH;
+    }
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, nullptr, &pixels, &pitch) == 0) {
+      SDLScaler::scale(screen.get(), Config::LCDWIDTH, Config::LCDHEIGHT,
+                       pixels, pitch, scale, scanlines);
+      SDL_UnlockTexture(texture);
+    }
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+    return;
+  }
   SDL_UpdateTexture(texture, nullptr, bitmap, 320 * sizeof(uint16_t));
   SDL_Rect dst{BORDERWIDTH, BORDERHEIGHT, 320, 200};
   SDL_RenderCopy(renderer, texture, nullptr, &dst);
@@ -6,6 +6,7 @@
 #include "DisplayDriver.h"
 #include <SDL2/SDL.h>
 #include <cstdint>
+#include <memory>
 #include <stdexcept>
 
 class SDLDisplay : public DisplayDriver {
@@ -19,6 +20,12 @@ private:
   SDL_Renderer *renderer = nullptr;
   SDL_Texture *texture = nullptr;
 
+  // software scaling: complete screen (frame + bitmap) in native resolution
+  bool swscale;
+  bool scanlines;
+  uint8_t scale;
+  std::unique_ptr<uint16_t[]> screen;
+
 public:
   SDLDisplay();
   ~SDLDisplay();
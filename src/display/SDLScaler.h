@@ -0,0 +1,209 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef SDLSCALER_H
+#define SDLSCALER_H
+
+#include "../Config.h"
+#ifdef USE_SDL_DISPLAY
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SDLSCALER_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SDLSCALER_NEON
+#endif
+
+// integer nearest neighbour scaler for RGB565 images (used by SDLDisplay
+// to avoid renderer side scaling on software rendered hosts)
+class SDLScaler {
+private:
+  // 75% brightness of a RGB565 pixel: p/2 + p/4 per color channel
+  static inline uint16_t darken(uint16_t p) {
+    return ((p >> 1) & 0x7bef) + ((p >> 2) & 0x39e7);
+  }
+
+  static void expandRow2(const uint16_t *src, uint16_t *dst, uint16_t w) {
+    uint16_t x = 0;
+#if defined(SDLSCALER_SSE2)
+    for (; x + 8 <= w; x += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+      _mm_storeu_si128((__m128i *)(dst + 2 * x), _mm_unpacklo_epi16(v, v));
+      _mm_storeu_si128((__m128i *)(dst + 2 * x + 8), _mm_unpackhi_epi16(v, v));
+    }
+#elif defined(SDLSCALER_NEON)
+    for (; x + 8 <= w; x += 8) {
+      uint16x8_t v = vld1q_u16(src + x);
+      vst2q_u16(dst + 2 * x, (uint16x8x2_t){{v, v}});
+    }
+#endif
+    for (; x < w; x++) {
+      dst[2 * x] = dst[2 * x + 1] = src[x];
+    }
+  }
+
+  static void expandRow3(const uint16_t *src, uint16_t *dst, uint16_t w) {
+    uint16_t x = 0;
+#if defined(SDLSCALER_SSE2)
+    // p0..p7 -> p0p0p0p1p1p1p2p2 p2p3p3p3p4p4p4p5 p5p5p6p6p6p7p7p7
+    for (; x + 8 <= w; x += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+      __m128i lo = _mm_unpacklo_epi64(v, v);
+      __m128i hi = _mm_unpackhi_epi64(v, v);
+      __m128i o0 = _mm_shufflehi_epi16(
+          _mm_shufflelo_epi16(lo, _MM_SHUFFLE(1, 0, 0, 0)),
+          _MM_SHUFFLE(2, 2, 1, 1));
+      __m128i o1 = _mm_shufflehi_epi16(
+          _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 2)),
+          _MM_SHUFFLE(1, 0, 0, 0));
+      __m128i o2 = _mm_shufflehi_epi16(
+          _mm_shufflelo_epi16(hi, _MM_SHUFFLE(2, 2, 1, 1)),
+          _MM_SHUFFLE(3, 3, 3, 2));
+      _mm_storeu_si128((__m128i *)(dst + 3 * x), o0);
+      _mm_storeu_si128((__m128i *)(dst + 3 * x + 8), o1);
+      _mm_storeu_si128((__m128i *)(dst + 3 * x + 16), o2);
+    }
+#elif defined(SDLSCALER_NEON)
+    for (; x + 8 <= w; x += 8) {
+      uint16x8_t v = vld1q_u16(src + x);
+      vst3q_u16(dst + 3 * x, (uint16x8x3_t){{v, v, v}});
+    }
+#endif
+    for (; x < w; x++) {
+      dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = src[x];
+    }
+  }
+
+  static void expandRow4(const uint16_t *src, uint16_t *dst, uint16_t w) {
+    uint16_t x = 0;
+#if defined(SDLSCALER_SSE2)
+    for (; x + 8 <= w; x += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+      __m128i lo = _mm_unpacklo_epi16(v, v);
+      __m128i hi = _mm_unpackhi_epi16(v, v);
+      _mm_storeu_si128((__m128i *)(dst + 4 * x), _mm_unpacklo_epi32(lo, lo));
+      _mm_storeu_si128((__m128i *)(dst + 4 * x + 8),
+                       _mm_unpackhi_epi32(lo, lo));
+      _mm_storeu_si128((__m128i *)(dst + 4 * x + 16),
+                       _mm_unpacklo_epi32(hi, hi));
+      _mm_storeu_si128((__m128i *)(dst + 4 * x + 24),
+                       _mm_unpackhi_epi32(hi, hi));
+    }
+#elif defined(SDLSCALER_NEON)
+    for (; x + 8 <= w; x += 8) {
+      uint16x8_t v = vld1q_u16(src + x);
+      vst4q_u16(dst + 4 * x, (uint16x8x4_t){{v, v, v, v}});
+    }
+#endif
+    for (; x < w; x++) {
+      dst[4 * x] = dst[4 * x + 1] = dst[4 * x + 2] = dst[4 * x + 3] = src[x];
+    }
+  }
+
+  static void expandRowN(const uint16_t *src, uint16_t *dst, uint16_t w,
+                         uint8_t factor) {
+    for (uint16_t x = 0; x < w; x++) {
+      uint16_t p = src[x];
+      for (uint8_t i = 0; i < factor; i++) {
+        *dst++ = p;
+      }
+    }
+  }
+
+  static void darkenRow(const uint16_t *src, uint16_t *dst, uint32_t n) {
+    uint32_t x = 0;
+#if defined(SDLSCALER_SSE2)
+    const __m128i mask1 = _mm_set1_epi16(0x7bef);
+    const __m128i mask2 = _mm_set1_epi16(0x39e7);
+    for (; x + 8 <= n; x += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+      __m128i d = _mm_add_epi16(_mm_and_si128(_mm_srli_epi16(v, 1), mask1),
+                                _mm_and_si128(_mm_srli_epi16(v, 2), mask2));
+      _mm_storeu_si128((__m128i *)(dst + x), d);
+    }
+#elif defined(SDLSCALER_NEON)
+    const uint16x8_t mask1 = vdupq_n_u16(0x7bef);
+    const uint16x8_t mask2 = vdupq_n_u16(0x39e7);
+    for (; x + 8 <= n; x += 8) {
+      uint16x8_t v = vld1q_u16(src + x);
+      vst1q_u16(dst + x, vaddq_u16(vandq_u16(vshrq_n_u16(v, 1), mask1),
+                                   vandq_u16(vshrq_n_u16(v, 2), mask2)));
+    }
+#endif
+    for (; x < n; x++) {
+      dst[x] = darken(src[x]);
+    }
+  }
+
+public:
+  /**
+   * @brief Scales a RGB565 image by an integer factor.
+   *
+   * Each source pixel is replicated factor x factor times (nearest
+   * neighbour). If scanlines is set (and factor > 1), the last row of each
+   * scaled source row is darkened to 75% brightness.
+   *
+   * @param src Source image.
+   * @param w Width of the source image in pixels.
+   * @param h Height of the source image in pixels.
+   * @param dst Destination image (at least w*factor x h*factor pixels).
+   * @param dstpitch Length of a destination row in bytes.
+   * @param factor Scaling factor (1..8).
+   * @param scanlines Enable scanline effect.
+   */
+  static void scale(const uint16_t *src, uint16_t w, uint16_t h, void *dst,
+                    int dstpitch, uint8_t factor, bool scanlines) {
+    uint32_t dstw = (uint32_t)w * factor;
+    uint8_t *dstrow = (uint8_t *)dst;
+    bool darkenlast = scanlines && (factor > 1);
+    for (uint16_t y = 0; y < h; y++) {
+      uint16_t *row0 = (uint16_t *)dstrow;
+      switch (factor) {
+      case 1:
+        memcpy(row0, src, w * sizeof(uint16_t));
+        break;
+      case 2:
+        expandRow2(src, row0, w);
+        break;
+      case 3:
+        expandRow3(src, row0, w);
+        break;
+      case 4:
+        expandRow4(src, row0, w);
+        break;
+      default:
+        expandRowN(src, row0, w, factor);
+        break;
+      }
+      dstrow += dstpitch;
+      uint8_t copies = darkenlast ? factor - 2 : factor - 1;
+      for (uint8_t i = 0; i < copies; i++) {
+        memcpy(dstrow, row0, dstw * sizeof(uint16_t));
+        dstrow += dstpitch;
+      }
+      if (darkenlast) {
+        darkenRow(row0, (uint16_t *)dstrow, dstw);
+        dstrow += dstpitch;
+      }
+      src += w;
+    }
+  }
+};
+#endif
+
+#endif // SDLSCALER_H
@@ -157,6 +157,31 @@ public:
    */
   virtual bool listnextentry(std::string &name, bool start) { return false; }
 
+  /**
+   * @brief Removes a file.
+   *
+   * The file must not be the currently opened file.
+   *
+   * @param path The path of the file to remove.
+   * @return true if the file was removed, false otherwise.
+   */
+  virtual bool remove(const std::string &path) { return false; }
+
+  /**
+   * @brief Renames a file.
+   *
+   * An existing file with the new name is replaced if the filesystem
+   * supports it, otherwise the operation fails. The file must not be the
+   * currently opened file.
+   *
+   * @param from The path of the file to rename.
+   * @param to The new path of the file.
+   * @return true if the file was renamed, false otherwise.
+   */
+  virtual bool rename(const std::string &from, const std::string &to) {
+    return false;
+  }
+
   virtual ~FileDriver() = default;
 };
 
@@ -32,7 +32,7 @@
 #endif
 
 namespace FileSys {
-std::unique_ptr<FileDriver> create() {
+inline std::unique_ptr<FileDriver> create() {
 #if defined(USE_SDCARD)
   return std::make_unique<SDMMCFile>();
 #elif defined(USE_LINUXFS)
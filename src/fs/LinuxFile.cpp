@@ -68,6 +68,14 @@ void LinuxFile::close() {
   }
 }
 
+bool LinuxFile::remove(const std::string &path) {
+  return std::remove(path.c_str()) == 0;
+}
+
+bool LinuxFile::rename(const std::string &from, const std::string &to) {
+  return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
 static DIR *dir_stream = nullptr;
 
 bool LinuxFile::listnextentry(std::string &name, bool start) {
@@ -37,6 +37,8 @@ public:
   int64_t size() override;
   void close() override;
   bool listnextentry(std::string &name, bool start) override;
+  bool remove(const std::string &path) override;
+  bool rename(const std::string &from, const std::string &to) override;
   ~LinuxFile() override;
 };
 #endif
@@ -84,6 +84,17 @@ void SDMMCFile::close() {
   }
 }
 
+bool SDMMCFile::remove(const std::string &path) {
+  std::string path1 = '/' + path;
+  return SD_MMC.remove(path1.c_str());
+}
+
+bool SDMMCFile::rename(const std::string &from, const std::string &to) {
+  std::string from1 = '/' + from;
+  std::string to1 = '/' + to;
+  return SD_MMC.rename(from1.c_str(), to1.c_str());
+}
+
 File listroot;
 
 bool SDMMCFile::listnextentry(std::string &name, bool start) {
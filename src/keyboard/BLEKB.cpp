@@ -26,8 +26,6 @@
 
 static const char *TAG = "BLEKB";
 
-static const uint8_t NUMOFCYCLES_KEYPRESSEDDOWN = 3;
-
 static const uint8_t C64JOYUP = 0;
 static const uint8_t C64JOYDOWN = 1;
 static const uint8_t C64JOYLEFT = 2;
@@ -64,12 +62,12 @@ void BLEKBCharacteristicCallback::onWrite(BLECharacteristic *pCharacteristic) {
 
     if (virtjoy == 0xff) {
       // key released
-      blekb.keypresseddown.store(false, std::memory_order_release);
+      blekb.keyEvents.pushKeyRelease();
     }
 
     bool deactivated = virtjoy & 0x80;
     uint8_t direction = virtjoy & 0x7f;
-    uint8_t virt = blekb.virtjoystickvalue.load(std::memory_order_acquire);
+    uint8_t virt = blekb.virtjoystickvalue;
     if (deactivated) {
       virt |= (1 << direction);
     } else {
@@ -84,7 +82,10 @@ void BLEKBCharacteristicCallback::onWrite(BLECharacteristic *pCharacteristic) {
         virt |= (1 << C64JOYUP);
       }
     }
-    blekb.virtjoystickvalue.store(virt, std::memory_order_release);
+    if (virt != blekb.virtjoystickvalue) {
+      blekb.virtjoystickvalue = virt;
+      blekb.keyEvents.pushJoystick(virt);
+    }
   } else if (len >= 3) { // keyboard codes or external commands
     // BLE client sends 3 codes for each key press: dc00, dc01, "shiftctrlcode"
     // BLE client sends at least 3 codes for each external command:
@@ -93,31 +94,30 @@ void BLEKBCharacteristicCallback::onWrite(BLECharacteristic *pCharacteristic) {
     //                bit 1 -> ctrl
     //                bit 2 -> commodore
     //                bit 7 -> external command
-    for (uint8_t i = 0; i < len; i++) {
-      blekb.buffer[i] = (uint8_t)value[i];
-    }
-    blekb.shiftctrlcode.store(blekb.buffer[2], std::memory_order_release);
-    if (!(blekb.shiftctrlcode & 128)) {
-      blekb.keypresseddowncnt.store(0, std::memory_order_release);
-      blekb.keypresseddown.store(true, std::memory_order_release);
+    if ((uint8_t)value[2] & 128) {
+      // external command: executed by the CPU thread, release active key
+      if (!blekb.extCmdQueue->push((const uint8_t *)value.c_str(), len)) {
+        PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                           "external command queue full");
+      }
+      blekb.keyEvents.pushKeyRelease();
+      return;
     }
+    blekb.keyEvents.pushKeyPress((uint8_t)value[0], (uint8_t)value[1],
+                                 (uint8_t)value[2]);
   }
 }
 
-BLEKB::BLEKB() { buffer = nullptr; }
+BLEKB::BLEKB() {
+  pCharacteristic = nullptr;
+  extCmdQueue = nullptr;
+}
 
 void BLEKB::init() {
-  if (buffer != nullptr) {
+  if (pCharacteristic != nullptr) {
     return;
   }
-  buffer = new uint8_t[256];
-  keypresseddowncnt.store(NUMOFCYCLES_KEYPRESSEDDOWN,
-                          std::memory_order_release);
-  keypresseddown.store(false, std::memory_order_release);
-  sentdc01.store(0xff, std::memory_order_release);
-  sentdc00.store(0xff, std::memory_order_release);
-  virtjoystickvalue.store(0xff, std::memory_order_release);
-  detectreleasekey.store(true, std::memory_order_release);
+  virtjoystickvalue = 0xff;
 
   // init BLE
   deviceConnected.store(false, std::memory_order_release);
@@ -150,17 +150,8 @@ void BLEKB::init() {
   esp_ble_gap_update_conn_params(&conn_params);
 }
 
-uint8_t *BLEKB::getExtCmdData() {
-  if (shiftctrlcode.load(std::memory_order_acquire) & 128) {
-    shiftctrlcode.store(0, std::memory_order_release);
-    sentdc01.store(0xff, std::memory_order_release);
-    sentdc00.store(0xff, std::memory_order_release);
-    keypresseddowncnt.store(NUMOFCYCLES_KEYPRESSEDDOWN,
-                            std::memory_order_release);
-    keypresseddown.store(false, std::memory_order_release);
-    return buffer;
-  }
-  return nullptr;
+void BLEKB::setExtCmdQueue(ExtCmdQueue *extCmdQueue) {
+  this->extCmdQueue = extCmdQueue;
 }
 
 void BLEKB::sendExtCmdNotification(uint8_t *data, size_t size) {
@@ -169,37 +160,19 @@ void BLEKB::sendExtCmdNotification(uint8_t *data, size_t size) {
   PlatformManager::getInstance().log(LOG_INFO, TAG, "notification sent");
 }
 
-void BLEKB::scanKeyboard() {
-  // "external" commands are handled in getExtCmdData()
-  if (!(shiftctrlcode.load(std::memory_order_acquire) & 128)) {
-    if ((detectreleasekey.load(std::memory_order_acquire) &&
-         keypresseddown.load(std::memory_order_acquire)) ||
-        (keypresseddowncnt.load(std::memory_order_acquire) <
-         NUMOFCYCLES_KEYPRESSEDDOWN)) {
-      // id detectreleasekey == false: key is "pressed down" at least for 24 ms
-      sentdc00.store(buffer[0], std::memory_order_release);
-      sentdc01.store(buffer[1], std::memory_order_release);
-      keypresseddowncnt.store(
-          keypresseddowncnt.load(std::memory_order_acquire) + 1,
-          std::memory_order_release);
-    } else {
-      sentdc01.store(0xff, std::memory_order_release);
-      sentdc00.store(0xff, std::memory_order_release);
-    }
-  }
-}
+void BLEKB::scanKeyboard() { keyEvents.scan(); }
 
-uint8_t BLEKB::getKBCodeDC01() { return sentdc01; }
+uint8_t BLEKB::getKBCodeDC01() { return keyEvents.getDC01(); }
 
-uint8_t BLEKB::getKBCodeDC00() { return sentdc00; }
+uint8_t BLEKB::getKBCodeDC00() { return keyEvents.getDC00(); }
 
-uint8_t BLEKB::getShiftctrlcode() { return shiftctrlcode; }
+uint8_t BLEKB::getShiftctrlcode() { return keyEvents.getShiftctrlcode(); }
 
-uint8_t BLEKB::getKBJoyValue() {
-  return virtjoystickvalue.load(std::memory_order_acquire);
-}
+uint8_t BLEKB::getKBJoyValue() { return keyEvents.getJoyValue(); }
+
+int64_t BLEKB::getEventTimeUS() { return keyEvents.getEventTime(); }
 
-void BLEKB::setDetectReleasekey(bool detectreleasekeyVal) {
-  detectreleasekey.store(detectreleasekeyVal, std::memory_order_release);
+void BLEKB::setDetectReleasekey(bool detectreleasekey) {
+  keyEvents.setDetectReleasekey(detectreleasekey);
 }
 #endif
@@ -19,6 +19,7 @@
 
 #include "../Config.h"
 #ifdef USE_BLE_KEYBOARD
+#include "KeyEventQueue.h"
 #include "KeyboardDriver.h"
 #include <BLEServer.h>
 #include <atomic>
@@ -27,27 +28,24 @@
 class BLEKB : public KeyboardDriver {
 private:
   BLECharacteristic *pCharacteristic;
-  std::atomic<uint8_t> sentdc01;
-  std::atomic<uint8_t> sentdc00;
-  std::atomic<bool> detectreleasekey;
 
 public:
-  uint8_t *buffer;
+  KeyEventQueue keyEvents;
+  ExtCmdQueue *extCmdQueue;
   std::atomic<bool> deviceConnected;
-  std::atomic<uint8_t> shiftctrlcode;
-  std::atomic<uint8_t> keypresseddowncnt;
-  std::atomic<uint8_t> virtjoystickvalue;
-  std::atomic<bool> keypresseddown;
+  // only accessed by the BLE task
+  uint8_t virtjoystickvalue;
 
   BLEKB();
   void init() override;
-  uint8_t *getExtCmdData() override;
+  void setExtCmdQueue(ExtCmdQueue *extCmdQueue) override;
   void sendExtCmdNotification(uint8_t *data, size_t size) override;
   void scanKeyboard() override;
   uint8_t getKBCodeDC01() override;
   uint8_t getKBCodeDC00() override;
   uint8_t getShiftctrlcode() override;
   uint8_t getKBJoyValue() override;
+  int64_t getEventTimeUS() override;
   void setDetectReleasekey(bool detectreleasekey) override;
 };
 
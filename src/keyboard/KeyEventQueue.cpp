@@ -0,0 +1,96 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#include "KeyEventQueue.h"
+#include "../platform/PlatformManager.h"
+
+bool KeyEventQueue::push(EventType type, uint8_t dc00, uint8_t dc01,
+                         uint8_t shiftctrlcode) {
+  KeyEvent event = {PlatformManager::getInstance().getTimeUS(), type, dc00,
+                    dc01, shiftctrlcode};
+  bool ok = (type == EventType::JOYSTICK) ? joyevents.push(event)
+                                          : events.push(event);
+  if (!ok) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+bool KeyEventQueue::pushKeyPress(uint8_t dc00, uint8_t dc01,
+                                 uint8_t shiftctrlcode) {
+  return push(EventType::KEYPRESS, dc00, dc01, shiftctrlcode);
+}
+
+bool KeyEventQueue::pushKeyRelease() {
+  return push(EventType::KEYRELEASE, 0xff, 0xff, 0);
+}
+
+bool KeyEventQueue::pushJoystick(uint8_t joyvalue) {
+  return push(EventType::JOYSTICK, joyvalue, 0xff, 0);
+}
+
+uint32_t KeyEventQueue::getDropped() {
+  return dropped.exchange(0, std::memory_order_relaxed);
+}
+
+void KeyEventQueue::setDetectReleasekey(bool detectreleasekey) {
+  this->detectreleasekey = detectreleasekey;
+}
+
+void KeyEventQueue::scan() {
+  if (holdscans > 0) {
+    holdscans--;
+  }
+  KeyEvent *event;
+  while ((event = joyevents.front()) != nullptr) {
+    joyvalue = event->dc00;
+    eventtime = event->timestamp;
+    joyevents.release();
+  }
+  while ((event = events.front()) != nullptr) {
+    // key is "pressed down" at least for MINHOLDSCANS scans
+    if (active && (holdscans > 0)) {
+      break;
+    }
+    if (event->type == EventType::KEYPRESS) {
+      dc00 = event->dc00;
+      dc01 = event->dc01;
+      shiftctrlcode = event->shiftctrlcode;
+      active = true;
+      holdscans = MINHOLDSCANS;
+    } else if (active) {
+      active = false;
+    } else {
+      // release of a key which is not pressed (anymore)
+      events.release();
+      continue;
+    }
+    eventtime = event->timestamp;
+    events.release();
+    // one key event per scan (key release is visible at least for one scan)
+    break;
+  }
+  // no key release detection: key is released after MINHOLDSCANS scans
+  if (active && (holdscans == 0) && !detectreleasekey) {
+    active = false;
+  }
+  if (!active) {
+    dc00 = 0xff;
+    dc01 = 0xff;
+    shiftctrlcode = 0;
+  }
+}
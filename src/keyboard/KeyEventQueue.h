@@ -0,0 +1,86 @@
+/*
+ Copyright (C) 2024-2025 retroelec <retroelec42@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify it
+ under the terms of the GNU General Public License as published by the
+ Free Software Foundation; either version 3 of the License, or (at your
+ option) any later version.
+
+ This program is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ for more details.
+
+ For the complete text of the GNU General Public License see
+ http://www.gnu.org/licenses/.
+*/
+#ifndef KEYEVENTQUEUE_H
+#define KEYEVENTQUEUE_H
+
+#include "../SPSCRing.h"
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Lock-free queue of timestamped key and joystick events passed from
+ * the input thread of a keyboard driver to the keyboard scan (CPU thread).
+ *
+ * The producer side (BLE callback, web socket handler, SDL event loop) only
+ * translates its input into events. The consumer side implements the
+ * press/hold/release state machine common to all keyboard drivers: at most
+ * one key event is applied per keyboard scan and a pressed key is visible to
+ * the C64 for at least MINHOLDSCANS scans, so short key presses and fast
+ * typing are not lost.
+ */
+class KeyEventQueue {
+public:
+  // minimal number of keyboard scans a key is "pressed down" (24 ms)
+  static const uint8_t MINHOLDSCANS = 3;
+
+private:
+  enum class EventType : uint8_t { KEYPRESS, KEYRELEASE, JOYSTICK };
+  struct KeyEvent {
+    int64_t timestamp; // us
+    EventType type;
+    uint8_t dc00; // joystick: joystick value
+    uint8_t dc01;
+    uint8_t shiftctrlcode;
+  };
+
+  // producer side, joystick events have their own queue so they are not
+  // held back by a pressed key
+  SPSCRing<KeyEvent, 64> events;
+  SPSCRing<KeyEvent, 16> joyevents;
+  std::atomic<uint32_t> dropped{0};
+
+  // consumer side
+  uint8_t dc00 = 0xff;
+  uint8_t dc01 = 0xff;
+  uint8_t shiftctrlcode = 0;
+  uint8_t joyvalue = 0xff;
+  bool active = false;
+  uint8_t holdscans = 0;
+  bool detectreleasekey = true;
+  int64_t eventtime = 0;
+
+  bool push(EventType type, uint8_t dc00, uint8_t dc01,
+            uint8_t shiftctrlcode);
+
+public:
+  // producer side, false if the queue is full (the event is dropped)
+  bool pushKeyPress(uint8_t dc00, uint8_t dc01, uint8_t shiftctrlcode);
+  bool pushKeyRelease();
+  bool pushJoystick(uint8_t joyvalue);
+  uint32_t getDropped();
+
+  // consumer side
+  void scan();
+  void setDetectReleasekey(bool detectreleasekey);
+  uint8_t getDC00() const { return dc00; }
+  uint8_t getDC01() const { return dc01; }
+  uint8_t getShiftctrlcode() const { return shiftctrlcode; }
+  uint8_t getJoyValue() const { return joyvalue; }
+  int64_t getEventTime() const { return eventtime; }
+};
+
+#endif // KEYEVENTQUEUE_H
@@ -18,6 +18,7 @@
 #define KEYBOARDDRIVER_H
 
 #include "../ExtCmd.h"
+#include "../ExtCmdQueue.h"
 #include <cstddef>
 #include <cstdint>
 
@@ -40,10 +41,11 @@ public:
   /**
    * @brief Performs a keyboard scan and updates internal variables.
    *
-   * This method is invoked periodically (every 8 ms) by an external process
-   * or timer rather than the main execution flow. Because of this, all
-   * involved variables that are read or modified within this method should
-   * be declared as atomic to ensure safe concurrent access.
+   * This method is invoked periodically (every 8 ms of emulated time) by the
+   * CPU thread. Key events are passed from the input thread of the driver to
+   * this method via a KeyEventQueue which also implements the
+   * press/hold/release timing. The get methods below are called by the CPU
+   * thread, too.
    */
   virtual void scanKeyboard() = 0;
 
@@ -81,15 +83,24 @@ public:
   virtual uint8_t getKBJoyValue() = 0;
 
   /**
-   * @brief Retrieves an external command including corresponding data.
+   * @brief Retrieves the time of the key event which led to the current
+   * key codes resp. joystick emulation value (input latency measurement).
    *
-   * Is called once per frame.
+   * @return Time of the event in us, 0 if not available.
+   */
+  virtual int64_t getEventTimeUS() { return 0; }
+
+  /**
+   * @brief Sets the queue for external commands.
    *
-   * @return Pointer to the data containing the external command including
-   * parameters. The null pointer is returned if no command is requested.
+   * Is called once before init(). The driver pushes each external command
+   * including corresponding data into this queue (from any thread), the
+   * queue is drained by the CPU thread once per frame.
    * See enum class ExtCmd for the content of the data buffer.
+   *
+   * @param extCmdQueue Queue for external commands.
    */
-  virtual uint8_t *getExtCmdData() = 0;
+  virtual void setExtCmdQueue(ExtCmdQueue *extCmdQueue) = 0;
 
   /**
    * @brief Sends an external command notification to the client.
@@ -110,9 +121,9 @@ public:
    * @brief Synchronizes SDL events with the main thread and creates the attach
    * window when needed.
    *
-   * Polls keyboard events and enqueues them for later processing by the
-   * method scanKeyboard() and creates the attach window when the corresponding
-   * event is triggered.
+   * Polls keyboard events, translates them into key events for later
+   * processing by the method scanKeyboard() resp. into external commands and
+   * creates the attach window when the corresponding event is triggered.
    *
    * The method is intended for SDL Keyboards only. It is called in the main
    * thread.
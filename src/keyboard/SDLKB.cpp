@@ -22,8 +22,6 @@
 #include "platform/PlatformManager.h"
 #include <SDL2/SDL.h>
 #include <cstdint>
-#include <mutex>
-#include <queue>
 
 static const char *TAG = "SDLKB";
 
@@ -31,12 +29,6 @@ static const uint8_t CHARPIXSIZE = 4;
 extern void drawChar(SDL_Renderer *ren, uint16_t c, uint16_t x, uint16_t y,
                      uint8_t size);
 
-void SDLKB::setCodes(uint8_t code1, uint8_t code2, uint8_t ctrlcode) {
-  kbcode1 = code1;
-  kbcode2 = code2;
-  shiftctrlcode = ctrlcode;
-}
-
 void SDLKB::handleKeyEvent(SDL_Keycode key, SDL_Keymod mod, bool pressed) {
   if (attachwinopen) {
     SDL_SetRenderDrawColor(attachrenderer, 0, 0, 50, 255);
@@ -81,7 +73,7 @@ void SDLKB::handleKeyEvent(SDL_Keycode key, SDL_Keymod mod, bool pressed) {
           std::copy(diskname, diskname + strlen(diskname) + 1,
                     extCmdBuffer + 3);
         }
-        gotExternalCmd = true;
+        pushExtCmd();
       } else {
         if (strlen(diskname) < DISKNAMEMAXLEN - 1) {
           uint8_t ch = (uint8_t)key;
@@ -105,7 +97,7 @@ void SDLKB::handleKeyEvent(SDL_Keycode key, SDL_Keymod mod, bool pressed) {
                                "          **** HELP PAGE ****\r\r"
                                "RCTRL-H FOR THIS HELP PAGE\r"
                                "RCTRL-Q TO QUIT THE EMULATOR\r"
-                               "RCTRL-L TO LOAD A PROGRAM\r"
+                               "RCTRL-L TO LOAD, +SHIFT TO LOAD AND RUN\r"
                                "        (SEE CONFIG::PATH, README.MD)\r"
                                "RCTRL-S TO SAVE A PROGRAM\r"
                                "RCTRL-T TO LIST PROGRAMS\r"
@@ -120,76 +112,108 @@ void SDLKB::handleKeyEvent(SDL_Keycode key, SDL_Keymod mod, bool pressed) {
                                "        IF A JOYSTICK PORT IS CHOSEN\r"
                                "RCTRL-N SHOW CONTENT OF CPU REGISTERS\r"
                                "RCTRL-D SWITCH TO DEBUG MODE AND BACK\r"
+                               "RCTRL-V START/STOP RECORDING\r"
+                               "RCTRL-I LOG INPUT LATENCY, -M MOVIE\r"
+                               "RCTRL-K/G SAVE/LOAD STATE, -B REWIND\r"
                                "COMMODORE KEY = LEFT ALT\r\x9a\0";
         memcpy(&extCmdBuffer[3], help, sizeof(help));
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_q) {
-        exit(0);
+        pushPowerOff();
       }
       // "external command" keys
       else if (key == SDLK_l) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::LOAD);
-        gotExternalCmd = true;
+        extCmdBuffer[1] = (mod & KMOD_SHIFT) ? 1 : 0;
+        pushExtCmd();
       } else if (key == SDLK_s) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::SAVE);
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_t) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::LIST);
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_a) {
         if (!attachwinopen && !openattachwin) {
-          std::lock_guard<std::mutex> lock(attachWinMutex);
           openattachwin = true;
           diskname[0] = '\0';
         }
       } else if (key == SDLK_n) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::SHOWREG);
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_r) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::RESET);
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_d) {
         extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
             ExtCmd::SWITCHDEBUG);
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_COMMA) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::DECVOLUME);
         extCmdBuffer[1] = 10;
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_PERIOD) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::INCVOLUME);
         extCmdBuffer[1] = 10;
-        gotExternalCmd = true;
+        pushExtCmd();
+      } else if (key == SDLK_i) {
+        extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
+            ExtCmd::GETINPUTLATENCY);
+        extCmdBuffer[1] = 3;
+        pushExtCmd();
+      } else if ((key == SDLK_k) || (key == SDLK_g)) {
+        extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
+            key == SDLK_k ? ExtCmd::SAVESTATE : ExtCmd::LOADSTATE);
+        extCmdBuffer[1] = 1;
+        extCmdBuffer[3] = '\0';
+        pushExtCmd();
+      } else if (key == SDLK_m) {
+        // record (from the actual state) resp. replay, stop if active
+        extCmdBuffer[0] =
+            static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::MOVIE);
+        extCmdBuffer[1] = (mod & KMOD_SHIFT) ? 3 : 2;
+        extCmdBuffer[2] = 0;
+        extCmdBuffer[3] = '\0';
+        pushExtCmd();
+      } else if (key == SDLK_b) {
+        extCmdBuffer[0] =
+            static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::REWIND);
+        extCmdBuffer[1] = (mod & KMOD_SHIFT) ? 0 : 1;
+        pushExtCmd();
+      } else if (key == SDLK_v) {
+        extCmdBuffer[0] =
+            static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::CAPTURE);
+        extCmdBuffer[3] = '\0';
+        pushExtCmd();
       } else if (key == SDLK_p) {
         extCmdBuffer[0] =
             static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::PAUSE);
-        gotExternalCmd = true;
+        pushExtCmd();
       } else if (key == SDLK_j) {
         switch (joystickmode) {
         case ExtCmd::JOYSTICKMODEOFF:
           joystickmode = ExtCmd::JOYSTICKMODE1;
           extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
               ExtCmd::JOYSTICKMODE1);
-          gotExternalCmd = true;
+          pushExtCmd();
           break;
         case ExtCmd::JOYSTICKMODE1:
           joystickmode = ExtCmd::JOYSTICKMODE2;
           extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
               ExtCmd::JOYSTICKMODE2);
-          gotExternalCmd = true;
+          pushExtCmd();
           break;
         case ExtCmd::JOYSTICKMODE2:
           joystickmode = ExtCmd::JOYSTICKMODEOFF;
           extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
               ExtCmd::JOYSTICKMODEOFF);
-          gotExternalCmd = true;
+          pushExtCmd();
           break;
         default:
           break;
@@ -218,7 +242,7 @@ void SDLKB::handleKeyEvent(SDL_Keycode key, SDL_Keymod mod, bool pressed) {
         auto it = keyMap.find(k);
         if (it != keyMap.end()) {
           auto [b1, b2, b3] = it->second;
-          setCodes(b1, b2, b3);
+          keyEvents.pushKeyPress(b1, b2, b3);
           found = true;
         }
       }
@@ -237,12 +261,12 @@ void SDLKB::handleKeyEvent(SDL_Keycode key, SDL_Keymod mod, bool pressed) {
           } else if (mod & KMOD_LALT) {
             b3 |= 4;
           }
-          setCodes(b1, b2, b3);
+          keyEvents.pushKeyPress(b1, b2, b3);
         }
       }
     }
   } else {
-    setCodes(0xff, 0xff, 0x00);
+    keyEvents.pushKeyRelease();
   }
 }
 
@@ -265,7 +289,7 @@ void SDLKB::printHelpHint() {
   extCmdBuffer[11] = 1;
   memcpy(&extCmdBuffer[12], helpbox, 20 * 3);
   extCmdBuffer[0] = {static_cast<uint8_t>(ExtCmd::WRITEOSD)};
-  gotExternalCmd = true;
+  pushExtCmd();
 }
 
 void SDLKB::init() {
@@ -275,15 +299,18 @@ void SDLKB::init() {
 }
 
 void SDLKB::syncAndCreateAttachWinSDL() {
-  // synchronize SDL events with the main thread
+  // translate SDL events into key events resp. external commands
   SDL_Event ev;
   while (SDL_PollEvent(&ev)) {
-    std::lock_guard<std::mutex> lock(eventMutex);
-    eventQueue.push(ev);
+    if (ev.type == SDL_QUIT) {
+      pushPowerOff();
+    } else if (ev.type == SDL_KEYDOWN || ev.type == SDL_KEYUP) {
+      handleKeyEvent(ev.key.keysym.sym, SDL_GetModState(),
+                     ev.type == SDL_KEYDOWN);
+    }
   }
   // create the attach window when needed
   if (openattachwin) {
-    std::lock_guard<std::mutex> lock(attachWinMutex);
     openattachwin = false;
     attachwin =
         SDL_CreateWindow("attach disk, enter d64 name", SDL_WINDOWPOS_CENTERED,
@@ -299,35 +326,35 @@ void SDLKB::syncAndCreateAttachWinSDL() {
   }
 }
 
-void SDLKB::scanKeyboard() {
-  std::lock_guard<std::mutex> lock(eventMutex);
-  while (!eventQueue.empty()) {
-    auto ev = eventQueue.front();
-    eventQueue.pop();
-    if (ev.type == SDL_QUIT) {
-      exit(0);
-    } else if (ev.type == SDL_KEYDOWN || ev.type == SDL_KEYUP) {
-      handleKeyEvent(ev.key.keysym.sym, SDL_GetModState(),
-                     ev.type == SDL_KEYDOWN);
-    }
-  }
-}
+void SDLKB::scanKeyboard() { keyEvents.scan(); }
 
-uint8_t SDLKB::getKBCodeDC01() { return kbcode2; }
+uint8_t SDLKB::getKBCodeDC01() { return keyEvents.getDC01(); }
 
-uint8_t SDLKB::getKBCodeDC00() { return kbcode1; }
+uint8_t SDLKB::getKBCodeDC00() { return keyEvents.getDC00(); }
 
-uint8_t SDLKB::getShiftctrlcode() { return shiftctrlcode; }
+uint8_t SDLKB::getShiftctrlcode() { return keyEvents.getShiftctrlcode(); }
 
 uint8_t SDLKB::getKBJoyValue() { return 0xff; }
 
-uint8_t *SDLKB::getExtCmdData() {
-  if (gotExternalCmd) {
-    gotExternalCmd = false;
-    extCmdBuffer[2] = 0x80;
-    return extCmdBuffer;
+int64_t SDLKB::getEventTimeUS() { return keyEvents.getEventTime(); }
+
+void SDLKB::setExtCmdQueue(ExtCmdQueue *extCmdQueue) {
+  this->extCmdQueue = extCmdQueue;
+}
+
+void SDLKB::pushExtCmd() {
+  extCmdBuffer[2] = 0x80;
+  if (!extCmdQueue->push(extCmdBuffer, sizeof(extCmdBuffer))) {
+    PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                       "external command queue full");
   }
-  return nullptr;
+}
+
+void SDLKB::pushPowerOff() {
+  // the emulation writes back the disk image before it exits
+  extCmdBuffer[0] =
+      static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::POWEROFF);
+  pushExtCmd();
 }
 
 void SDLKB::sendExtCmdNotification(uint8_t *data, size_t size) {
@@ -337,7 +364,9 @@ void SDLKB::sendExtCmdNotification(uint8_t *data, size_t size) {
   // }
 }
 
-void SDLKB::setDetectReleasekey(bool detectreleasekey) {}
+void SDLKB::setDetectReleasekey(bool detectreleasekey) {
+  keyEvents.setDetectReleasekey(detectreleasekey);
+}
 
 void SDLKB::setSpecialjoymode(bool specialjoymode) {
   this->specialjoymode = specialjoymode;
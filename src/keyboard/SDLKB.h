@@ -20,20 +20,19 @@
 #include "../Config.h"
 #ifdef USE_SDL_KEYBOARD
 #include "../ExtCmd.h"
+#include "KeyEventQueue.h"
 #include "KeyboardDriver.h"
 #include <SDL2/SDL.h>
 #include <atomic>
 #include <cstdint>
-#include <mutex>
-#include <queue>
 
 class SDLKB : public KeyboardDriver {
 private:
-  std::atomic<bool> gotExternalCmd = false;
-  uint8_t extCmdBuffer[1024];
+  ExtCmdQueue *extCmdQueue = nullptr;
+  uint8_t extCmdBuffer[ExtCmdQueue::CMDSIZE];
 
-  bool joystickActive = false;
-  ExtCmd joystickmode = ExtCmd::JOYSTICKMODEOFF;
+  std::atomic<bool> joystickActive = false;
+  std::atomic<ExtCmd> joystickmode = ExtCmd::JOYSTICKMODEOFF;
 
   bool keyRight = false;
   bool keyLeft = false;
@@ -41,7 +40,7 @@ private:
   bool keyDown = false;
   bool keyFire = false;
 
-  bool specialjoymode;
+  std::atomic<bool> specialjoymode;
 
   bool attachwinopen = false;
   bool openattachwin = false;
@@ -50,21 +49,16 @@ private:
   SDL_Window *attachwin = NULL;
   SDL_Renderer *attachrenderer = NULL;
 
-  std::atomic<uint8_t> kbcode1;
-  std::atomic<uint8_t> kbcode2;
-  std::atomic<uint8_t> shiftctrlcode;
+  KeyEventQueue keyEvents;
 
-  std::queue<SDL_Event> eventQueue;
-  std::mutex eventMutex;
-  std::mutex attachWinMutex;
-
-  void setCodes(uint8_t code1, uint8_t code2, uint8_t ctrlcode);
   void handleKeyEvent(SDL_Keycode key, SDL_Keymod mod, bool pressed);
   void printHelpHint();
+  void pushExtCmd();
+  void pushPowerOff();
 
 public:
   void init() override;
-  uint8_t *getExtCmdData() override;
+  void setExtCmdQueue(ExtCmdQueue *extCmdQueue) override;
   void sendExtCmdNotification(uint8_t *data, size_t size) override;
   void syncAndCreateAttachWinSDL() override;
   void scanKeyboard() override;
@@ -72,6 +66,7 @@ public:
   uint8_t getKBCodeDC00() override;
   uint8_t getShiftctrlcode() override;
   uint8_t getKBJoyValue() override;
+  int64_t getEventTimeUS() override;
   void setDetectReleasekey(bool detectreleasekey) override;
   void setSpecialjoymode(bool specialjoymode) override;
   void setJoystickmode(ExtCmd joystickmode) override;
@@ -405,19 +405,10 @@ void WebKB::printIPAddress() {
   memcpy(&ipaddrbox[40], ipString.c_str(), ipString.length());
   memcpy(&extCmdBuffer[12], ipaddrbox, 28 * 3);
   extCmdBuffer[0] = {static_cast<uint8_t>(ExtCmd::WRITEOSD)};
-  gotExternalCmd = true;
+  pushExtCmd();
 }
 
 void WebKB::init() {
-  queueSem = xSemaphoreCreateBinary();
-  xSemaphoreGive(queueSem);
-
-  currentKey.dc0 = 0xff;
-  currentKey.dc1 = 0xff;
-  currentKey.shift = 0;
-  currentKey.active = false;
-  currentKey.holdTicks = 0;
-
   PlatformManager::getInstance().log(LOG_INFO, TAG, "Init Wifi");
 
   // create webserver instance
@@ -448,7 +439,7 @@ void WebKB::init() {
   // start with joystickmode 2 at startup
   extCmdBuffer[0] =
       static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::JOYSTICKMODE2);
-  gotExternalCmd = true;
+  pushExtCmd();
 }
 
 // scan for wifi networks
@@ -639,58 +630,59 @@ void WebKB::processSingleKey(const char *type, const char *keyId, bool shift,
     if (strcmp(keyId, "char:RESET") == 0) {
       extCmdBuffer[0] =
           static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::RESET);
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:LOAD") == 0) {
       extCmdBuffer[0] =
           static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::LOAD);
-      gotExternalCmd = true;
+      extCmdBuffer[1] = 0;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:SAVE") == 0) {
       extCmdBuffer[0] =
           static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::SAVE);
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:LIST") == 0) {
       extCmdBuffer[0] =
           static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::LIST);
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:PageUp") == 0) {
       extCmdBuffer[0] =
           static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::RESTORE);
       extCmdBuffer[1] = 0x00;
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:INCVOLUME") == 0) {
       extCmdBuffer[0] =
           static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::INCVOLUME);
       extCmdBuffer[1] = 10;
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:DECVOLUME") == 0) {
       extCmdBuffer[0] =
           static_cast<std::underlying_type<ExtCmd>::type>(ExtCmd::DECVOLUME);
       extCmdBuffer[1] = 10;
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:JOYMODE1") == 0) {
       extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
           ExtCmd::JOYSTICKMODE1);
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
     if (strcmp(keyId, "char:JOYMODE2") == 0) {
       extCmdBuffer[0] = static_cast<std::underlying_type<ExtCmd>::type>(
           ExtCmd::JOYSTICKMODE2);
-      gotExternalCmd = true;
+      pushExtCmd();
       return;
     }
   }
@@ -712,86 +704,32 @@ void WebKB::processSingleKey(const char *type, const char *keyId, bool shift,
     PlatformManager::getInstance().log(LOG_DEBUG, TAG, "keycodes: %d %d",
                                        std::get<0>(code), std::get<1>(code));
 
-    // set register for key down
     if (strcmp(type, "key-down") == 0) {
-
-      if (xSemaphoreTake(queueSem, portMAX_DELAY) == pdTRUE) {
-        uint8_t shiftcode = std::get<2>(code);
-        if (shiftlock)
-          shiftcode |= 0x01;
-        eventQueue.emplace(std::get<1>(code), std::get<0>(code), shiftcode);
-        xSemaphoreGive(queueSem);
-      }
-
+      uint8_t shiftcode = std::get<2>(code);
+      if (shiftlock)
+        shiftcode |= 0x01;
+      keyEvents.pushKeyPress(std::get<0>(code), std::get<1>(code), shiftcode);
     } else if (strcmp(type, "key-up") == 0) {
-      // key release → all bits to 0xff
-      if (xSemaphoreTake(queueSem, portMAX_DELAY) == pdTRUE) {
-        eventQueue.emplace(0xff, 0xff, 0x00);
-        xSemaphoreGive(queueSem);
-      }
+      keyEvents.pushKeyRelease();
     }
   }
 }
 
-void WebKB::scanKeyboard() {
-
-  // countdown
-  if (currentKey.active && currentKey.holdTicks > 0) {
-    currentKey.holdTicks--;
-  }
-
-  // if the key is not active for at least 24 ms, do nothing (3*8ms)
-  if (currentKey.active && currentKey.holdTicks > 0) {
-    return;
-  }
-
-  // otherwise check queue
-  bool gotEvent = false;
-  uint8_t _dc1, _dc0, _shift;
-
-  if (xSemaphoreTake(queueSem, 0) == pdTRUE) {
-    if (!eventQueue.empty()) {
-      auto e = eventQueue.front();
-      eventQueue.pop();
-      gotEvent = true;
-      std::tie(_dc1, _dc0, _shift) = e;
-    }
-    xSemaphoreGive(queueSem);
-  }
-
-  if (gotEvent) {
-    if (_dc1 == 0xFF && _dc0 == 0xFF) {
-      currentKey.active = false;
-    } else {
-      // key press
-      currentKey.dc1 = _dc1;
-      currentKey.dc0 = _dc0;
-      currentKey.shift = _shift;
-      currentKey.holdTicks = 3; // 3×8ms = 24ms
-      currentKey.active = true;
-    }
-  }
-
-  // set registers
-  if (currentKey.active) {
-    setKBcodes(currentKey.dc1, currentKey.dc0);
-    shiftctrlcode.store(currentKey.shift, std::memory_order_release);
-  } else {
-    setKBcodes(0xFF, 0xFF);
-    shiftctrlcode.store(0, std::memory_order_release);
-  }
-}
+void WebKB::scanKeyboard() { keyEvents.scan(); }
 
 // ----------------------------------------------------
 // external commands
 // ----------------------------------------------------
-uint8_t *WebKB::getExtCmdData() {
-  if (gotExternalCmd) {
-    gotExternalCmd = false;
-    extCmdBuffer[2] = 0x80;
-    return extCmdBuffer;
+void WebKB::setExtCmdQueue(ExtCmdQueue *extCmdQueue) {
+  this->extCmdQueue = extCmdQueue;
+}
+
+void WebKB::pushExtCmd() {
+  extCmdBuffer[2] = 0x80;
+  if (!extCmdQueue->push(extCmdBuffer, sizeof(extCmdBuffer))) {
+    PlatformManager::getInstance().log(LOG_INFO, TAG,
+                                       "external command queue full");
   }
-  return nullptr;
 }
 
 void WebKB::sendExtCmdNotification(uint8_t *data, size_t size) {}
@@ -20,26 +20,16 @@
 #include "../Config.h"
 #ifdef USE_WEB_KEYBOARD
 
+#include "KeyEventQueue.h"
 #include "KeyboardDriver.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
 #include <Arduino.h>
 #include <ESPAsyncDNSServer.h>
 #include <ESPAsyncWebServer.h>
 #include <Preferences.h>
-#include <atomic>
-#include <queue>
+#include <tuple>
 
 using CodeTriple = std::tuple<uint8_t, uint8_t, uint8_t>;
 
-struct ActiveKey {
-  uint8_t dc1;
-  uint8_t dc0;
-  uint8_t shift;
-  uint8_t holdTicks;
-  bool active;
-};
-
 class WebKB : public KeyboardDriver {
 public:
   WebKB(uint16_t port = 80);
@@ -47,26 +37,19 @@ public:
 
   void init() override;
 
-  uint8_t getKBCodeDC01() override {
-    uint16_t v = dc01dc00.load(std::memory_order_acquire);
-    return static_cast<uint8_t>(v >> 8);
-  }
-  uint8_t getKBCodeDC00() override {
-    uint16_t v = dc01dc00.load(std::memory_order_acquire);
-    return static_cast<uint8_t>(v & 0xFF);
-  }
-  uint8_t getShiftctrlcode() override {
-    return shiftctrlcode.load(std::memory_order_acquire);
-  }
-  uint8_t getKBJoyValue() override {
-    return joyvalue.load(std::memory_order_acquire);
-  }
+  uint8_t getKBCodeDC01() override { return keyEvents.getDC01(); }
+  uint8_t getKBCodeDC00() override { return keyEvents.getDC00(); }
+  uint8_t getShiftctrlcode() override { return keyEvents.getShiftctrlcode(); }
+  uint8_t getKBJoyValue() override { return keyEvents.getJoyValue(); }
+  int64_t getEventTimeUS() override { return keyEvents.getEventTime(); }
 
-  uint8_t *getExtCmdData() override;
+  void setExtCmdQueue(ExtCmdQueue *extCmdQueue) override;
   void sendExtCmdNotification(uint8_t *data, size_t size) override;
 
   void scanKeyboard() override;
-  void setDetectReleasekey(bool detectreleasekey) override {}
+  void setDetectReleasekey(bool detectreleasekey) override {
+    keyEvents.setDetectReleasekey(detectreleasekey);
+  }
 
 private:
   void startWebServer();
@@ -74,30 +57,21 @@ private:
   void processSingleKey(const char *type, const char *keyId, bool shift,
                         bool ctrl, bool comm);
   void printIPAddress();
+  void pushExtCmd();
   String getNetworksHTML();
   void startCaptivePortal();
   void connectToWiFi(const String &ssid, const String &pass);
 
-  void setKBcodes(uint8_t sentdc01, uint8_t sentdc00) {
-    uint16_t packed = (static_cast<uint16_t>(sentdc01) << 8) | sentdc00;
-    dc01dc00.store(packed, std::memory_order_release);
-  }
-
   uint16_t port;
   AsyncWebServer *server;
   AsyncWebSocket *ws;
   AsyncDNSServer dns_server;
   Preferences prefs;
 
-  std::atomic<uint16_t> dc01dc00; // high byte = dc01, low byte = dc00
-  std::atomic<uint8_t> shiftctrlcode{0};
-  std::atomic<uint8_t> joyvalue{0};
-  std::atomic<bool> gotExternalCmd = false;
-  uint8_t extCmdBuffer[1024];
+  KeyEventQueue keyEvents;
+  ExtCmdQueue *extCmdQueue = nullptr;
+  uint8_t extCmdBuffer[ExtCmdQueue::CMDSIZE];
   bool shiftlock = false;
-  std::queue<CodeTriple> eventQueue;
-  SemaphoreHandle_t queueSem;
-  ActiveKey currentKey;
 };
 
 #endif
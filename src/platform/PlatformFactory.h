@@ -29,7 +29,7 @@
 #endif
 
 namespace PlatformNS {
-Platform *create() {
+inline Platform *create() {
 #if defined(ESP_PLATFORM)
   return new PlatformESP32();
 #elif defined(PLATFORM_LINUX)
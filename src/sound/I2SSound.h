@@ -20,17 +20,37 @@
 #include "../Config.h"
 #ifdef USE_I2SSOUND
 #include "SoundDriver.h"
+#include <atomic>
 #include <driver/i2s_std.h>
+#include <esp_attr.h>
 #include <freertos/FreeRTOS.h>
 
 class I2SSound : public SoundDriver {
 private:
   i2s_chan_handle_t tx_channel = nullptr;
 
+  // bytes written to resp. sent by the DMA buffers (used to determine the
+  // fill level)
+  std::atomic<uint32_t> writtenbytes{0};
+  std::atomic<uint32_t> sentbytes{0};
+  uint32_t dmabufsize = 0;
+
+  static bool IRAM_ATTR onSent(i2s_chan_handle_t handle,
+                               i2s_event_data_t *event, void *userctx) {
+    static_cast<I2SSound *>(userctx)->sentbytes.fetch_add(
+        event->size, std::memory_order_release);
+    return false;
+  }
+
 public:
   void init() override {
     i2s_chan_config_t chan_cfg =
         I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    // 60 ms DMA buffer, governor keeps it half filled
+    chan_cfg.dma_desc_num = 6;
+    chan_cfg.dma_frame_num = 441;
+    dmabufsize = chan_cfg.dma_desc_num * chan_cfg.dma_frame_num *
+                 sizeof(int16_t);
     ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_channel, NULL));
 
     i2s_std_config_t std_cfg = {
@@ -52,13 +72,34 @@ public:
         }};
 
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_channel, &std_cfg));
+    i2s_event_callbacks_t cbs = {};
+    cbs.on_sent = &I2SSound::onSent;
+    ESP_ERROR_CHECK(
+        i2s_channel_register_event_callback(tx_channel, &cbs, this));
     ESP_ERROR_CHECK(i2s_channel_enable(tx_channel));
   }
 
   void playAudio(int16_t *samples, size_t size) override {
+    // after an underrun the DMA has sent silence -> resync counters
+    uint32_t sent = sentbytes.load(std::memory_order_acquire);
+    if ((int32_t)(writtenbytes.load(std::memory_order_relaxed) - sent) < 0) {
+      writtenbytes.store(sent, std::memory_order_release);
+    }
     size_t bw = 0;
     ESP_ERROR_CHECK(
         i2s_channel_write(tx_channel, samples, size, &bw, portMAX_DELAY));
+    writtenbytes.fetch_add(bw, std::memory_order_release);
+  }
+
+  int16_t getFillLevel() override {
+    int32_t fill = writtenbytes.load(std::memory_order_acquire) -
+                   sentbytes.load(std::memory_order_acquire);
+    if (fill <= 0) {
+      return 0;
+    }
+    // target: half of the DMA buffer
+    fill = fill * 2000 / dmabufsize;
+    return (fill > 2000) ? 2000 : fill;
   }
 
   ~I2SSound() {
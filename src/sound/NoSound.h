@@ -17,15 +17,13 @@
 #ifndef NOSOUND_H
 #define NOSOUND_H
 
-#include "../Config.h"
-#ifdef USE_NOSOUND
 #include "SoundDriver.h"
 
+// no audio output (boards without sound, offline rendering of the SID)
 class NoSound : public SoundDriver {
 public:
   void init() override {}
   void playAudio(int16_t *samples, size_t size) override {}
 };
-#endif
 
 #endif // NOSOUND_H
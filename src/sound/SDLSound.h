@@ -19,40 +19,63 @@
 
 #include "../Config.h"
 #ifdef USE_SDLSOUND
+#include "../SPSCRing.h"
+#include "../platform/PlatformManager.h"
 #include "SoundDriver.h"
 #include <SDL2/SDL.h>
-#include <mutex>
-#include <queue>
-#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
 
 class SDLSound : public SoundDriver {
-public:
 private:
+  static constexpr const char *TAG = "SDLSound";
+  static const uint16_t DEVICESAMPLES = 512;
   SDL_AudioDeviceID audioDevice = 0;
-  std::deque<int16_t> audioBuffer;
-  std::mutex bufferMutex;
+  SPSCRing<int16_t, 16384> audioBuffer;
+  // maximum number of buffered samples (target latency)
+  uint32_t maxBufferedSamples;
   bool initialized;
   bool quit;
 
+  // profiling info
+  std::atomic<uint32_t> underruns;
+  std::atomic<uint32_t> overruns;
+  std::atomic<uint64_t> callbackTimeNS;
+  std::atomic<uint32_t> callbackCnt;
+
   static void audioCallbackStatic(void *userdata, Uint8 *stream, int len) {
     static_cast<SDLSound *>(userdata)->audioCallback((int16_t *)stream,
                                                      len / sizeof(int16_t));
   }
 
   void audioCallback(int16_t *stream, int len) {
-    std::lock_guard<std::mutex> lock(bufferMutex);
-    for (int i = 0; i < len; ++i) {
-      if (!audioBuffer.empty()) {
-        stream[i] = audioBuffer.front();
-        audioBuffer.pop_front();
-      } else {
-        stream[i] = 0; // silence
-      }
+    auto start = std::chrono::steady_clock::now();
+    uint32_t n = audioBuffer.pop(stream, len);
+    if (n < (uint32_t)len) {
+      // silence
+      memset(stream + n, 0, (len - n) * sizeof(int16_t));
+      underruns.fetch_add(1, std::memory_order_release);
     }
+    callbackTimeNS.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count(),
+        std::memory_order_release);
+    callbackCnt.fetch_add(1, std::memory_order_release);
   }
 
 public:
-  SDLSound() : initialized(false), quit(false) {}
+  SDLSound()
+      : initialized(false), quit(false), underruns(0), overruns(0),
+        callbackTimeNS(0), callbackCnt(0) {
+    maxBufferedSamples =
+        (uint32_t)Config::AUDIOLATENCYMS * AUDIO_SAMPLE_RATE / 1000;
+    if (maxBufferedSamples > 16384) {
+      maxBufferedSamples = 16384;
+    }
+  }
 
   void init() override {
     if (SDL_Init(SDL_INIT_AUDIO) < 0) {
@@ -63,7 +86,7 @@ public:
     desiredSpec.freq = AUDIO_SAMPLE_RATE;
     desiredSpec.format = AUDIO_S16SYS;
     desiredSpec.channels = 1;
-    desiredSpec.samples = 512;
+    desiredSpec.samples = DEVICESAMPLES;
     desiredSpec.callback = &SDLSound::audioCallbackStatic;
     desiredSpec.userdata = this;
     SDL_AudioSpec obtainedSpec;
@@ -81,9 +104,40 @@ public:
     if (!initialized) {
       return;
     }
-    std::lock_guard<std::mutex> lock(bufferMutex);
-    audioBuffer.insert(audioBuffer.end(), samples,
-                       samples + (size / sizeof(int16_t)));
+    uint32_t num = size / sizeof(int16_t);
+    uint32_t buffered = audioBuffer.size();
+    uint32_t free =
+        (buffered < maxBufferedSamples) ? maxBufferedSamples - buffered : 0;
+    if (num > free) {
+      // emulation is ahead of the audio device -> drop samples to keep the
+      // latency
+      overruns.fetch_add(1, std::memory_order_release);
+      num = free;
+    }
+    audioBuffer.push(samples, num);
+  }
+
+  int16_t getFillLevel() override {
+    // target: half of the maximum latency
+    uint32_t fill = audioBuffer.size() * 2000 / maxBufferedSamples;
+    return (fill > 2000) ? 2000 : fill;
+  }
+
+  void logPerfValues() override {
+    uint32_t cnt = callbackCnt.exchange(0, std::memory_order_acq_rel);
+    uint64_t timens = callbackTimeNS.exchange(0, std::memory_order_acq_rel);
+    // a callback takes about a microsecond -> log the average with a
+    // fraction
+    uint64_t avgns = (cnt > 0) ? timens / cnt : 0;
+    PlatformManager::getInstance().log(
+        LOG_INFO, TAG,
+        "latency: %lu ms, underruns: %lu, overruns: %lu, callback: %lu.%03lu "
+        "us",
+        (unsigned long)((audioBuffer.size() + DEVICESAMPLES) * 1000 /
+                        AUDIO_SAMPLE_RATE),
+        (unsigned long)underruns.exchange(0, std::memory_order_acq_rel),
+        (unsigned long)overruns.exchange(0, std::memory_order_acq_rel),
+        (unsigned long)(avgns / 1000), (unsigned long)(avgns % 1000));
   }
 
   ~SDLSound() override {
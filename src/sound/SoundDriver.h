@@ -57,6 +57,25 @@ public:
    */
   virtual void playAudio(int16_t *samples, size_t size) = 0;
 
+  /**
+   * @brief Returns the fill level of the audio output buffer.
+   *
+   * Is used by the speed governor to keep the emulation in sync with the
+   * audio clock. Is called from the emulation task.
+   *
+   * @return Fill level in permille of the driver's target fill level (1000:
+   * target reached), -1 if the driver cannot determine the fill level.
+   */
+  virtual int16_t getFillLevel() { return -1; }
+
+  /**
+   * @brief Logs driver specific performance values.
+   *
+   * Is called once per second if performance logging is switched on.
+   * Counters are reset after each call.
+   */
+  virtual void logPerfValues() {}
+
   virtual ~SoundDriver() {}
 };
 